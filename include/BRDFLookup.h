@@ -0,0 +1,63 @@
+#ifndef BRDFLOOKUP_H_
+#define BRDFLOOKUP_H_
+#include <ngl/Types.h>
+#include <array>
+#include <optional>
+#include <string_view>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file BRDFLookup.h
+/// @brief the BRDF evaluations the forward shader can be built with, and the table the BRDF_LUT one reads
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Reference is the original per light Cook-Torrance code, Fast moves the light independent terms out of
+/// the loop and uses a spherical gaussian for the Fresnel power, LUT is Fast with the geometry and Fresnel terms
+/// read from BRDFLookup's texture
+//----------------------------------------------------------------------------------------------------------------------
+enum class BRDFMode
+{
+  Reference,
+  Fast,
+  LUT
+};
+constexpr std::array<std::string_view, 3> BRDFModeNames = {"reference", "fast", "lut"};
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief look a mode up by its name in BRDFModeNames
+/// @param [in] _name the name, as given on the command line
+/// @returns the mode, or nothing if the name isn't one
+//----------------------------------------------------------------------------------------------------------------------
+std::optional<BRDFMode> brdfModeFromName(std::string_view _name);
+constexpr std::string_view brdfModeName(BRDFMode _mode) { return BRDFModeNames[static_cast<size_t>(_mode)]; }
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class BRDFLookup
+/// @brief a two channel float texture indexed by a cosine across and the roughness down. Red is the Schlick-GGX
+/// geometry term for that cosine and roughness and green (1 - cosine)^5, which doesn't depend on the roughness
+/// but shares the fetch coordinates. It is computed once on the CPU and is small enough to stay in the texture cache
+//----------------------------------------------------------------------------------------------------------------------
+class BRDFLookup
+{
+public:
+  BRDFLookup() = default;
+  BRDFLookup(const BRDFLookup &) = delete;
+  BRDFLookup &operator=(const BRDFLookup &) = delete;
+  ~BRDFLookup();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief build the table and upload it, must be called once a GL context is valid
+  //----------------------------------------------------------------------------------------------------------------------
+  void create();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the texture for the brdfLUT sampler in PBRFragment.glsl
+  /// @param [in] _unit the texture unit the sampler uses
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind(GLuint _unit) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief entries along each side, linear filtering between them is well inside 8 bit output precision
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr int Size = 64;
+
+private:
+  GLuint m_textureID = 0;
+};
+
+#endif
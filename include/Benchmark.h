@@ -0,0 +1,209 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+#include <ngl/Types.h>
+#include "BRDFLookup.h"
+#include <QSurfaceFormat>
+#include <memory>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Benchmark.h
+/// @brief headless frame time benchmark, renders NGLScene into an FBO on a QOffscreenSurface so it can run in CI
+/// under Mesa llvmpipe with no window system
+//----------------------------------------------------------------------------------------------------------------------
+
+class NGLScene;
+class QOffscreenSurface;
+class QOpenGLContext;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class Benchmark
+/// @brief renders a fixed orbit of the camera for a set number of frames and writes per frame CPU and GPU times
+/// as JSON (or CSV if the output file ends in .csv), optionally saving the last frame as a PNG
+//----------------------------------------------------------------------------------------------------------------------
+class Benchmark
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief everything that affects the result is set here so a run can be reproduced exactly
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Options
+  {
+    int numLights = 8;
+    int numObjects = 1;
+    int width = 1024;
+    int height = 720;
+    int frames = 300;
+    int warmup = 10;
+    unsigned int seed = 1234;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief use the deferred renderer. The final pose is also rendered forward, unclustered and with the reference
+    /// BRDF, and the run fails if the deferred frame's RMSE over the objects is above deferredTolerance
+    //----------------------------------------------------------------------------------------------------------------------
+    bool deferred = false;
+    float deferredTolerance = 0.01f;
+    bool clustered = true;
+    bool showLights = true;
+    bool animate = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief sampled lights per fragment, 0 shades every light. When set the final pose is also rendered exactly
+    /// and the error of one stochastic frame and of the accumulated history is reported against it
+    //----------------------------------------------------------------------------------------------------------------------
+    int stochasticSamples = 0;
+    bool depthPrepass = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief deferred light accumulation resolution, or a GPU time for the scene to pick it from if targetMs is set
+    //----------------------------------------------------------------------------------------------------------------------
+    float lightingScale = 1.0f;
+    float targetMs = 0.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the forward BRDF. Anything but the reference is checked against it on the final pose and the run
+    /// fails if the RMSE over the objects is above brdfTolerance
+    //----------------------------------------------------------------------------------------------------------------------
+    BRDFMode brdf = BRDFMode::Reference;
+    float brdfTolerance = 0.01f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief forward shadows from ShadowAtlas, the views rendered and reused each timed frame are reported
+    //----------------------------------------------------------------------------------------------------------------------
+    bool shadows = false;
+    int shadowBudget = 8;
+    int shadowSize = 256;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief cull the lights and gizmos with LightCuller, the visible counts and cull time are reported per frame
+    //----------------------------------------------------------------------------------------------------------------------
+    bool cullLights = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief NGLScene::setLightCutoff, 0 for the default that scales with the light count
+    //----------------------------------------------------------------------------------------------------------------------
+    float lightCutoff = 0.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render the final pose again with CPURenderer and report how far the GPU frame is from it, optionally
+    /// saving the CPU image. Only the single teapot with static lights can be reproduced
+    //----------------------------------------------------------------------------------------------------------------------
+    bool cpuReference = false;
+    std::string cpuPng;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief time CPURenderer over a range of light and thread counts instead of rendering frames
+    //----------------------------------------------------------------------------------------------------------------------
+    bool cpuBench = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief time light generation and upload at 1k, 100k and 1M lights instead of rendering frames
+    //----------------------------------------------------------------------------------------------------------------------
+    bool lightGeneration = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief time loading light files of 1k, 100k and 1M lights instead of rendering frames
+    //----------------------------------------------------------------------------------------------------------------------
+    bool lightFiles = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief time building, refitting and querying LightCuller at 1k, 100k and 1M lights, against testing every
+    /// light, instead of rendering frames
+    //----------------------------------------------------------------------------------------------------------------------
+    bool lightCulling = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render the lights in this binary light file or JSON rig, it is fully streamed in before timing starts
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string lightFile;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief program binary cache directory and whether to empty it first, startup time is reported either way
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string shaderCache;
+    bool clearShaderCache = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief result file, empty writes JSON to stdout
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string output;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief if set the final frame is saved here
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string png;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief if set a Chrome trace of the timed frames is written here
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string trace;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _format the GL format to request, samples are ignored as we render to a single sample FBO
+  /// @param [in] _options the run settings
+  //----------------------------------------------------------------------------------------------------------------------
+  Benchmark(const QSurfaceFormat &_format, const Options &_options);
+  ~Benchmark();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the context, render every frame and write the results
+  /// @returns false if the context or framebuffer could not be created or the output could not be written
+  //----------------------------------------------------------------------------------------------------------------------
+  bool run();
+
+private:
+  bool createContext();
+  bool createScene();
+  void createFramebuffer();
+  void renderFrame(int _frame, GLuint _startQuery, GLuint _endQuery);
+  bool writeResults() const;
+  bool runLightGeneration();
+  bool runLightFiles();
+  bool runLightCulling();
+  bool runCPUBench();
+  bool writeText(const std::string &_text) const;
+  bool savePNG(const std::string &_path, const std::vector<unsigned char> &_pixels) const;
+  std::vector<unsigned char> readFrame() const;
+  void measureStochasticError(const GLuint *_queries);
+  bool measureBRDFError(const GLuint *_queries);
+  bool measureDeferredError(const GLuint *_queries);
+  bool measureCPUReference(const GLuint *_queries);
+  std::string passTimings() const;
+
+  QSurfaceFormat m_format;
+  Options m_options;
+  std::unique_ptr<QOffscreenSurface> m_surface;
+  std::unique_ptr<QOpenGLContext> m_context;
+  std::unique_ptr<NGLScene> m_scene;
+  GLuint m_fbo = 0;
+  GLuint m_colour = 0;
+  GLuint m_depth = 0;
+  std::string m_renderer;
+  float m_startupMs = 0.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the stochastic_error JSON object, empty when not sampling
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_stochasticError;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the brdf_error JSON object, empty when using the reference BRDF
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_brdfError;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the deferred_error JSON object, empty when rendering forward
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_deferredError;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the cpu_reference JSON object, empty unless asked for
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_cpuReference;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the passes JSON object, per pass GPU time from the scene's profiler
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_passes;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief deferred lighting scale at the end of the timed frames, where the controller settled if it had a target
+  //----------------------------------------------------------------------------------------------------------------------
+  float m_lightingScale = 1.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ShadowAtlas stats of each timed frame
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> m_shadowedLights;
+  std::vector<float> m_shadowRendered;
+  std::vector<float> m_shadowReused;
+  std::vector<float> m_shadowEmpty;
+  std::vector<float> m_shadowStale;
+  std::vector<float> m_shadowUpdateMs;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief LightCuller stats of each timed frame
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> m_culledLights;
+  std::vector<float> m_culledGizmos;
+  std::vector<float> m_cullMs;
+  std::vector<float> m_cpuMs;
+  std::vector<float> m_gpuMs;
+};
+
+#endif
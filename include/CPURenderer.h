@@ -0,0 +1,126 @@
+#ifndef CPURENDERER_H_
+#define CPURENDERER_H_
+#include "LightBuffer.h"
+#include <ngl/Mat4.h>
+#include <ngl/Vec3.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file CPURenderer.h
+/// @brief a C++ port of the forward PBR shader over a software rasterised mesh, the ground truth the GPU paths are
+/// diffed against and a throughput benchmark that needs no GPU at all
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class CPURenderer
+/// @brief the screen is cut into TileSize tiles and every thread takes the next unfinished tile until none are
+/// left. A tile rasterises the triangles binned to it into its own depth buffer, then shades each covered pixel with
+/// every light exactly as the unclustered PBRFragment.glsl does, four lights at a time with SSE2 where available.
+/// The image is bottom row first like glReadPixels so it can be compared with a GPU frame byte for byte, and each
+/// tile's time is kept to show where the cost goes
+//----------------------------------------------------------------------------------------------------------------------
+class CPURenderer
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief an object space vertex, the mesh is a plain triangle list
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Vertex
+  {
+    ngl::Vec3 position;
+    ngl::Vec3 normal;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the material uniforms of PBRFragment.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Material
+  {
+    ngl::Vec3 albedo;
+    float metallic;
+    float roughness;
+    float ao;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the matrices PBRVertex.glsl is given, the normal is taken to view space by model * view as it is there
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Camera
+  {
+    ngl::Mat4 model;
+    ngl::Mat4 view;
+    ngl::Mat4 project;
+    ngl::Vec3 eye;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief timings of the last render, setup is the vertex transform and binning which run on the calling thread
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    unsigned int threads = 0;
+    float totalMs = 0.0f;
+    float setupMs = 0.0f;
+    size_t shadedPixels = 0;
+    std::vector<float> tileMs;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _threads threads to shade with, 0 uses every hardware thread
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit CPURenderer(unsigned int _threads = 0);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief render one frame
+  /// @param [in] _mesh triangles, three vertices each
+  /// @param [in] _camera the transforms
+  /// @param [in] _material the surface
+  /// @param [in] _lights every light, shaded without any culling
+  /// @param [in] _width image width in pixels
+  /// @param [in] _height image height in pixels
+  /// @param [out] _rgba resized to the image, 8 bit RGBA
+  //----------------------------------------------------------------------------------------------------------------------
+  void render(const std::vector<Vertex> &_mesh, const Camera &_camera, const Material &_material, const LightSoA &_lights,
+              int _width, int _height, std::vector<unsigned char> &_rgba);
+  const Stats &stats() const { return m_stats; }
+  unsigned int threads() const { return m_threads; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the instruction set the light loop was built for, "sse2" or "scalar"
+  //----------------------------------------------------------------------------------------------------------------------
+  static const char *instructionSet();
+  static constexpr int TileSize = 32;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the clear colour NGLScene uses, 0.4 grey
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr unsigned char Background = 102;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a vertex after the vertex shader, window x and y, NDC z, clip w and the varyings
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Transformed
+  {
+    float x;
+    float y;
+    float z;
+    float w;
+    ngl::Vec3 world;
+    ngl::Vec3 normal;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief rasterise and shade one tile
+  /// @returns the number of pixels shaded
+  //----------------------------------------------------------------------------------------------------------------------
+  size_t renderTile(size_t _tile, const Material &_material, const ngl::Vec3 &_eye, const LightSoA &_lights, std::vector<unsigned char> &_rgba) const;
+
+  unsigned int m_threads;
+  int m_width = 0;
+  int m_height = 0;
+  int m_tilesX = 0;
+  int m_tilesY = 0;
+  std::vector<Transformed> m_vertices;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the triangles whose bounds touch each tile, reused between renders
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<std::vector<uint32_t>> m_bins;
+  Stats m_stats;
+};
+
+#endif
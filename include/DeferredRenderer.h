@@ -0,0 +1,116 @@
+#ifndef DEFERREDRENDERER_H_
+#define DEFERREDRENDERER_H_
+#include <ngl/Mat4.h>
+#include <array>
+class ShaderCache;
+class ShaderState;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file DeferredRenderer.h
+/// @brief an alternative to the forward PBR path, the geometry is rasterised once into a G-buffer and each
+/// light is then accumulated as a screen space quad bounded by its radius
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class DeferredRenderer
+/// @brief owns the G-buffer (albedo + ao, octahedral normal + metallic + roughness, depth), the light accumulation
+/// target and the three pass shaders. Lights are read from the same LightBlock buffer as the forward path
+//----------------------------------------------------------------------------------------------------------------------
+class DeferredRenderer
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GPU time of each pass in ms, read back a frame late so the queries never stall
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Timings
+  {
+    float geometryMs = 0.0f;
+    float lightingMs = 0.0f;
+    float resolveMs = 0.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the lighting scale the timed frame was drawn at
+    //----------------------------------------------------------------------------------------------------------------------
+    float lightingScale = 1.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frames timed so far, changes whenever the values above do
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t samples = 0;
+  };
+  DeferredRenderer() = default;
+  DeferredRenderer(const DeferredRenderer &) = delete;
+  DeferredRenderer &operator=(const DeferredRenderer &) = delete;
+  ~DeferredRenderer();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load the shaders and create the GL objects, must be called once a GL context is valid
+  /// @param [in] _shaders the cache the pass programs are loaded through
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(ShaderCache &_shaders);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set the render target size, the targets are reallocated on the next geometry pass
+  /// @param [in] _width width in pixels
+  /// @param [in] _height height in pixels
+  //----------------------------------------------------------------------------------------------------------------------
+  void resize(int _width, int _height);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief accumulate the lights at a fraction of the G-buffer resolution, the resolve upsamples the result with
+  /// the G-buffer depth and normals. The targets stay full size and the light pass draws into a corner of them
+  /// so the scale can change every frame without reallocating
+  /// @param [in] _scale fraction of the width and height, 1 shades every pixel
+  //----------------------------------------------------------------------------------------------------------------------
+  void setLightingScale(float _scale);
+  float lightingScale() const { return m_lightingScale; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind and clear the G-buffer, the caller then binds GBufferShader (or its instanced variant) and draws
+  /// the geometry
+  //----------------------------------------------------------------------------------------------------------------------
+  void beginGeometryPass();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief accumulate the lights then resolve into _target
+  /// @param [in] _state the scene's shader state, both pass programs are bound and fed through it
+  /// @param [in] _numLights the number of lights in the LightBlock buffer
+  /// @param [in] _VP the projection * view matrix used for the geometry pass
+  /// @param [in] _camPos the eye position for the specular term
+  /// @param [in] _target the framebuffer to resolve into (the QOpenGLWindow default FBO)
+  //----------------------------------------------------------------------------------------------------------------------
+  void shade(ShaderState &_state, size_t _numLights, const ngl::Mat4 &_VP, const ngl::Vec3 &_camPos, GLuint _target);
+  const Timings &timings() const { return m_timings; }
+
+  static constexpr auto GBufferShader = "GBuffer";
+  static constexpr float MinLightingScale = 0.25f;
+
+private:
+  enum Pass
+  {
+    Geometry,
+    Lighting,
+    Resolve,
+    NumPasses
+  };
+  void allocateTargets();
+  void releaseTargets();
+  void readTimings();
+
+  GLuint m_gbufferFBO = 0;
+  GLuint m_accumFBO = 0;
+  GLuint m_albedoAO = 0;
+  GLuint m_normalMaterial = 0;
+  GLuint m_depth = 0;
+  GLuint m_lightAccum = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the light and resolve passes generate their vertices from gl_VertexID but core profile still needs a VAO
+  //----------------------------------------------------------------------------------------------------------------------
+  GLuint m_emptyVAO = 0;
+  int m_width = 1;
+  int m_height = 1;
+  bool m_targetsDirty = true;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief double buffered so this frame's queries are issued while last frame's are read
+  //----------------------------------------------------------------------------------------------------------------------
+  std::array<std::array<GLuint, NumPasses>, 2> m_queries = {};
+  std::array<bool, 2> m_queriesIssued = {{false, false}};
+  std::array<float, 2> m_queryScale = {{1.0f, 1.0f}};
+  float m_lightingScale = 1.0f;
+  size_t m_frame = 0;
+  Timings m_timings;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef INSTANCEDSCENE_H_
+#define INSTANCEDSCENE_H_
+#include <ngl/Mat4.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file InstancedScene.h
+/// @brief many copies of one primitive drawn with a single instanced call, the camera is a uniform block shared by
+/// every program and each copy's model matrix lives in a shader storage buffer
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class InstancedScene
+/// @brief lays the objects out on a jittered grid through the light volume. The model matrices are only uploaded
+/// when the layout changes and the camera block once per frame at most, PBRInstancedVertex.glsl derives the
+/// normal matrix from each model matrix so nothing per object is computed on the CPU while drawing
+//----------------------------------------------------------------------------------------------------------------------
+class InstancedScene
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief buffer traffic since the last resetStats
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t cameraUploads = 0;
+    size_t cameraSkips = 0;
+    size_t instanceBytes = 0;
+    size_t draws = 0;
+  };
+  InstancedScene() = default;
+  InstancedScene(const InstancedScene &) = delete;
+  InstancedScene &operator=(const InstancedScene &) = delete;
+  ~InstancedScene();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the camera and instance buffers, must be called once a GL context is valid
+  /// @param [in] _cameraBinding uniform block binding of Camera in PBRInstancedVertex.glsl
+  /// @param [in] _instanceBinding shader storage binding of InstanceBlock in PBRInstancedVertex.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(GLuint _cameraBinding, GLuint _instanceBinding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief place _count objects in the cube -_extent to _extent and upload their model matrices
+  /// @param [in] _count the number of objects
+  /// @param [in] _extent half the size of the volume to fill
+  /// @param [in] _seed picks the jitter, spin and scale of each object
+  //----------------------------------------------------------------------------------------------------------------------
+  void layout(size_t _count, float _extent, unsigned int _seed);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set the camera block, skipped if nothing has changed since the last call
+  /// @param [in] _view the view matrix
+  /// @param [in] _project the projection matrix
+  /// @param [in] _scene applied before every model matrix, the mouse rotation
+  //----------------------------------------------------------------------------------------------------------------------
+  void setCamera(const ngl::Mat4 &_view, const ngl::Mat4 &_project, const ngl::Mat4 &_scene);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief draw every object with the current program, which must use the Camera and InstanceBlock blocks
+  /// @param [in] _primitive the ngl::VAOPrimitives name to draw
+  //----------------------------------------------------------------------------------------------------------------------
+  void draw(const std::string &_primitive);
+  size_t count() const { return m_count; }
+  const Stats &stats() const { return m_stats; }
+  void resetStats() { m_stats = Stats(); }
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief std140 layout of the Camera block, three mat4 need no padding
+  //----------------------------------------------------------------------------------------------------------------------
+  struct CameraBlock
+  {
+    ngl::Mat4 view;
+    ngl::Mat4 project;
+    ngl::Mat4 scene;
+  };
+  GLuint m_cameraID = 0;
+  GLuint m_instanceID = 0;
+  GLuint m_cameraBinding = 0;
+  GLuint m_instanceBinding = 0;
+  size_t m_count = 0;
+  bool m_cameraValid = false;
+  CameraBlock m_camera;
+  std::vector<ngl::Mat4> m_models;
+  Stats m_stats;
+};
+
+#endif
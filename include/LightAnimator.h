@@ -0,0 +1,63 @@
+#ifndef LIGHTANIMATOR_H_
+#define LIGHTANIMATOR_H_
+#include <ngl/Types.h>
+#include <cstddef>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LightAnimator.h
+/// @brief moves the lights every frame with a compute shader so animation costs no CPU time or bus traffic
+//----------------------------------------------------------------------------------------------------------------------
+
+class LightBuffer;
+class ShaderCache;
+class ShaderState;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class LightAnimator
+/// @brief keeps a GPU side copy of the lights as uploaded (the rest state) and each frame writes the animated
+/// lights into the LightBuffer in place. Every light orbits its rest position and flickers, the parameters are
+/// hashed in the shader from the light index and a seed so a run is reproducible from the seed and time alone
+//----------------------------------------------------------------------------------------------------------------------
+class LightAnimator
+{
+public:
+  LightAnimator() = default;
+  LightAnimator(const LightAnimator &) = delete;
+  LightAnimator &operator=(const LightAnimator &) = delete;
+  ~LightAnimator();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load the compute shader and create the rest buffer, must be called once a GL context is valid
+  /// @param [in] _shaders the cache the compute program is built through
+  /// @param [in] _restBinding the shader storage binding of RestBlock in LightAnimateCompute.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(ShaderCache &_shaders, GLuint _restBinding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief copy the current contents of _lights into the rest buffer, GPU to GPU. Call after every upload
+  /// @param [in] _lights the buffer the lights were uploaded to
+  /// @param [in] _numLights how many lights it holds
+  //----------------------------------------------------------------------------------------------------------------------
+  void setRestState(const LightBuffer &_lights, size_t _numLights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write the lights at _time into the light buffer and make the result visible to later draws
+  /// @param [in] _state the scene's shader state, the compute program is bound and fed through it
+  /// @param [in] _time animation time in seconds
+  /// @param [in] _seed selects the orbit and flicker of every light
+  //----------------------------------------------------------------------------------------------------------------------
+  void update(ShaderState &_state, float _time, unsigned int _seed);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the furthest any light moves from its rest position, anything culled on the CPU from the rest
+  /// state must grow its bounds by this
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr float MaxOrbit = 2.0f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief must match local_size_x in LightAnimateCompute.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr GLuint GroupSize = 256;
+
+private:
+  GLuint m_rest = 0;
+  GLuint m_restBinding = 0;
+  GLsizeiptr m_capacity = 0;
+  size_t m_numLights = 0;
+};
+
+#endif
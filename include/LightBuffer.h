@@ -0,0 +1,135 @@
+#ifndef LIGHTBUFFER_H_
+#define LIGHTBUFFER_H_
+#include <ngl/Types.h>
+#include <ngl/Vec3.h>
+#include <cstddef>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LightBuffer.h
+/// @brief a shader storage buffer holding every light in the scene so the whole set is sent to the GPU
+/// in a single call rather than one glUniform per light per array
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a single point light, laid out to match the std430 Light struct in PBRFragment.glsl. Each vec3 is
+/// padded out to 16 bytes so the array stride is 32 bytes on both sides, the radius lives in position.w
+//----------------------------------------------------------------------------------------------------------------------
+struct Light
+{
+  ngl::Vec3 position;
+  float radius = 1.0f;
+  ngl::Vec3 colour;
+  float pad1 = 0.0f;
+};
+static_assert(sizeof(Light) == 32, "Light must match the std430 layout in PBRFragment.glsl");
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the CPU side light store, one array per component so the generator and culling loops stream through
+/// only the data they need and can process several lights per SIMD register
+//----------------------------------------------------------------------------------------------------------------------
+struct LightSoA
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<float> radius;
+  std::vector<float> r;
+  std::vector<float> g;
+  std::vector<float> b;
+  size_t size() const { return x.size(); }
+  void resize(size_t _size);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief gather a single light in the GPU layout
+  /// @param [in] _index the light to fetch
+  //----------------------------------------------------------------------------------------------------------------------
+  Light get(size_t _index) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief scatter lights in the GPU layout into the store, which must already hold _first + _count lights
+  /// @param [in] _first the index of the first light to write
+  /// @param [in] _lights the lights to copy
+  /// @param [in] _count how many to copy
+  //----------------------------------------------------------------------------------------------------------------------
+  void set(size_t _first, const Light *_lights, size_t _count);
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class LightBuffer
+/// @brief owns the GL_SHADER_STORAGE_BUFFER the PBR shader reads its lights from
+//----------------------------------------------------------------------------------------------------------------------
+class LightBuffer
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief upload counters, reset by the owner whenever it wants a fresh sample
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t calls = 0;
+    size_t bytes = 0;
+  };
+  LightBuffer() = default;
+  LightBuffer(const LightBuffer &) = delete;
+  LightBuffer &operator=(const LightBuffer &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief dtor, needs a current GL context to release the buffer
+  //----------------------------------------------------------------------------------------------------------------------
+  ~LightBuffer();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the buffer object, must be called once a GL context is valid
+  /// @param [in] _binding the shader storage binding point used in the shader
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(GLuint _binding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief upload the full light array. The old storage is orphaned by glBufferData so the driver
+  /// hands back fresh memory instead of waiting for the GPU to finish with the previous frame's lights
+  /// @param [in] _lights the lights to send
+  //----------------------------------------------------------------------------------------------------------------------
+  void upload(const std::vector<Light> &_lights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief orphan the storage and map it for writing so lights can be generated straight into GPU memory,
+  /// the pointer may be written from any thread but unmap must be called on the GL thread before drawing
+  /// @param [in] _numLights the number of lights the buffer will hold
+  /// @returns the mapped lights or nullptr if the map failed
+  //----------------------------------------------------------------------------------------------------------------------
+  Light *map(size_t _numLights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief finish a map
+  /// @returns false if the contents were lost while mapped (GL_FALSE from glUnmapBuffer) and must be rewritten
+  //----------------------------------------------------------------------------------------------------------------------
+  bool unmap();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief orphan the storage and size it for _numLights lights without writing any, the lights are then filled
+  /// in a range at a time with mapRange or uploadRange
+  /// @param [in] _numLights the number of lights the buffer will hold
+  //----------------------------------------------------------------------------------------------------------------------
+  void allocate(size_t _numLights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief map part of the buffer for writing without waiting on the GPU, the caller must know no draw in flight
+  /// reads the range. Finish with unmap
+  /// @param [in] _first the first light to map
+  /// @param [in] _count how many lights to map
+  /// @returns the mapped lights or nullptr if the map failed
+  //----------------------------------------------------------------------------------------------------------------------
+  Light *mapRange(size_t _first, size_t _count);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write part of the buffer with glBufferSubData, the fallback when mapRange fails
+  /// @param [in] _first the first light to write
+  /// @param [in] _lights the lights to send
+  /// @param [in] _count how many lights to send
+  //----------------------------------------------------------------------------------------------------------------------
+  void uploadRange(size_t _first, const Light *_lights, size_t _count);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the buffer to its binding point
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind() const;
+  GLuint getID() const { return m_id; }
+  const Stats &stats() const { return m_stats; }
+  void resetStats() { m_stats = Stats(); }
+
+private:
+  GLuint m_id = 0;
+  GLuint m_binding = 0;
+  Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef LIGHTCLUSTERS_H_
+#define LIGHTCLUSTERS_H_
+#include "LightBuffer.h"
+#include <ngl/Mat4.h>
+#include <cstdint>
+#include <vector>
+class ShaderState;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LightClusters.h
+/// @brief CPU binning of the scene lights into screen tiles x exponential depth slices for clustered forward shading
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class LightClusters
+/// @brief builds a per cluster light list (offset / count into a flat index array) and uploads both arrays
+/// as shader storage buffers. The fragment shader finds its cluster from gl_FragCoord and its view depth
+/// and only shades the lights in that list
+//----------------------------------------------------------------------------------------------------------------------
+class LightClusters
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief build counters from the last call to build
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t lightsBinned = 0;
+    size_t indices = 0;
+    size_t maxPerCluster = 0;
+    float buildMs = 0.0f;
+  };
+  LightClusters() = default;
+  LightClusters(const LightClusters &) = delete;
+  LightClusters &operator=(const LightClusters &) = delete;
+  ~LightClusters();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the grid and index buffers, must be called once a GL context is valid
+  /// @param [in] _gridBinding binding point of the ClusterGrid block
+  /// @param [in] _indexBinding binding point of the ClusterIndices block
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(GLuint _gridBinding, GLuint _indexBinding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief rebuild the view space bounds of each cluster, call when the projection or viewport changes
+  /// @param [in] _fovy vertical field of view in degrees as passed to ngl::perspective
+  /// @param [in] _aspect the aspect ratio
+  /// @param [in] _near near plane
+  /// @param [in] _far far plane
+  /// @param [in] _width viewport width in pixels
+  /// @param [in] _height viewport height in pixels
+  //----------------------------------------------------------------------------------------------------------------------
+  void setProjection(float _fovy, float _aspect, float _near, float _far, int _width, int _height);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bin the lights against the clusters and upload the result
+  /// @param [in] _lights the world space lights
+  /// @param [in] _view the view matrix the fragments are clustered in
+  /// @param [in] _radiusPadding added to every radius, lets lights that move on the GPU be binned once by the
+  /// bound of their motion
+  //----------------------------------------------------------------------------------------------------------------------
+  void build(const LightSoA &_lights, const ngl::Mat4 &_view, float _radiusPadding = 0.0f);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind both buffers to their binding points
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind() const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set the uniforms the fragment shader needs to locate its cluster on the currently active shader
+  /// @param [in] _state the scene's shader state, which skips the uploads when the values have not changed
+  //----------------------------------------------------------------------------------------------------------------------
+  void loadToShader(ShaderState &_state) const;
+  const Stats &stats() const { return m_stats; }
+  size_t numClusters() const { return static_cast<size_t>(m_dimX) * m_dimY * m_dimZ; }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief size of a screen tile in pixels
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr int TileSize = 64;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief number of exponential depth slices
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr int DepthSlices = 24;
+
+private:
+  struct AABB
+  {
+    ngl::Vec3 min;
+    ngl::Vec3 max;
+  };
+  size_t clusterIndex(int _x, int _y, int _z) const { return (static_cast<size_t>(_z) * m_dimY + _y) * m_dimX + _x; }
+  int sliceForDepth(float _depth) const;
+
+  GLuint m_gridID = 0;
+  GLuint m_indexID = 0;
+  GLuint m_gridBinding = 0;
+  GLuint m_indexBinding = 0;
+  int m_dimX = 1;
+  int m_dimY = 1;
+  int m_dimZ = DepthSlices;
+  int m_width = 1;
+  int m_height = 1;
+  float m_near = 0.1f;
+  float m_far = 100.0f;
+  float m_tanHalfFovX = 1.0f;
+  float m_tanHalfFovY = 1.0f;
+  float m_sliceScale = 1.0f;
+  std::vector<AABB> m_bounds;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief offset / count pairs per cluster, uvec2 in the shader
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> m_grid;
+  std::vector<uint32_t> m_indices;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief scratch (cluster, light) pairs reused between builds
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<std::pair<uint32_t, uint32_t>> m_pairs;
+  Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef LIGHTCULLER_H_
+#define LIGHTCULLER_H_
+#include "LightBuffer.h"
+#include <ngl/Mat4.h>
+#include <ngl/Vec3.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LightCuller.h
+/// @brief CPU culling of the lights and their gizmos against the view frustum through a bounding volume hierarchy
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class LightCuller
+/// @brief a BVH over the light positions, rebuilt when the light count changes and otherwise refitted in place, that
+/// finds the lights whose influence sphere is in the view frustum and reaches the objects, and the lights whose gizmo
+/// is on screen. Whole subtrees are accepted or rejected at once so a query costs about the number of visible lights
+/// rather than the number of lights. The results are lists of light indices uploaded as shader storage buffers, the
+/// light buffer itself is untouched so animated positions and per light shadows still line up
+//----------------------------------------------------------------------------------------------------------------------
+class LightCuller
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief counters from the last cull, and the time of the last build and refit
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t lights = 0;
+    size_t visibleLights = 0;
+    size_t visibleGizmos = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief lights not shaded because their sphere is outside the frustum, or in it but can't reach an object
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t outsideFrustum = 0;
+    size_t outOfReach = 0;
+    size_t nodesVisited = 0;
+    size_t rebuilds = 0;
+    size_t refits = 0;
+    float buildMs = 0.0f;
+    float refitMs = 0.0f;
+    float cullMs = 0.0f;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief normalised frustum planes, a point is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+  //----------------------------------------------------------------------------------------------------------------------
+  using Planes = std::array<std::array<float, 4>, 6>;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the frustum of _viewProject in the space it is applied to, in that space's units
+  /// @param [in] _viewProject a projection times a view and any model transform
+  //----------------------------------------------------------------------------------------------------------------------
+  static Planes frustumPlanes(const ngl::Mat4 &_viewProject);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bounding radius of a gizmo cube around its light
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr float GizmoRadius = 0.87f;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief most lights in a leaf
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr uint32_t LeafSize = 16;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a refit whose bounds grow to more than this times the surface area they had when built is rebuilt instead
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr float RebuildGrowth = 1.5f;
+
+  LightCuller() = default;
+  LightCuller(const LightCuller &) = delete;
+  LightCuller &operator=(const LightCuller &) = delete;
+  ~LightCuller();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the index buffers, must be called once a GL context is valid
+  /// @param [in] _lightBinding binding point of the VisibleLights block
+  /// @param [in] _gizmoBinding binding point of the VisibleGizmos block
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(GLuint _lightBinding, GLuint _gizmoBinding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the lights have changed, the next update refits or rebuilds the hierarchy
+  //----------------------------------------------------------------------------------------------------------------------
+  void invalidate() { m_lightsChanged = true; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bring the hierarchy up to date if invalidated, refitting when the count is unchanged and rebuilding when
+  /// it isn't or the refit bounds have grown too loose
+  /// @param [in] _lights the world space lights
+  /// @param [in] _numLights how many of them are in use
+  //----------------------------------------------------------------------------------------------------------------------
+  void update(const LightSoA &_lights, size_t _numLights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sort the lights along a Morton curve and build a new balanced hierarchy over them
+  //----------------------------------------------------------------------------------------------------------------------
+  void build(const LightSoA &_lights, size_t _numLights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief recompute every node's bounds for lights that have moved, keeping the tree
+  /// @returns the total surface area of the bounds as a multiple of what it was when built
+  //----------------------------------------------------------------------------------------------------------------------
+  float refit(const LightSoA &_lights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief find the visible lights and gizmos and upload both lists, skipped if nothing has changed since last time
+  /// @param [in] _viewProject the world to clip matrix the objects are shaded with
+  /// @param [in] _gizmoMVP the clip matrix of the gizmos, which are drawn in another space
+  /// @param [in] _objectCentre centre of a sphere around every object, world space
+  /// @param [in] _objectRadius its radius, a light whose sphere doesn't touch it lights nothing
+  /// @param [in] _radiusPadding added to every radius, lets lights that move on the GPU be culled by the bound of
+  /// their motion
+  //----------------------------------------------------------------------------------------------------------------------
+  void cull(const ngl::Mat4 &_viewProject, const ngl::Mat4 &_gizmoMVP, const ngl::Vec3 &_objectCentre,
+            float _objectRadius, float _radiusPadding = 0.0f);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind both lists to their binding points
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind() const;
+  size_t visibleLights() const { return m_visibleLights.size(); }
+  size_t visibleGizmos() const { return m_visibleGizmos.size(); }
+  const Stats &stats() const { return m_stats; }
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bounds of the light positions, for the gizmos, and of their influence spheres. The lights are
+  /// m_items[first, first + count) and children are always stored after their parent, left then left + 1
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Node
+  {
+    ngl::Vec3 centreMin;
+    ngl::Vec3 centreMax;
+    ngl::Vec3 sphereMin;
+    ngl::Vec3 sphereMax;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief 0 for a leaf, the root is never a child
+    //----------------------------------------------------------------------------------------------------------------------
+    uint32_t left = 0;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a light's sphere and index, kept in tree order so the build, refit and leaf tests read them sequentially
+  /// rather than gathering from the scene's arrays
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Item
+  {
+    float x;
+    float y;
+    float z;
+    float radius;
+    uint32_t light;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set _node's bounds from the items in its range
+  //----------------------------------------------------------------------------------------------------------------------
+  void fitItems(Node &_node) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief fit every node bottom up, leaves to their items and the rest to their children
+  /// @returns the total surface area of the sphere bounds
+  //----------------------------------------------------------------------------------------------------------------------
+  float fitNodes();
+  void upload();
+
+  GLuint m_lightID = 0;
+  GLuint m_gizmoID = 0;
+  GLuint m_lightBinding = 0;
+  GLuint m_gizmoBinding = 0;
+  std::vector<Node> m_nodes;
+  std::vector<Item> m_items;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief scratch Morton code and light index pairs reused between builds, and the radix sort's second buffer
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint64_t> m_keys;
+  std::vector<uint64_t> m_scratch;
+  float m_builtArea = 0.0f;
+  bool m_lightsChanged = true;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief what the last cull was given, it is only repeated when one of them or the lights change
+  //----------------------------------------------------------------------------------------------------------------------
+  bool m_treeChanged = true;
+  ngl::Mat4 m_viewProject;
+  ngl::Mat4 m_gizmoMVP;
+  ngl::Vec3 m_objectCentre;
+  float m_objectRadius = 0.0f;
+  float m_radiusPadding = 0.0f;
+  std::vector<uint32_t> m_visibleLights;
+  std::vector<uint32_t> m_visibleGizmos;
+  Stats m_stats;
+};
+
+#endif
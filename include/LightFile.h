@@ -0,0 +1,106 @@
+#ifndef LIGHTFILE_H_
+#define LIGHTFILE_H_
+#include "LightBuffer.h"
+#include <QFile>
+#include <cstdint>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LightFile.h
+/// @brief light sets on disk, a binary format that is memory mapped and streamed straight into the light buffer,
+/// and a JSON importer for small hand written rigs
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class LightFile
+/// @brief the binary format is a 32 byte header followed by the lights in exactly the std430 layout of Light, little
+/// endian. The file is mapped rather than read, so a chunk is copied from the page cache into the mapped GPU buffer
+/// with no staging copy in between. Large sets are streamed a chunk per frame, the buffer is allocated at full size
+/// first and each chunk is written unsynchronized as nothing in flight reads past the lights already streamed
+//----------------------------------------------------------------------------------------------------------------------
+class LightFile
+{
+public:
+  LightFile() = default;
+  LightFile(const LightFile &) = delete;
+  LightFile &operator=(const LightFile &) = delete;
+  ~LightFile();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief map a binary light file and check its header
+  /// @param [in] _path the file to open
+  /// @returns false if the file can't be mapped or isn't a light file, see error()
+  //----------------------------------------------------------------------------------------------------------------------
+  bool open(const std::string &_path);
+  void close();
+  size_t size() const { return m_count; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the mapped lights, valid until close
+  //----------------------------------------------------------------------------------------------------------------------
+  const Light *lights() const { return m_lights; }
+  const std::string &error() const { return m_error; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief allocate _buffer for every light in the file and empty _lights, streamChunk then fills both
+  /// @param [in,out] _buffer the GPU light buffer
+  /// @param [out] _lights the CPU store, grows by each chunk
+  //----------------------------------------------------------------------------------------------------------------------
+  void beginStream(LightBuffer &_buffer, LightSoA &_lights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief copy the next _maxLights lights to the end of both the buffer and the store
+  /// @param [in,out] _buffer the buffer passed to beginStream
+  /// @param [in,out] _lights the store passed to beginStream
+  /// @param [in] _maxLights the most lights to copy this call
+  /// @returns true once every light has been streamed
+  //----------------------------------------------------------------------------------------------------------------------
+  bool streamChunk(LightBuffer &_buffer, LightSoA &_lights, size_t _maxLights = ChunkLights);
+  bool streaming() const { return m_streamed < m_count; }
+  size_t streamed() const { return m_streamed; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief write _lights in the binary format
+  /// @param [in] _path the file to write
+  /// @param [in] _lights the lights to save
+  /// @returns false if the file couldn't be written
+  //----------------------------------------------------------------------------------------------------------------------
+  static bool write(const std::string &_path, const LightSoA &_lights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief read a JSON rig of the form {"lights": [{"position": [x, y, z], "colour": [r, g, b], "radius": r}]},
+  /// the radius is optional and defaults to where the light's brightest channel falls to _cutoff
+  /// @param [in] _path the file to read
+  /// @param [in] _cutoff radiance below which a light has no influence
+  /// @param [out] _lights resized to the rig and filled
+  /// @param [out] _error why the import failed
+  /// @returns false if the file can't be read or isn't a rig
+  //----------------------------------------------------------------------------------------------------------------------
+  static bool importJSON(const std::string &_path, float _cutoff, LightSoA &_lights, std::string &_error);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief lights streamed per frame, 2MB a chunk
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t ChunkLights = 65536;
+  static constexpr uint32_t Version = 1;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the lights start this far into the file
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t HeaderSize = 32;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief padded to 32 bytes so the lights that follow stay aligned to their own size
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t lightSize;
+    uint64_t count;
+    uint64_t pad;
+  };
+  static_assert(sizeof(Header) == HeaderSize, "Header must match HeaderSize");
+  static constexpr char Magic[8] = {'N', 'G', 'L', 'L', 'I', 'G', 'H', 'T'};
+
+  QFile m_file;
+  uchar *m_map = nullptr;
+  const Light *m_lights = nullptr;
+  size_t m_count = 0;
+  size_t m_streamed = 0;
+  std::string m_error;
+};
+
+#endif
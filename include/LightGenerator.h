@@ -0,0 +1,85 @@
+#ifndef LIGHTGENERATOR_H_
+#define LIGHTGENERATOR_H_
+#include "LightBuffer.h"
+#include <cstdint>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LightGenerator.h
+/// @brief random light generation over a LightSoA, SIMD within a thread and split across threads for large sets
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class LightGenerator
+/// @brief every random value is a hash of the light index, seed and generation rather than the next value of a
+/// sequential generator, so lights can be made four at a time on any number of threads and still come out
+/// identical for the same seed. The GPU copy is interleaved into a mapped buffer in the same pass
+//----------------------------------------------------------------------------------------------------------------------
+class LightGenerator
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the distribution of the generated lights
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Params
+  {
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief positions are uniform in a cube of +/- extent
+    //----------------------------------------------------------------------------------------------------------------------
+    float extent = 20.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief each colour channel is uniform in minColour to minColour + colourScale
+    //----------------------------------------------------------------------------------------------------------------------
+    float minColour = 0.1f;
+    float colourScale = 100.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief radiance below which a light has no influence, the radius is sqrt(max channel / cutoff)
+    //----------------------------------------------------------------------------------------------------------------------
+    float cutoff = 0.25f;
+    uint32_t seed = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bumped for a new light set from the same seed
+    //----------------------------------------------------------------------------------------------------------------------
+    uint32_t generation = 0;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ctor
+  /// @param [in] _threads worker threads to split large sets over, 0 uses every hardware thread
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit LightGenerator(unsigned int _threads = 0);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief fill every light in _lights, sized by the caller
+  /// @param [in,out] _lights the store to fill
+  /// @param [in] _params the distribution and seed
+  /// @param [out] _mapped if not null also written in the GPU layout, must hold _lights.size() lights
+  //----------------------------------------------------------------------------------------------------------------------
+  void generate(LightSoA &_lights, const Params &_params, Light *_mapped = nullptr) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief copy a store into the GPU layout, used to re-upload lights without generating new ones
+  /// @param [in] _lights the lights to copy
+  /// @param [out] _mapped destination, must hold _lights.size() lights
+  //----------------------------------------------------------------------------------------------------------------------
+  void interleave(const LightSoA &_lights, Light *_mapped) const;
+  unsigned int threads() const { return m_threads; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the instruction set the kernels were built for, "sse2" or "scalar"
+  //----------------------------------------------------------------------------------------------------------------------
+  static const char *instructionSet();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the cutoff that keeps _numLights lights as local as _cutoff keeps ReferenceLights, so about as many
+  /// lights reach any point, and the clusters hold about as many, whatever the count
+  /// @param [in] _cutoff the cutoff at ReferenceLights lights or fewer
+  /// @param [in] _numLights the size of the set
+  //----------------------------------------------------------------------------------------------------------------------
+  static float scaledCutoff(float _cutoff, size_t _numLights);
+  static constexpr size_t ReferenceLights = 8;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief sets smaller than this run on the calling thread as starting threads would cost more than it saves
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t MinLightsPerThread = 16384;
+
+private:
+  template <typename Kernel>
+  void parallelFor(size_t _count, Kernel &&_kernel) const;
+  unsigned int m_threads;
+};
+
+#endif
@@ -3,8 +3,27 @@
 #include <ngl/Transformation.h>
 #include <ngl/Text.h>
 #include "WindowParams.h"
+#include "LightBuffer.h"
+#include "LightClusters.h"
+#include "LightAnimator.h"
+#include "LightGenerator.h"
+#include "DeferredRenderer.h"
+#include "InstancedScene.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "ShaderState.h"
+#include "ResolutionController.h"
+#include "BRDFLookup.h"
+#include "CPURenderer.h"
+#include "ShadowAtlas.h"
+#include "LightFile.h"
+#include "StochasticLights.h"
+#include "LightCuller.h"
 #include <array>
+#include <chrono>
+#include <string_view>
 #include <memory>
+#include <optional>
 #include <QOpenGLWindow>
 //----------------------------------------------------------------------------------------------------------------------
 /// @file NGLScene.h
@@ -44,6 +63,161 @@ class NGLScene : public QOpenGLWindow
     /// @brief this is called everytime we resize
     //----------------------------------------------------------------------------------------------------------------------
     void resizeGL(int _w, int _h);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the largest counts the setters accept, anything above is clamped. The light buffer is unsized in the
+    /// shader so MaxLights is only a sanity limit
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MaxLights = 1 << 20;
+    static constexpr int MaxObjects = 1 << 17;
+    static constexpr int MaxStochasticSamples = 64;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief scene settings used by the command line and the headless benchmark, set these before initializeGL
+    //----------------------------------------------------------------------------------------------------------------------
+    void setNumLights(int _numLights);
+    void setSeed(unsigned int _seed) { m_seed = _seed; }
+    void setDeferred(bool _deferred) { m_deferred = _deferred; }
+    void setClustered(bool _clustered) { m_clustered = _clustered; }
+    void setShowLights(bool _show) { m_showLights = _show; }
+    void setShowHUD(bool _show) { m_showHUD = _show; }
+    void setAnimateLights(bool _animate) { m_animateLights = _animate; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief only draw when something on screen has changed rather than on every presented frame. Input between two
+    /// frames is coalesced into one redraw, and a static scene presents nothing
+    //----------------------------------------------------------------------------------------------------------------------
+    void setOnDemand(bool _onDemand) { m_onDemand = _onDemand; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stop the simulation clock and the new light set each second, so the scene only changes with input
+    //----------------------------------------------------------------------------------------------------------------------
+    void setPaused(bool _paused) { m_paused = _paused; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the lights from a binary light file, streamed in over the first frames, or a JSON rig instead of
+    /// generating them. Falls back to generated lights if the file can't be loaded
+    //----------------------------------------------------------------------------------------------------------------------
+    void setLightFile(const std::string &_path) { m_lightFilePath = _path; }
+    bool streamingLights() const { return m_lightFile.streaming(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief 1 draws the single spinning teapot, more draws that many static teapots with one instanced call
+    //----------------------------------------------------------------------------------------------------------------------
+    void setNumObjects(int _numObjects);
+    const InstancedScene &instances() const { return m_instances; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief shade _samples lights per fragment chosen by power and distance rather than every light, 0 for the
+    /// exact sum. Only the forward path samples, and the history is dropped on every call
+    //----------------------------------------------------------------------------------------------------------------------
+    void setStochastic(int _samples);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the objects depth only before the forward shading pass, which then tests GL_EQUAL
+    //----------------------------------------------------------------------------------------------------------------------
+    void setDepthPrepass(bool _prepass) { m_depthPrepass = _prepass; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief which BRDF evaluation the forward shader is built with, see BRDFMode
+    //----------------------------------------------------------------------------------------------------------------------
+    void setBRDFMode(BRDFMode _mode);
+    BRDFMode brdfMode() const { return m_brdfMode; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief shadows from ShadowAtlas for the forward path, _budget lights' views are re-rendered at most a frame and
+    /// _faceSize is the face size of the largest slots. Off while the lights animate, the atlas only knows where
+    /// they rest
+    //----------------------------------------------------------------------------------------------------------------------
+    void setShadows(bool _shadows) { m_shadows = _shadows; }
+    void setShadowBudget(int _budget) { m_shadowAtlas.setBudget(_budget); }
+    void setShadowFaceSize(int _faceSize) { m_shadowAtlas.setFaceSize(_faceSize); }
+    const ShadowAtlas &shadowAtlas() const { return m_shadowAtlas; }
+    bool shadowed() const { return m_shadows && !m_deferred && !m_animateLights; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief cull the lights against the view frustum and the objects with LightCuller, only the gizmos on screen are
+    /// drawn and the forward light loop, when not clustered or stochastic, only shades the lights that can reach
+    //----------------------------------------------------------------------------------------------------------------------
+    void setCullLights(bool _cull) { m_cullLights = _cull; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief radiance below which a light has no influence, which sets the radii. 0 keeps the default, which rises
+    /// with the light count so the radii stay local
+    //----------------------------------------------------------------------------------------------------------------------
+    void setLightCutoff(float _cutoff) { m_lightCutoff = _cutoff; }
+    float lightCutoff() const;
+    const LightCuller &lightCuller() const { return m_lightCuller; }
+    bool cullingLights() const { return m_cullLights; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief deferred light accumulation resolution, a fixed fraction of the window or picked each frame to meet
+    /// a GPU time target. Setting a scale turns the target off
+    //----------------------------------------------------------------------------------------------------------------------
+    void setLightingScale(float _scale);
+    void setTargetFrameMs(float _ms) { m_resolution.setTarget(_ms); }
+    float lightingScale() const { return m_deferredRenderer.lightingScale(); }
+    const StochasticLights &stochasticLights() const { return m_stochasticLights; }
+    Profiler &profiler() { return m_profiler; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief shader binary cache settings, set these before initializeGL
+    //----------------------------------------------------------------------------------------------------------------------
+    void setShaderCacheDirectory(const std::string &_directory) { m_shaderCache.setDirectory(_directory); }
+    void setClearShaderCache(bool _clear) { m_clearShaderCache = _clear; }
+    void setPrecompileShaders(bool _precompile) { m_precompileShaders = _precompile; }
+    const ShaderCache &shaderCache() const { return m_shaderCache; }
+    const ShaderState &shaderState() const { return m_shaderState; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief how long initializeGL took
+    //----------------------------------------------------------------------------------------------------------------------
+    float startupMs() const { return m_startupMs; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the mouse rotation and teapot spin directly, used to drive a fixed camera sequence. Once called
+    /// the scene no longer advances its own simulation clock
+    /// @param [in] _spinX rotation about x in degrees
+    /// @param [in] _spinY rotation about y in degrees
+    /// @param [in] _teapotRotation the teapot spin in degrees
+    /// @param [in] _lightTime the light animation time in seconds
+    //----------------------------------------------------------------------------------------------------------------------
+    void setPose(int _spinX, int _spinY, ngl::Real _teapotRotation, ngl::Real _lightTime = 0.0f);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what CPURenderer needs to draw the single teapot as the forward pass does, in the pose last painted.
+    /// The lights are the rest state, so they only match the frame when the lights aren't animated
+    //----------------------------------------------------------------------------------------------------------------------
+    CPURenderer::Camera cpuCamera();
+    const CPURenderer::Material &material() const { return m_material; }
+    const LightSoA &lights() const { return m_lights; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw into this framebuffer rather than the window's, used when rendering offscreen
+    /// @param [in] _fbo the framebuffer id
+    //----------------------------------------------------------------------------------------------------------------------
+    void setRenderTarget(GLuint _fbo) { m_renderTarget = _fbo; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what RenderWindow's render thread calls in place of the event handlers, it drives the scene as the
+    /// benchmark does and applies the input the GUI thread hands it here
+    /// @param [in] _spinX rotation about x in degrees
+    /// @param [in] _spinY rotation about y in degrees
+    /// @param [in] _modelPos the mouse translation
+    //----------------------------------------------------------------------------------------------------------------------
+    void setCamera(int _spinX, int _spinY, const ngl::Vec3 &_modelPos);
+    void handleKey(int _key);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the once a second new set of generated lights, unless they animate, came from a file or are paused
+    //----------------------------------------------------------------------------------------------------------------------
+    void newLightSet();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief false in on demand mode while nothing has changed or moves by itself
+    //----------------------------------------------------------------------------------------------------------------------
+    bool needsFrame() const { return !m_onDemand || m_dirty != 0 || animating(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief call when needsFrame() stopped the drawing, the gap until the next frame isn't a frame time and mustn't
+    /// advance the simulation
+    //----------------------------------------------------------------------------------------------------------------------
+    void idle() { m_lastFrame.reset(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a new sample of the upload counters and frame times, as each title bar report does
+    //----------------------------------------------------------------------------------------------------------------------
+    void resetFrameStats();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the time from the last light count edit to its frame completing, returned once
+    //----------------------------------------------------------------------------------------------------------------------
+    std::optional<float> takeLightEditMs();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the mouse camera controls, applied to m_win and m_modelPos by our handlers and to RenderWindow's own
+    /// copies on the GUI thread
+    /// @returns true if the camera moved
+    //----------------------------------------------------------------------------------------------------------------------
+    static bool dragCamera(WinParams &_win, ngl::Vec3 &_modelPos, QMouseEvent *_event);
+    static void pressCamera(WinParams &_win, QMouseEvent *_event);
+    static void releaseCamera(WinParams &_win, QMouseEvent *_event);
+    static bool wheelCamera(ngl::Vec3 &_modelPos, QWheelEvent *_event);
 
 private:
     //----------------------------------------------------------------------------------------------------------------------
@@ -59,6 +233,15 @@ private:
     //----------------------------------------------------------------------------------------------------------------------
     ngl::Mat4 m_view;
     ngl::Mat4 m_project;
+    ngl::Vec3 m_eye;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief framebuffer override for offscreen rendering, otherwise the window's default framebuffer is used
+    //----------------------------------------------------------------------------------------------------------------------
+    std::optional<GLuint> m_renderTarget;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief optional fixed seed for the light generator and animation, 0 if unset
+    //----------------------------------------------------------------------------------------------------------------------
+    std::optional<unsigned int> m_seed;
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief transformation stack for the gl transformations etc
     //----------------------------------------------------------------------------------------------------------------------
@@ -69,24 +252,187 @@ private:
     ngl::Vec3 m_modelPos;
     // an array of lights
     int m_numLights=8;
-    struct Light
+    LightSoA m_lights;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief fills m_lights and the mapped light buffer, m_lightGeneration picks a new set from the same seed
+    //----------------------------------------------------------------------------------------------------------------------
+    LightGenerator m_lightGenerator;
+    uint32_t m_lightGeneration=0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief lights loaded from a file rather than generated, the binary file stays mapped while it streams in and
+    /// m_streamPublished is how many of the streamed lights are shaded
+    //----------------------------------------------------------------------------------------------------------------------
+    LightFile m_lightFile;
+    std::string m_lightFilePath;
+    bool m_fileLights=false;
+    size_t m_streamPublished=0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the GPU copy of m_lights read by the PBR shader
+    //----------------------------------------------------------------------------------------------------------------------
+    LightBuffer m_lightBuffer;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief per cluster light lists, rebuilt when the lights or projection change
+    //----------------------------------------------------------------------------------------------------------------------
+    LightClusters m_lightClusters;
+    bool m_clustered=true;
+    bool m_clustersDirty=true;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief moves the lights on the GPU each frame when m_animateLights is set, m_lights stays the rest state
+    //----------------------------------------------------------------------------------------------------------------------
+    LightAnimator m_lightAnimator;
+    bool m_animateLights=false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the animated part of the scene, stepped at a fixed rate and interpolated for drawing
+    //----------------------------------------------------------------------------------------------------------------------
+    struct SimulationState
     {
-      ngl::Vec3 position;
-      ngl::Vec3 colour;
+      ngl::Real teapotRotation=0.0f;
+      ngl::Real lightTime=0.0f;
     };
-
-    std::vector<Light> m_lightArray;
-    ngl::Real m_teapotRotation=0.0f;
-    int m_rotationTimer;
-    int m_lightChangeTimer;
+    SimulationState m_previousState;
+    SimulationState m_state;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frame time not yet consumed by a simulation step
+    //----------------------------------------------------------------------------------------------------------------------
+    std::chrono::duration<double> m_accumulator{0.0};
+    std::optional<std::chrono::steady_clock::time_point> m_lastFrame;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set by setPose, the state is then only changed from outside
+    //----------------------------------------------------------------------------------------------------------------------
+    bool m_externalPose=false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief interval between the last two frames and the sum / worst since the last report
+    //----------------------------------------------------------------------------------------------------------------------
+    float m_frameMs=0.0f;
+    float m_frameMsSum=0.0f;
+    float m_frameMsMax=0.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what has changed since the last frame was drawn. Marking anything schedules a frame, and
+    /// m_frameScheduled stays set until that frame is presented so every request in between is coalesced into it
+    //----------------------------------------------------------------------------------------------------------------------
+    enum DirtyFlags : uint32_t
+    {
+      CameraDirty = 1,
+      LightsDirty = 2,
+      TransformsDirty = 4,
+      SettingsDirty = 8,
+      AllDirty = 15
+    };
+    uint32_t m_dirty=AllDirty;
+    bool m_frameScheduled=false;
+    bool m_onDemand=false;
+    bool m_paused=false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frames drawn and display refreshes given no new frame since startup, and redraw requests coalesced into
+    /// a frame already scheduled
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t m_renderedFrames=0;
+    size_t m_skippedFrames=0;
+    size_t m_coalescedRequests=0;
+    std::chrono::steady_clock::time_point m_lastReport;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief G-buffer renderer used in place of the forward PBR shader when m_deferred is set
+    //----------------------------------------------------------------------------------------------------------------------
+    DeferredRenderer m_deferredRenderer;
+    bool m_deferred=false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief sets the deferred lighting scale from the pass timings when it has a target, m_resolutionSample is
+    /// the last timing sample it was given so each measurement is only used once
+    //----------------------------------------------------------------------------------------------------------------------
+    ResolutionController m_resolution;
+    size_t m_resolutionSample=0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the instanced objects drawn in place of the teapot when m_numObjects is more than 1, laid out again
+    /// when m_objectsDirty is set
+    //----------------------------------------------------------------------------------------------------------------------
+    InstancedScene m_instances;
+    int m_numObjects=1;
+    bool m_objectsDirty=true;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stochastic light selection for the forward path, m_stochasticSamples is kept while it is off.
+    /// m_stochasticView is last frame's object to clip matrix, the history only converges while it is unchanged
+    //----------------------------------------------------------------------------------------------------------------------
+    StochasticLights m_stochasticLights;
+    bool m_stochastic=false;
+    int m_stochasticSamples=4;
+    bool m_aliasTableDirty=true;
+    ngl::Mat4 m_stochasticView;
+    bool m_depthPrepass=false;
+    BRDFMode m_brdfMode=BRDFMode::Reference;
+    BRDFLookup m_brdfLookup;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the shadow views, m_casterVersion changes whenever the objects move and m_casterKey is what they were
+    /// drawn with last
+    //----------------------------------------------------------------------------------------------------------------------
+    ShadowAtlas m_shadowAtlas;
+    bool m_shadows=false;
+    uint64_t m_casterVersion=0;
+    ngl::Mat4 m_casterKey;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the visible light and gizmo lists, refreshed each frame while m_cullLights is set
+    //----------------------------------------------------------------------------------------------------------------------
+    LightCuller m_lightCuller;
+    bool m_cullLights=false;
+    float m_lightCutoff=0.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief CPU / GPU section timings, shown with m_text when m_showHUD is set
+    //----------------------------------------------------------------------------------------------------------------------
+    Profiler m_profiler;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief every program goes through here so startup and permutation switches can skip the compiler
+    //----------------------------------------------------------------------------------------------------------------------
+    ShaderCache m_shaderCache;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief all of our program binds and uniform sets go through here so unchanged values are never resent
+    //----------------------------------------------------------------------------------------------------------------------
+    ShaderState m_shaderState;
+    bool m_clearShaderCache=false;
+    bool m_precompileShaders=true;
+    float m_startupMs=0.0f;
+    std::unique_ptr<ngl::Text> m_text;
+    bool m_showHUD=true;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frames drawn since the light upload stats were last reported
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t m_framesSinceReport=0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief when the light count was last changed, the next frame reports how long it took to appear
+    //----------------------------------------------------------------------------------------------------------------------
+    std::chrono::steady_clock::time_point m_lightEditStart;
+    bool m_timeLightEdit=false;
+    std::optional<float> m_lightEditMs;
+    int m_lightChangeTimer=0;
     ngl::Real m_scale=8.0f;
     bool m_showLights=true;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the surface every object is shaded with
+    //----------------------------------------------------------------------------------------------------------------------
+    CPURenderer::Material m_material={ngl::Vec3(0.950f, 0.71f, 0.29f), 1.02f, 0.38f, 0.2f};
 
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief method to load transform matrices to the shader
+    /// @param [in] _shader the program to load them to, PBR or the deferred G-buffer shader
     //----------------------------------------------------------------------------------------------------------------------
-    void loadMatricesToShader();
-    void loadMatricesToColourShader(const ngl::Vec4 &_colour);
+    void loadMatricesToShader(std::string_view _shader);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief make _shader current ready to draw the objects, loading the teapot matrices unless instanced
+    /// @param [in] _shader a program using PBRVertex.glsl, or PBRInstancedVertex.glsl when instanced
+    //----------------------------------------------------------------------------------------------------------------------
+    void useObjectShader(std::string_view _shader);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the spinning teapot or every instanced object with the current program
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawObjects();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bring the shadow atlas up to date for this frame's objects, leaves our target and camera bound
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateShadows();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a world space sphere around everything drawn, the teapot or the whole instanced volume
+    /// @param [out] _centre its centre
+    /// @param [out] _radius its radius
+    //----------------------------------------------------------------------------------------------------------------------
+    void objectBounds(ngl::Vec3 &_centre, float &_radius);
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief Qt Event called when a key is pressed
     /// @param [in] _event the Qt event to query for size etc
@@ -120,12 +466,72 @@ private:
     //----------------------------------------------------------------------------------------------------------------------
     void createLights();
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief timer event triggered when we need to update teapot or lights
+    /// @brief send m_lights to the light buffer unchanged
+    //----------------------------------------------------------------------------------------------------------------------
+    void uploadLights();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief m_numLights lights are now in the light buffer, rebuild everything derived from them
+    //----------------------------------------------------------------------------------------------------------------------
+    void lightsChanged();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief replace the lights with those in _path, a binary light file or a .json rig
+    /// @returns false if the file couldn't be loaded, the current lights are left alone
+    //----------------------------------------------------------------------------------------------------------------------
+    bool loadLights(const std::string &_path);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief copy the next chunk of m_lightFile, called at the start of each frame while it streams
+    //----------------------------------------------------------------------------------------------------------------------
+    void streamLights();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief timer event triggered when we need to update the lights
     //----------------------------------------------------------------------------------------------------------------------
     void timerEvent(QTimerEvent *_event );
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief run as many fixed steps as the time since the last frame allows
+    /// @returns the state to draw, interpolated between the last two steps
+    //----------------------------------------------------------------------------------------------------------------------
+    SimulationState advanceSimulation();
+    void stepSimulation();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief record what changed and ask for a frame unless one is already scheduled
+    /// @param [in] _flags the DirtyFlags that changed
+    //----------------------------------------------------------------------------------------------------------------------
+    void markDirty(uint32_t _flags);
+    void scheduleFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief something on screen changes without input, so on demand mode keeps drawing
+    //----------------------------------------------------------------------------------------------------------------------
+    bool animating() const;
 
     void updateLights(int _amount);
-    void loadShaderDefaults();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the material uniforms
+    /// @param [in] _shader the program to set them on
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadShaderDefaults(std::string_view _shader);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the forward PBR permutation for the current settings, loaded from the shader cache on first use
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string_view forwardShader();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load _variant from the shader cache with the material set if it isn't already
+    /// @returns the program name
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string_view cachedShader(const ShaderCache::Variant &_variant);
+    bool instanced() const { return m_numObjects > 1; }
+    bool stochastic() const { return m_stochastic && !m_deferred; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the forward pass loops over the culled light list rather than every light
+    //----------------------------------------------------------------------------------------------------------------------
+    bool culledLoop() const { return m_cullLights && !m_deferred && !m_clustered && !m_stochastic; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief show the light upload counters in the title bar and start a new sample
+    //----------------------------------------------------------------------------------------------------------------------
+    void reportLightStats();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the profiler summary over the scene
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawHUD();
 };
 
 
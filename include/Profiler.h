@@ -0,0 +1,132 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+#include <ngl/Types.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Profiler.h
+/// @brief named CPU and GPU timing sections with rolling statistics and Chrome trace export
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class Profiler
+/// @brief sections are timed with Profiler::Scope. CPU time is taken from std::chrono, GPU time from a pair of
+/// GL_TIMESTAMP queries (timestamps nest, unlike GL_TIME_ELAPSED). Queries are kept for FramesInFlight frames
+/// and only read back once available so the CPU never waits on the GPU
+//----------------------------------------------------------------------------------------------------------------------
+class Profiler
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief RAII timer for a named section, nests freely
+  //----------------------------------------------------------------------------------------------------------------------
+  class Scope
+  {
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @param [in] _profiler the profiler to record into
+    /// @param [in] _name section name, must outlive the profiler (string literals)
+    /// @param [in] _gpu also time the GL commands issued inside the scope
+    //----------------------------------------------------------------------------------------------------------------------
+    Scope(Profiler &_profiler, const char *_name, bool _gpu = true);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Profiler &m_profiler;
+    size_t m_section;
+    GLuint m_startQuery = 0;
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief rolling statistics of a section in ms
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    float cpuAvg = 0.0f;
+    float cpuP99 = 0.0f;
+    float gpuAvg = 0.0f;
+    float gpuP99 = 0.0f;
+  };
+
+  Profiler() = default;
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+  ~Profiler();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief mark the start of a frame. The query pool issued FramesInFlight frames ago is read back if it has
+  /// finished (and dropped if not) then reused, scopes run between frames go into the previous frame's pool
+  //----------------------------------------------------------------------------------------------------------------------
+  void beginFrame();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief rolling average and p99 over the last HistorySize samples of a section
+  /// @param [in] _name the section name
+  //----------------------------------------------------------------------------------------------------------------------
+  Stats stats(const std::string &_name) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one formatted line per section, used for the on screen HUD
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<std::string> summary() const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start recording every scope as a trace event
+  //----------------------------------------------------------------------------------------------------------------------
+  void startTrace();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief stop recording and write a Chrome trace (chrome://tracing or ui.perfetto.dev) JSON file
+  /// @param [in] _fileName where to write the trace
+  /// @returns false if the file can't be written
+  //----------------------------------------------------------------------------------------------------------------------
+  bool stopTrace(const std::string &_fileName);
+  bool isTracing() const { return m_tracing; }
+
+  static constexpr size_t FramesInFlight = 3;
+  static constexpr size_t HistorySize = 120;
+
+private:
+  struct Section
+  {
+    const char *name;
+    std::deque<float> cpu;
+    std::deque<float> gpu;
+  };
+  struct GPURecord
+  {
+    size_t section;
+    GLuint start;
+    GLuint end;
+  };
+  struct FrameQueries
+  {
+    std::vector<GLuint> pool;
+    size_t used = 0;
+    std::vector<GPURecord> records;
+  };
+  struct TraceEvent
+  {
+    size_t section;
+    bool gpu;
+    double startUs;
+    double durationUs;
+  };
+  size_t findSection(const char *_name);
+  GLuint allocateQuery();
+  void addSample(std::deque<float> &_history, float _ms);
+  void collect(FrameQueries &_frame);
+  double cpuTraceTime(std::chrono::steady_clock::time_point _time) const;
+
+  std::vector<Section> m_sections;
+  std::array<FrameQueries, FramesInFlight> m_frames;
+  size_t m_frame = 0;
+  bool m_tracing = false;
+  std::vector<TraceEvent> m_trace;
+  std::chrono::steady_clock::time_point m_traceEpoch;
+  GLint64 m_gpuTraceEpoch = 0;
+};
+
+#endif
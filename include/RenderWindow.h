@@ -0,0 +1,157 @@
+#ifndef RENDERWINDOW_H_
+#define RENDERWINDOW_H_
+#include "NGLScene.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
+#include "WindowParams.h"
+#include <ngl/Vec3.h>
+#include <QWindow>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RenderWindow.h
+/// @brief a window whose GL context is owned by a render thread, so a slow frame never holds up input and a burst
+/// of input never holds up a frame
+//----------------------------------------------------------------------------------------------------------------------
+
+class QOpenGLContext;
+class QThread;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class RenderWindow
+/// @brief the GUI thread only handles events. Mouse input moves its own copy of the camera, which is published as an
+/// immutable snapshot through a TripleBuffer, so the render thread always takes the newest and never waits. Keys and
+/// the once a second new light set are discrete, so they go through an SPSCQueue and are applied in order on the
+/// render thread, which is where the light generation, uploads and any shader compile they cause now happen. The
+/// render thread drives NGLScene as the benchmark does, sleeping while it has nothing to draw in on demand mode, and
+/// hands a second of frame timings back through another TripleBuffer for the title bar
+//----------------------------------------------------------------------------------------------------------------------
+class RenderWindow : public QWindow
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a second of the render thread's frames. Frame time is between presents and paintGL is the CPU time of the
+  /// scene's work, latency is from an input event on the GUI thread to the first present that includes it
+  //----------------------------------------------------------------------------------------------------------------------
+  struct FrameStats
+  {
+    size_t frames = 0;
+    float frameMs = 0.0f;
+    float frameMsMax = 0.0f;
+    float paintMs = 0.0f;
+    float latencyMs = 0.0f;
+    float latencyMsMax = 0.0f;
+    size_t inputs = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief camera snapshots replaced by a newer one before the render thread took them
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t coalesced = 0;
+    size_t lights = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief key press to frame complete of the last light count edit in the second, if there was one
+    //----------------------------------------------------------------------------------------------------------------------
+    std::optional<float> lightEditMs;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief take over _scene, configured but not yet initialised. It is only touched by the render thread from
+  /// the first expose until this window is destroyed
+  //----------------------------------------------------------------------------------------------------------------------
+  explicit RenderWindow(std::unique_ptr<NGLScene> _scene);
+  RenderWindow(const RenderWindow &) = delete;
+  RenderWindow &operator=(const RenderWindow &) = delete;
+  ~RenderWindow();
+
+protected:
+  void exposeEvent(QExposeEvent *_event);
+  void resizeEvent(QResizeEvent *_event);
+  void keyPressEvent(QKeyEvent *_event);
+  void mouseMoveEvent(QMouseEvent *_event);
+  void mousePressEvent(QMouseEvent *_event);
+  void mouseReleaseEvent(QMouseEvent *_event);
+  void wheelEvent(QWheelEvent *_event);
+  void timerEvent(QTimerEvent *_event);
+
+private:
+  using Clock = std::chrono::steady_clock;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the camera and window size as the GUI thread last saw them. input is when the oldest input event the
+  /// render thread hasn't taken yet arrived, unset if there is none
+  //----------------------------------------------------------------------------------------------------------------------
+  struct CameraSnapshot
+  {
+    int spinX = 0;
+    int spinY = 0;
+    ngl::Vec3 modelPos;
+    int width = 0;
+    int height = 0;
+    uint64_t sequence = 0;
+    std::optional<Clock::time_point> input;
+  };
+  struct Command
+  {
+    enum class Type
+    {
+      Key,
+      NewLights
+    };
+    Type type = Type::Key;
+    int key = 0;
+    Clock::time_point time;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the context and start the render thread, on the first expose
+  //----------------------------------------------------------------------------------------------------------------------
+  void start();
+  void renderLoop();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief publish m_win and m_modelPos and wake the render thread
+  /// @param [in] _input true if an input event changed them, to be timed until it is presented
+  //----------------------------------------------------------------------------------------------------------------------
+  void publishCamera(bool _input);
+  void pushCommand(const Command &_command);
+  void wake();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief show the last published FrameStats in the title bar
+  //----------------------------------------------------------------------------------------------------------------------
+  void reportStats();
+
+  std::unique_ptr<NGLScene> m_scene;
+  std::unique_ptr<QOpenGLContext> m_context;
+  std::unique_ptr<QThread> m_thread;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GUI thread state, the camera the mouse moves and the last snapshot published
+  //----------------------------------------------------------------------------------------------------------------------
+  WinParams m_win;
+  ngl::Vec3 m_modelPos;
+  uint64_t m_sequence = 0;
+  std::optional<Clock::time_point> m_firstInput;
+  int m_timer = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief whether the window can be presented to, the render thread sleeps while it isn't
+  //----------------------------------------------------------------------------------------------------------------------
+  std::atomic<bool> m_exposed{false};
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GUI to render thread
+  //----------------------------------------------------------------------------------------------------------------------
+  TripleBuffer<CameraSnapshot> m_cameras;
+  SPSCQueue<Command, 256> m_commands;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief render to GUI thread, the last snapshot sequence taken and a second of timings
+  //----------------------------------------------------------------------------------------------------------------------
+  std::atomic<uint64_t> m_consumed{0};
+  TripleBuffer<FrameStats> m_stats;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the render thread sleeps here while the scene needs no frame, any publish or command wakes it
+  //----------------------------------------------------------------------------------------------------------------------
+  std::mutex m_wakeMutex;
+  std::condition_variable m_wakeCondition;
+  bool m_woken = false;
+  std::atomic<bool> m_quit{false};
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef RESOLUTIONCONTROLLER_H_
+#define RESOLUTIONCONTROLLER_H_
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ResolutionController.h
+/// @brief picks the light accumulation resolution from measured GPU times so the frame lands on a target time
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class ResolutionController
+/// @brief the frame is modelled as a fixed part plus a part that scales with the area shaded (scale squared).
+/// Each measurement re-estimates both from the scale it was taken at, the scale that would meet the target is
+/// then approached gradually and small changes are ignored so the image doesn't shimmer between sizes
+//----------------------------------------------------------------------------------------------------------------------
+class ResolutionController
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the GPU frame time to aim for, 0 turns the controller off and leaves the scale where it is
+  /// @param [in] _ms target in milliseconds
+  //----------------------------------------------------------------------------------------------------------------------
+  void setTarget(float _ms) { m_targetMs = _ms; }
+  float target() const { return m_targetMs; }
+  bool enabled() const { return m_targetMs > 0.0f; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief feed one measurement
+  /// @param [in] _frameMs GPU time of the whole frame
+  /// @param [in] _scaledMs the part of _frameMs spent in the pass drawn at reduced resolution
+  /// @param [in] _scale the scale that pass was drawn at
+  /// @returns the scale to draw at next
+  //----------------------------------------------------------------------------------------------------------------------
+  float update(float _frameMs, float _scaledMs, float _scale);
+  float scale() const { return m_scale; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the controller never goes below MinScale, a quarter of the width is a sixteenth of the shading
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr float MinScale = 0.25f;
+  static constexpr float MaxScale = 1.0f;
+
+private:
+  float m_targetMs = 0.0f;
+  float m_scale = MaxScale;
+};
+
+#endif
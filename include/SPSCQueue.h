@@ -0,0 +1,63 @@
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+#include <array>
+#include <atomic>
+#include <cstddef>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SPSCQueue.h
+/// @brief a bounded lock-free queue between exactly one producer thread and one consumer thread
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class SPSCQueue
+/// @brief a ring of Capacity slots. The producer only writes the tail and the consumer only writes the head, so each
+/// index has a single writer and a push or pop is one load of the other side's index and one release store of its
+/// own. Unlike TripleBuffer every value arrives, in order, which is what discrete events such as key presses need
+//----------------------------------------------------------------------------------------------------------------------
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+public:
+  static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief producer side, append _value
+  /// @returns false if the queue is full, _value is dropped
+  //----------------------------------------------------------------------------------------------------------------------
+  bool push(const T &_value)
+  {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+    {
+      return false;
+    }
+    m_slots[tail & (Capacity - 1)] = _value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief consumer side, take the oldest value
+  /// @param [out] _value the value, untouched if the queue is empty
+  /// @returns false if the queue is empty
+  //----------------------------------------------------------------------------------------------------------------------
+  bool pop(T &_value)
+  {
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    _value = m_slots[head & (Capacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  std::array<T, Capacity> m_slots{};
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief free running counts of values popped and pushed, on separate cache lines so the two threads don't share one
+  //----------------------------------------------------------------------------------------------------------------------
+  alignas(64) std::atomic<size_t> m_head{0};
+  alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+#endif
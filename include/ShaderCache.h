@@ -0,0 +1,138 @@
+#ifndef SHADERCACHE_H_
+#define SHADERCACHE_H_
+#include <ngl/Types.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShaderCache.h
+/// @brief builds shader permutations (a source pair plus #defines) into ngl::ShaderLib programs, reusing linked
+/// program binaries from memory or disk so startup and variant switches skip the GLSL compiler
+//----------------------------------------------------------------------------------------------------------------------
+
+class QOpenGLContext;
+class QOffscreenSurface;
+class QThread;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class ShaderCache
+/// @brief binaries come from glGetProgramBinary and are only valid for the driver that made them, each entry on
+/// disk records a hash of the final sources and the GL vendor / renderer / version string and is rebuilt from
+/// source if either differs. Variants can be linked ahead of time on a background thread with a shared context
+//----------------------------------------------------------------------------------------------------------------------
+class ShaderCache
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief one permutation, the defines are inserted after the #version line of every stage. A variant with a
+  /// compute source builds a compute only program and leaves vertex and fragment empty
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Variant
+  {
+    std::string name;
+    std::string vertex;
+    std::string fragment;
+    std::vector<std::string> defines;
+    std::string compute = {};
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief where each load came from and the time spent loading
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t memoryHits = 0;
+    size_t diskHits = 0;
+    size_t compiles = 0;
+    size_t precompiled = 0;
+    float loadMs = 0.0f;
+  };
+  ShaderCache();
+  ShaderCache(const ShaderCache &) = delete;
+  ShaderCache &operator=(const ShaderCache &) = delete;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief waits for any background precompile
+  //----------------------------------------------------------------------------------------------------------------------
+  ~ShaderCache();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set where binaries are kept, empty keeps them in memory only
+  /// @param [in] _directory the cache directory, created on first write
+  //----------------------------------------------------------------------------------------------------------------------
+  void setDirectory(const std::string &_directory) { m_directory = _directory; }
+  const std::string &directory() const { return m_directory; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief delete every cached binary on disk so the next start is cold
+  //----------------------------------------------------------------------------------------------------------------------
+  void clear();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief make _variant.name a linked ShaderLib program, a no-op if it already is. Needs a current context. A
+  /// variant that fails is reported once and every later load of it returns false without building it again
+  /// @param [in] _variant the permutation to build
+  /// @returns false if it failed to compile or link
+  //----------------------------------------------------------------------------------------------------------------------
+  bool load(const Variant &_variant);
+  bool isLoaded(const std::string &_name) const { return m_loaded.count(_name) != 0; }
+  bool hasFailed(const std::string &_name) const { return m_failed.count(_name) != 0; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief link variants on a background thread with a context shared with the current one, only the binaries
+  /// are kept so a later load of each is a cache hit. Does nothing if the driver can't return program binaries
+  /// @param [in] _variants the permutations to build
+  //----------------------------------------------------------------------------------------------------------------------
+  void precompile(std::vector<Variant> _variants);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief block until a background precompile has finished
+  //----------------------------------------------------------------------------------------------------------------------
+  void waitForPrecompile();
+  Stats stats() const;
+
+private:
+  struct Sources
+  {
+    std::string vertex;
+    std::string fragment;
+    std::string compute;
+    uint64_t hash = 0;
+  };
+  struct Binary
+  {
+    GLenum format = 0;
+    std::vector<char> data;
+  };
+  Sources readSources(const Variant &_variant) const;
+  std::string cacheFile(const std::string &_name, uint64_t _hash) const;
+  enum class Origin
+  {
+    None,
+    Memory,
+    Disk
+  };
+  Origin findBinary(const std::string &_name, uint64_t _hash, Binary &_binary);
+  void storeBinary(const std::string &_name, uint64_t _hash, Binary _binary);
+  void queryDriver();
+
+  std::string m_directory;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief GL_VENDOR / GL_RENDERER / GL_VERSION, a binary from any other driver is rejected
+  //----------------------------------------------------------------------------------------------------------------------
+  std::string m_driver;
+  bool m_binariesSupported = false;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief binaries by source hash, shared with the precompile thread
+  //----------------------------------------------------------------------------------------------------------------------
+  mutable std::mutex m_mutex;
+  std::unordered_map<uint64_t, Binary> m_binaries;
+  std::unordered_set<std::string> m_loaded;
+  std::unordered_set<std::string> m_failed;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief guarded by m_mutex as the precompile thread counts into it
+  //----------------------------------------------------------------------------------------------------------------------
+  Stats m_stats;
+  std::unique_ptr<QOffscreenSurface> m_surface;
+  std::unique_ptr<QOpenGLContext> m_context;
+  std::unique_ptr<QThread> m_thread;
+};
+
+#endif
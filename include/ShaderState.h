@@ -0,0 +1,86 @@
+#ifndef SHADERSTATE_H_
+#define SHADERSTATE_H_
+#include <ngl/Mat3.h>
+#include <ngl/Mat4.h>
+#include <ngl/Vec3.h>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShaderState.h
+/// @brief a thin layer over ngl::ShaderLib that drops redundant program binds and uniform uploads
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class ShaderState
+/// @brief use() skips glUseProgram when ShaderLib's current program is already the one asked for, so binds made
+/// by code that talks to ShaderLib directly are still seen. setUniform() caches each uniform's location and last
+/// value per program and only calls glUniform* when the value changes. Uniforms set on the same program by other
+/// paths must not also be set through here or the cached value goes stale
+//----------------------------------------------------------------------------------------------------------------------
+class ShaderState
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief calls made and avoided
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t programBinds = 0;
+    size_t programSkips = 0;
+    size_t uniformSets = 0;
+    size_t uniformSkips = 0;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief make _program current unless it already is
+  /// @param [in] _program the ShaderLib program name
+  //----------------------------------------------------------------------------------------------------------------------
+  void use(std::string_view _program);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set a uniform on the program last passed to use, skipped if it already holds _value
+  //----------------------------------------------------------------------------------------------------------------------
+  void setUniform(std::string_view _name, int _value);
+  void setUniform(std::string_view _name, int _x, int _y);
+  void setUniform(std::string_view _name, int _x, int _y, int _z);
+  void setUniform(std::string_view _name, float _value);
+  void setUniform(std::string_view _name, float _x, float _y, float _z);
+  void setUniform(std::string_view _name, const ngl::Vec3 &_value);
+  void setUniform(std::string_view _name, const ngl::Mat3 &_value);
+  void setUniform(std::string_view _name, const ngl::Mat4 &_value);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief start counting a new frame, the finished frame's counts move to lastFrame
+  //----------------------------------------------------------------------------------------------------------------------
+  void beginFrame();
+  const Stats &lastFrame() const { return m_lastFrame; }
+
+private:
+  struct Uniform
+  {
+    GLint location = -1;
+    std::vector<unsigned char> value;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the maps compare with std::less<> so they are searched by string_view, and a name is only copied the
+  /// first time it is seen
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Program
+  {
+    GLuint id = 0;
+    std::map<std::string, Uniform, std::less<>> uniforms;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief compare _value with the cached copy and update it
+  /// @returns the location to set or -1 if the call can be skipped
+  //----------------------------------------------------------------------------------------------------------------------
+  GLint changed(std::string_view _name, const void *_value, size_t _size);
+
+  std::map<std::string, Program, std::less<>> m_programs;
+  Program *m_current = nullptr;
+  Stats m_stats;
+  Stats m_lastFrame;
+};
+
+#endif
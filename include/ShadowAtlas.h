@@ -0,0 +1,184 @@
+#ifndef SHADOWATLAS_H_
+#define SHADOWATLAS_H_
+#include "LightBuffer.h"
+#include <ngl/Mat4.h>
+#include <ngl/Vec3.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShadowAtlas.h
+/// @brief omnidirectional shadows for the lights that matter most, six depth views per light packed into one
+/// shared atlas and only re-rendered when something they see has moved
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class ShadowAtlas
+/// @brief the atlas is cut into fixed slots in three tiers, a few at the full face size, more at half and most at a
+/// quarter. Each frame the lights whose influence reaches the casters are ranked by how much of the screen they
+/// light, the highest ranks get the large slots and the rest smaller ones or none. A slot keeps its depth views
+/// until its light or the casters move, and then at most the budget of slots are re-rendered a frame, the longest
+/// stale first weighted by rank. A light is only given to the shader once its slot holds its views, until then it
+/// is shaded unshadowed. The forward shader's SHADOWS permutation reads the views with the light's slot index
+//----------------------------------------------------------------------------------------------------------------------
+class ShadowAtlas
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief what the last update did, a view is one face of a light's cube
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    size_t shadowedLights = 0;
+    size_t renderedViews = 0;
+    size_t reusedViews = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief faces the casters can't be in, cleared rather than drawn
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t emptyViews = 0;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief slots out of date that didn't fit in the budget
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t staleLights = 0;
+    float updateMs = 0.0f;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a bounding sphere of everything that casts shadows and a count that changes whenever any of it moves
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Casters
+  {
+    ngl::Vec3 centre;
+    float radius = 0.0f;
+    uint64_t version = 0;
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief draws the casters depth only for a view, the atlas has the viewport and framebuffer set
+  //----------------------------------------------------------------------------------------------------------------------
+  using DrawCasters = std::function<void(const ngl::Mat4 &_view, const ngl::Mat4 &_project)>;
+
+  ShadowAtlas() = default;
+  ShadowAtlas(const ShadowAtlas &) = delete;
+  ShadowAtlas &operator=(const ShadowAtlas &) = delete;
+  ~ShadowAtlas();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief create the buffers, must be called once a GL context is valid. The atlas itself is allocated on first use
+  /// @param [in] _slotBinding shader storage binding of ShadowSlots in PBRFragment.glsl
+  /// @param [in] _lightSlotBinding shader storage binding of LightShadows in PBRFragment.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(GLuint _slotBinding, GLuint _lightSlotBinding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief slots re-rendered at most per frame
+  //----------------------------------------------------------------------------------------------------------------------
+  void setBudget(int _lights) { m_budget = std::max(_lights, 1); }
+  int budget() const { return m_budget; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the face size of the largest tier in pixels, the others are a half and a quarter of it. The atlas is
+  /// 6 x 8 faces of this size
+  //----------------------------------------------------------------------------------------------------------------------
+  void setFaceSize(int _size);
+  int faceSize() const { return m_faceSize; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief forget every slot on the next update, call whenever the lights are replaced
+  //----------------------------------------------------------------------------------------------------------------------
+  void invalidate() { m_lightsDirty = true; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief rank the lights, assign slots and re-render the stale ones within the budget. Leaves the atlas
+  /// framebuffer bound, the caller rebinds its target and viewport
+  /// @param [in] _lights the lights as uploaded
+  /// @param [in] _numLights how many of them the shader sees
+  /// @param [in] _viewProject the camera, lights out of its frustum get no slot
+  /// @param [in] _projectScale the projection's y scale, to estimate how large a light's influence is on screen
+  /// @param [in] _eye the camera position
+  /// @param [in] _casters the bounds of the shadow casters
+  /// @param [in] _draw draws the casters for a view
+  //----------------------------------------------------------------------------------------------------------------------
+  void update(const LightSoA &_lights, size_t _numLights, const ngl::Mat4 &_viewProject, float _projectScale, const ngl::Vec3 &_eye,
+              const Casters &_casters, const DrawCasters &_draw);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind the atlas and the slot buffers for the SHADOWS forward shader
+  /// @param [in] _unit the texture unit of shadowAtlas
+  //----------------------------------------------------------------------------------------------------------------------
+  void bind(GLuint _unit) const;
+  const Stats &stats() const { return m_stats; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief slots in each tier, largest faces first
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr std::array<size_t, 3> TierSlots = {2, 8, 64};
+  static constexpr int DefaultFaceSize = 256;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief a quarter of the smallest face must still be a few texels, and the atlas within any GL 4.3 texture
+  /// size limit
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr int MinFaceSize = 32;
+  static constexpr int MaxFaceSize = 2048;
+  static constexpr int DefaultBudget = 8;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief std430 layout of ShadowSlot in PBRFragment.glsl, the projection of each face and where the faces are in
+  /// the atlas, the origin of the 3 x 2 block and the size of a face as fractions of the atlas
+  //----------------------------------------------------------------------------------------------------------------------
+  struct GPUSlot
+  {
+    std::array<ngl::Mat4, 6> faces;
+    float rect[4];
+  };
+  static_assert(sizeof(GPUSlot) == 400, "GPUSlot must match the std430 layout in PBRFragment.glsl");
+  struct Slot
+  {
+    size_t tier = 0;
+    int x = 0;
+    int y = 0;
+    int size = 0;
+    uint32_t light = NoLight;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the views are of light and the shader has been told, false until the first render for a light
+    //----------------------------------------------------------------------------------------------------------------------
+    bool published = false;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what the views were rendered from, any difference makes them stale
+    //----------------------------------------------------------------------------------------------------------------------
+    float position[3] = {};
+    float radius = 0.0f;
+    uint64_t casterVersion = 0;
+    size_t renderedFrame = 0;
+    float priority = 0.0f;
+  };
+  void allocateAtlas();
+  void releaseAtlas();
+  void rankLights(const LightSoA &_lights, size_t _numLights, const ngl::Mat4 &_viewProject, float _projectScale,
+                  const ngl::Vec3 &_eye, const Casters &_casters);
+  void assignSlots();
+  void renderSlot(Slot &_slot, size_t _index, const LightSoA &_lights, const Casters &_casters, const DrawCasters &_draw);
+  void resetSlots(size_t _numLights);
+  void setLightSlot(uint32_t _light, int32_t _slot);
+  bool stale(const Slot &_slot, const LightSoA &_lights, const Casters &_casters) const;
+
+  static constexpr uint32_t NoLight = ~0u;
+  GLuint m_atlas = 0;
+  GLuint m_fbo = 0;
+  GLuint m_slotBuffer = 0;
+  GLuint m_lightSlotBuffer = 0;
+  GLuint m_slotBinding = 0;
+  GLuint m_lightSlotBinding = 0;
+  int m_faceSize = DefaultFaceSize;
+  int m_budget = DefaultBudget;
+  bool m_atlasDirty = true;
+  bool m_lightsDirty = true;
+  size_t m_numLights = 0;
+  size_t m_frame = 0;
+  std::vector<Slot> m_slots;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief this frame's ranking, the light and its screen influence, best first
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<std::pair<float, uint32_t>> m_ranked;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the slot each light holds, or -1, mirrors what the assignment wants rather than what is published
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<int32_t> m_lightSlots;
+  Stats m_stats;
+};
+
+#endif
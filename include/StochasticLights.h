@@ -0,0 +1,126 @@
+#ifndef STOCHASTICLIGHTS_H_
+#define STOCHASTICLIGHTS_H_
+#include "LightBuffer.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+class ShaderState;
+class ShaderCache;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file StochasticLights.h
+/// @brief support for the forward shader's STOCHASTIC permutation, which shades a fixed number of sampled lights per
+/// fragment instead of all of them and relies on accumulation over frames to remove the noise
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class StochasticLights
+/// @brief builds the alias table the unclustered variant draws lights from in proportion to their power, and owns
+/// the targets the sampled lighting is rendered to and accumulated in. The forward pass draws into our framebuffer
+/// between begin and resolve, resolve blends it into the history and tonemaps the history into the caller's target
+//----------------------------------------------------------------------------------------------------------------------
+class StochasticLights
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief table build time and how many frames the current history holds
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Stats
+  {
+    float tableMs = 0.0f;
+    size_t accumulatedFrames = 0;
+  };
+  StochasticLights() = default;
+  StochasticLights(const StochasticLights &) = delete;
+  StochasticLights &operator=(const StochasticLights &) = delete;
+  ~StochasticLights();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load the accumulate and resolve shaders and create the table buffer, must be called once a GL context
+  /// is valid
+  /// @param [in] _shaders the cache the programs are loaded through
+  /// @param [in] _tableBinding shader storage binding of AliasTable in PBRFragment.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  void create(ShaderCache &_shaders, GLuint _tableBinding);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief set the render target size, the targets are reallocated and the history dropped on the next begin
+  /// @param [in] _width width in pixels
+  /// @param [in] _height height in pixels
+  //----------------------------------------------------------------------------------------------------------------------
+  void resize(int _width, int _height);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief build and upload the alias table, the chance of drawing each light is its share of the total power
+  /// @param [in] _lights the lights as uploaded to the light buffer
+  //----------------------------------------------------------------------------------------------------------------------
+  void buildTable(const LightSoA &_lights);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief bind and clear our framebuffer, the caller then draws the objects with a STOCHASTIC program
+  //----------------------------------------------------------------------------------------------------------------------
+  void begin();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief blend the frame into the history and tonemap the result into _target
+  /// @param [in] _state the scene's shader state, both pass programs are bound and fed through it
+  /// @param [in] _moved the camera or objects moved since the last frame, the history is clipped to this frame and
+  /// can only keep a fixed weight rather than converging
+  /// @param [in] _target the framebuffer to resolve into
+  //----------------------------------------------------------------------------------------------------------------------
+  void resolve(ShaderState &_state, bool _moved, GLuint _target);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief drop the history, call when the lights themselves change
+  //----------------------------------------------------------------------------------------------------------------------
+  void invalidate() { m_frames = 0; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief counts frames for the shader's noise seed, changes every frame so accumulation sees new samples
+  //----------------------------------------------------------------------------------------------------------------------
+  int frameIndex() const { return static_cast<int>(m_frameIndex); }
+  Stats stats() const { return {m_tableMs, m_frames}; }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief candidate lights streamed through each sample's reservoir
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr int Candidates = 8;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the history is an average of at most this many frames, and of MovingFrames once anything moves
+  //----------------------------------------------------------------------------------------------------------------------
+  static constexpr size_t MaxFrames = 256;
+  static constexpr size_t MovingFrames = 8;
+
+private:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief std430 layout of AliasTable in PBRFragment.glsl
+  //----------------------------------------------------------------------------------------------------------------------
+  struct AliasEntry
+  {
+    float threshold;
+    uint32_t alias;
+    float pdf;
+    float pad;
+  };
+  void allocateTargets();
+  void releaseTargets();
+
+  GLuint m_tableID = 0;
+  GLuint m_tableBinding = 0;
+  GLuint m_sceneFBO = 0;
+  GLuint m_colour = 0;
+  GLuint m_depth = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief ping pong histories, each frame reads one and writes the other
+  //----------------------------------------------------------------------------------------------------------------------
+  std::array<GLuint, 2> m_historyFBO = {};
+  std::array<GLuint, 2> m_history = {};
+  GLuint m_emptyVAO = 0;
+  int m_width = 1;
+  int m_height = 1;
+  bool m_targetsDirty = true;
+  size_t m_frames = 0;
+  uint32_t m_frameIndex = 0;
+  float m_tableMs = 0.0f;
+  std::vector<AliasEntry> m_table;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief scratch reused between table builds
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> m_scaled;
+  std::vector<uint32_t> m_small;
+  std::vector<uint32_t> m_large;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+#include <array>
+#include <atomic>
+#include <cstdint>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file TripleBuffer.h
+/// @brief hands the latest value from one thread to another without either ever waiting
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @class TripleBuffer
+/// @brief one writer fills the back copy and publishes it, one reader takes the newest published copy. The third copy
+/// is the one in between, swapped with an atomic exchange by whichever side moves next, so the writer never blocks
+/// on a slow reader and values the reader didn't get to in time are simply replaced by newer ones
+//----------------------------------------------------------------------------------------------------------------------
+template <typename T>
+class TripleBuffer
+{
+public:
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief writer side, the copy to fill. It holds whatever was published two writes ago, not the last value
+  //----------------------------------------------------------------------------------------------------------------------
+  T &back() { return m_buffers[m_back]; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief writer side, make back() the newest value and take the spare copy to fill next
+  //----------------------------------------------------------------------------------------------------------------------
+  void publish() { m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & IndexMask; }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief reader side, take the newest published value if there is one since the last call
+  /// @returns true if front() changed
+  //----------------------------------------------------------------------------------------------------------------------
+  bool update()
+  {
+    if ((m_middle.load(std::memory_order_relaxed) & Fresh) == 0)
+    {
+      return false;
+    }
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+    return true;
+  }
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief reader side, the value last taken by update(), default constructed until then
+  //----------------------------------------------------------------------------------------------------------------------
+  const T &front() const { return m_buffers[m_front]; }
+
+private:
+  static constexpr uint32_t IndexMask = 3;
+  static constexpr uint32_t Fresh = 4;
+  std::array<T, 3> m_buffers{};
+  uint32_t m_back = 0;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the copy between the two sides, with Fresh set while it holds a value the reader hasn't taken
+  //----------------------------------------------------------------------------------------------------------------------
+  std::atomic<uint32_t> m_middle{1};
+  uint32_t m_front = 2;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#version 430 core
+// light accumulation pass of the deferred path, the BRDF is the same as PBRFragment.glsl
+layout (location = 0) out vec4 fragColour;
+
+flat in int lightIndex;
+
+struct Light
+{
+    vec4 position;
+    vec4 colour;
+};
+
+layout (std430, binding = 0) readonly buffer LightBlock
+{
+    Light lights[];
+};
+
+uniform sampler2D albedoAOTex;
+uniform sampler2D normalMaterialTex;
+uniform sampler2D depthTex;
+uniform mat4 inverseVP;
+uniform vec3 camPos;
+// light accumulation resolution over G-buffer resolution, below 1 each accumulation pixel shades one G-buffer pixel
+uniform float lightingScale;
+
+const float PI = 3.14159265359;
+// ----------------------------------------------------------------------------
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a = roughness*roughness;
+    float a2 = a*a;
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH*NdotH;
+
+    float nom   = a2;
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r*r) / 8.0;
+
+    float nom   = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+// ----------------------------------------------------------------------------
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+// ----------------------------------------------------------------------------
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    }
+    return normalize(n);
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    // the G-buffer pixel under this accumulation pixel's centre, DeferredResolveFragment.glsl must pick the same
+    ivec2 size = textureSize(depthTex, 0);
+    ivec2 pixel = min(ivec2(gl_FragCoord.xy / lightingScale), size - 1);
+    float depth = texelFetch(depthTex, pixel, 0).r;
+    if(depth >= 1.0)
+    {
+        discard;
+    }
+    // rebuild the world position from the depth buffer
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+    vec4 world = inverseVP * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 WorldPos = world.xyz / world.w;
+
+    Light light = lights[lightIndex];
+    float distance = length(light.position.xyz - WorldPos);
+    if(distance >= light.position.w)
+    {
+        discard;
+    }
+
+    vec4 albedoAO = texelFetch(albedoAOTex, pixel, 0);
+    vec4 normalMaterial = texelFetch(normalMaterialTex, pixel, 0);
+    vec3 albedo = albedoAO.rgb;
+    float metallic = normalMaterial.z;
+    float roughness = normalMaterial.w;
+
+    vec3 N = octDecode(normalMaterial.xy);
+    vec3 V = normalize(camPos - WorldPos);
+    vec3 F0 = vec3(0.04);
+    F0 = mix(F0, albedo, metallic);
+
+    vec3 L = normalize(light.position.xyz - WorldPos);
+    vec3 H = normalize(V + L);
+    // inverse square falloff windowed to reach zero at the light radius (position.w)
+    float ratio = distance / light.position.w;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    float attenuation = window * window / (distance * distance);
+    vec3 radiance = light.colour.rgb * attenuation;
+
+    // Cook-Torrance BRDF
+    float NDF = DistributionGGX(N, H, roughness);
+    float G   = GeometrySmith(N, V, L, roughness);
+    vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+    vec3 nominator    = NDF * G * F;
+    float denominator = 4 * max(dot(V, N), 0.0) * max(dot(L, N), 0.0) + 0.001; // 0.001 to prevent divide by zero.
+    vec3 brdf = nominator / denominator;
+
+    vec3 kS = F;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metallic;
+
+    float NdotL = max(dot(N, L), 0.0);
+    // additively blended into the light accumulation target
+    fragColour = vec4((kD * albedo / PI + brdf) * radiance * NdotL, 1.0);
+}
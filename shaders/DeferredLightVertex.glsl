@@ -0,0 +1,50 @@
+#version 430 core
+// one instance per light, each a screen space quad covering the projected bounds of the light's sphere
+
+struct Light
+{
+    vec4 position;
+    vec4 colour;
+};
+
+layout (std430, binding = 0) readonly buffer LightBlock
+{
+    Light lights[];
+};
+
+uniform mat4 VP;
+
+flat out int lightIndex;
+
+void main()
+{
+    lightIndex = gl_InstanceID;
+    vec3 centre = lights[gl_InstanceID].position.xyz;
+    float radius = lights[gl_InstanceID].position.w;
+    vec2 lo = vec2(1.0);
+    vec2 hi = vec2(-1.0);
+    bool crossesNear = false;
+    // project the corners of the sphere's bounding box, if any are behind the eye use the whole screen
+    for(int i = 0; i < 8; ++i)
+    {
+        vec3 corner = centre + radius * vec3((i & 1) == 0 ? -1.0 : 1.0, (i & 2) == 0 ? -1.0 : 1.0, (i & 4) == 0 ? -1.0 : 1.0);
+        vec4 clip = VP * vec4(corner, 1.0);
+        if(clip.w <= 0.0)
+        {
+            crossesNear = true;
+            break;
+        }
+        lo = min(lo, clip.xy / clip.w);
+        hi = max(hi, clip.xy / clip.w);
+    }
+    if(crossesNear)
+    {
+        lo = vec2(-1.0);
+        hi = vec2(1.0);
+    }
+    lo = clamp(lo, vec2(-1.0), vec2(1.0));
+    hi = clamp(hi, vec2(-1.0), vec2(1.0));
+    // four vertex triangle strip
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(mix(lo, hi, corner), 0.0, 1.0);
+}
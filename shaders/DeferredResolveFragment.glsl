@@ -0,0 +1,107 @@
+#version 430 core
+// final pass of the deferred path, adds the ambient term then tonemaps and gamma corrects as PBRFragment.glsl.
+// The G-buffer depth is written out so the light gizmos still depth test against the teapot. When the lighting
+// was accumulated at reduced resolution it is upsampled here, each of the four nearest accumulation pixels is
+// weighted by how close the surface it shaded is to this pixel's plane and normal so light doesn't bleed
+// across edges
+layout (location = 0) out vec4 fragColour;
+
+uniform sampler2D albedoAOTex;
+uniform sampler2D normalMaterialTex;
+uniform sampler2D lightAccumTex;
+uniform sampler2D depthTex;
+uniform float lightingScale;
+// the part of lightAccumTex the light pass drew into
+uniform ivec2 lightingSize;
+uniform mat4 inverseVP;
+uniform vec3 camPos;
+
+// ----------------------------------------------------------------------------
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+// ----------------------------------------------------------------------------
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if(n.z < 0.0)
+    {
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    }
+    return normalize(n);
+}
+// ----------------------------------------------------------------------------
+vec3 worldPosition(ivec2 pixel, float depth, vec2 size)
+{
+    vec2 uv = (vec2(pixel) + 0.5) / size;
+    vec4 world = inverseVP * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return world.xyz / world.w;
+}
+// ----------------------------------------------------------------------------
+vec3 upsampleLighting(ivec2 pixel, float depth)
+{
+    if(lightingScale >= 1.0)
+    {
+        return texelFetch(lightAccumTex, pixel, 0).rgb;
+    }
+    vec2 size = vec2(textureSize(depthTex, 0));
+    vec3 P = worldPosition(pixel, depth, size);
+    vec3 N = octDecode(texelFetch(normalMaterialTex, pixel, 0).xy);
+    // the plane distance that counts as a different surface grows with distance from the eye like depth precision
+    float tolerance = 0.02 * distance(P, camPos);
+    vec2 lowPos = (vec2(pixel) + 0.5) * lightingScale - 0.5;
+    ivec2 base = ivec2(floor(lowPos));
+    vec2 f = lowPos - vec2(base);
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    vec3 nearest = vec3(0.0);
+    float nearestDistance = 1e30;
+    for(int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 low = clamp(base + offset, ivec2(0), lightingSize - 1);
+        // the G-buffer pixel the light pass shaded for this sample, as chosen in DeferredLightFragment.glsl
+        ivec2 source = min(ivec2((vec2(low) + 0.5) / lightingScale), ivec2(size) - 1);
+        float sourceDepth = texelFetch(depthTex, source, 0).r;
+        if(sourceDepth >= 1.0)
+        {
+            continue;
+        }
+        vec3 lighting = texelFetch(lightAccumTex, low, 0).rgb;
+        vec3 sourceN = octDecode(texelFetch(normalMaterialTex, source, 0).xy);
+        float planeDistance = abs(dot(N, worldPosition(source, sourceDepth, size) - P)) / tolerance;
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y * exp(-planeDistance * planeDistance) * pow(max(dot(N, sourceN), 0.0), 8.0);
+        sum += lighting * weight;
+        weightSum += weight;
+        if(planeDistance < nearestDistance)
+        {
+            nearestDistance = planeDistance;
+            nearest = lighting;
+        }
+    }
+    // on a thin feature no sample may be on this surface, the closest one is better than nothing
+    return weightSum > 1e-4 ? sum / weightSum : nearest;
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(depthTex, pixel, 0).r;
+    if(depth >= 1.0)
+    {
+        discard;
+    }
+    vec4 albedoAO = texelFetch(albedoAOTex, pixel, 0);
+    vec3 ambient = vec3(0.03) * albedoAO.rgb * albedoAO.a;
+    vec3 colour = ambient + upsampleLighting(pixel, depth);
+
+    // HDR tonemapping
+    colour = colour / (colour + vec3(1.0));
+    // gamma correct
+    colour = pow(colour, vec3(1.0/2.2));
+
+    fragColour = vec4(colour, 1.0);
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,6 @@
+#version 430 core
+// depth pre-pass, colour writes are masked off so only the depth of the nearest surface is laid down and the
+// shading pass that follows runs once per visible fragment
+void main()
+{
+}
@@ -0,0 +1,32 @@
+#version 430 core
+// geometry pass of the deferred path, writes the material and normal for DeferredLightFragment.glsl
+layout (location = 0) out vec4 albedoAO;
+layout (location = 1) out vec4 normalMaterial;
+
+in vec3 WorldPos;
+in vec3 Normal;
+
+// material parameters
+uniform vec3 albedo;
+uniform float metallic;
+uniform float roughness;
+uniform float ao;
+
+// ----------------------------------------------------------------------------
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+// ----------------------------------------------------------------------------
+// octahedral normal encoding so the normal only needs two channels
+vec2 octEncode(vec3 n)
+{
+    n /= (abs(n.x) + abs(n.y) + abs(n.z));
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    albedoAO = vec4(albedo, ao);
+    normalMaterial = vec4(octEncode(normalize(Normal)), metallic, roughness);
+}
@@ -0,0 +1,72 @@
+#version 430 core
+// animates every light in place on the GPU. Each light orbits its rest position and flickers, the orbit and
+// flicker parameters are hashed from the light index and seed so nothing per light is ever sent from the CPU
+layout (local_size_x = 256) in;
+
+struct Light
+{
+    vec4 position;
+    vec4 colour;
+};
+
+layout (std430, binding = 0) writeonly buffer LightBlock
+{
+    Light lights[];
+};
+
+// the lights as created on the CPU, copied GPU side whenever they change
+layout (std430, binding = 3) readonly buffer RestBlock
+{
+    Light rest[];
+};
+
+uniform int numLights;
+uniform int seed;
+uniform float time;
+uniform float maxOrbit;
+
+const float TWO_PI = 6.28318530718;
+// ----------------------------------------------------------------------------
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+// ----------------------------------------------------------------------------
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state) / 4294967295.0;
+}
+// ----------------------------------------------------------------------------
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= uint(numLights))
+    {
+        return;
+    }
+    uint state = hash(i ^ hash(uint(seed)));
+    Light light = rest[i];
+
+    // a random circular orbit about the rest position, never further than maxOrbit from it
+    float orbitRadius = maxOrbit * (0.25 + 0.75 * random(state));
+    vec3 axis = normalize(vec3(random(state), random(state), random(state)) * 2.0 - 1.0 + vec3(0.0, 0.001, 0.0));
+    float speed = (random(state) * 2.0 - 1.0) * 2.0;
+    float phase = random(state) * TWO_PI;
+    vec3 u = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 v = cross(axis, u);
+    float angle = phase + speed * time;
+    light.position.xyz += orbitRadius * (cos(angle) * u + sin(angle) * v);
+
+    // flicker only ever dims the light so its radius stays valid
+    float flickerRate = 2.0 + 6.0 * random(state);
+    float flickerPhase = random(state) * TWO_PI;
+    light.colour.rgb *= 0.8 + 0.2 * sin(flickerRate * time + flickerPhase);
+
+    lights[i] = light;
+}
@@ -0,0 +1,9 @@
+#version 430 core
+layout (location = 0) out vec4 fragColour;
+
+in vec3 gizmoColour;
+
+void main()
+{
+    fragColour = vec4(gizmoColour, 1.0);
+}
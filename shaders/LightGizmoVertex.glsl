@@ -0,0 +1,39 @@
+#version 430 core
+// light gizmo cubes, one instance per light read straight from the lighting buffer, or per light LightCuller found
+// on screen when CULLED
+layout (location = 0) in vec3 inVert;
+
+struct Light
+{
+    vec4 position;
+    vec4 colour;
+};
+
+layout (std430, binding = 0) readonly buffer LightBlock
+{
+    Light lights[];
+};
+
+#ifdef CULLED
+layout (std430, binding = 9) readonly buffer VisibleGizmos
+{
+    uint visibleGizmos[];
+};
+#endif
+
+// projection * view * mouse transform, the light position is the per instance model translation
+uniform mat4 MVP;
+
+out vec3 gizmoColour;
+
+void main()
+{
+#ifdef CULLED
+    Light light = lights[visibleGizmos[gl_InstanceID]];
+#else
+    Light light = lights[gl_InstanceID];
+#endif
+    // same scale as the old per light colour shader draw so the gizmos don't saturate
+    gizmoColour = light.colour.rgb / 200.0;
+    gl_Position = MVP * vec4(inVert + light.position.xyz, 1.0);
+}
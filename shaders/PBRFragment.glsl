@@ -1,5 +1,10 @@
-#version 330 core
+#version 430 core
 // This code is based on code from here https://learnopengl.com/#!PBR/Lighting
+// built by ShaderCache with CLUSTERED defined for the clustered forward variant and STOCHASTIC for the variant
+// that shades a fixed number of sampled lights per fragment, from the cluster list if both are defined. FAST_BRDF
+// works out the light independent terms once per fragment and approximates the Fresnel power, BRDF_LUT does the
+// same but reads the geometry and Fresnel terms from BRDFLookup's table. SHADOWS multiplies each light by its
+// shadow from ShadowAtlas if it has been given a slot
 layout (location =0) out vec4 fragColour;
 
 in vec2 TexCoords;
@@ -13,9 +18,83 @@ uniform float metallic;
 uniform float roughness;
 uniform float ao;
 
-// lights
-uniform vec3 lightPositions[@numLights];
-uniform vec3 lightColours[@numLights];
+// lights, std430 layout must match the Light struct in LightBuffer.h
+struct Light
+{
+    vec4 position;
+    vec4 colour;
+};
+
+layout (std430, binding = 0) readonly buffer LightBlock
+{
+    Light lights[];
+};
+uniform int numLights;
+
+#ifdef CULLED
+// the lights LightCuller found can reach a visible object, numLights is then how many there are
+layout (std430, binding = 8) readonly buffer VisibleLights
+{
+    uint visibleLights[];
+};
+#endif
+
+// clustered forward lists built by LightClusters, one offset / count pair per cluster
+layout (std430, binding = 1) readonly buffer ClusterGrid
+{
+    uvec2 clusterRanges[];
+};
+layout (std430, binding = 2) readonly buffer ClusterIndices
+{
+    uint clusterLights[];
+};
+uniform ivec3 clusterDims;
+uniform float clusterTileSize;
+uniform float clusterNear;
+uniform float clusterSliceScale;
+
+#ifdef STOCHASTIC
+// alias table over light power built by StochasticLights, pdf is the chance of picking the entry's own light
+struct AliasEntry
+{
+    float threshold;
+    uint alias;
+    float pdf;
+    float pad;
+};
+layout (std430, binding = 5) readonly buffer AliasTable
+{
+    AliasEntry aliasTable[];
+};
+uniform int stochasticSamples;
+uniform int stochasticCandidates;
+uniform int frameIndex;
+#endif
+
+#ifdef BRDF_LUT
+// x is a cosine, y the roughness, r the Schlick-GGX geometry term and g (1 - cosine)^5
+uniform sampler2D brdfLUT;
+#endif
+
+#ifdef SHADOWS
+// cube views of the lights ShadowAtlas has given a slot, must match ShadowAtlas::GPUSlot. rect is the origin of the
+// slot's 3 x 2 block of faces and the size of one face, as fractions of the atlas
+struct ShadowSlot
+{
+    mat4 faces[6];
+    vec4 rect;
+};
+layout (std430, binding = 6) readonly buffer ShadowSlots
+{
+    ShadowSlot shadowSlots[];
+};
+// the slot of each light, -1 for none
+layout (std430, binding = 7) readonly buffer LightShadows
+{
+    int lightShadows[];
+};
+uniform sampler2DShadow shadowAtlas;
+#endif
 
 uniform vec3 camPos;
 uniform float exposure;
@@ -62,54 +141,277 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
     return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 // ----------------------------------------------------------------------------
-void main()
-{		
-    vec3 N = normalize(Normal);
-    vec3 V = normalize(camPos - WorldPos);
-    vec3 R = reflect(-V, N); 
-
+uvec2 clusterRange()
+{
+    // gl_FragCoord.w is 1 / clip w which is the view space depth for a perspective projection
+    float viewDepth = 1.0 / gl_FragCoord.w;
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), int(log(viewDepth / clusterNear) * clusterSliceScale));
+    cluster = clamp(cluster, ivec3(0), clusterDims - 1);
+    return clusterRanges[(cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x];
+}
+// ----------------------------------------------------------------------------
+// what shadeLight needs to know about the fragment, the fast variants also keep the terms that don't depend on the
+// light here so the loop doesn't repeat them
+struct Surface
+{
+    vec3 N;
+    vec3 V;
+    vec3 F0;
+#if defined(FAST_BRDF) || defined(BRDF_LUT)
+    // albedo / PI scaled by the inverse metalness, times 1 - F gives the diffuse term
+    vec3 diffuse;
+    float NdotV;
+    float a2;
+    float k;
+    float geometryV;
+#endif
+};
+// ----------------------------------------------------------------------------
+Surface makeSurface()
+{
+    Surface surface;
+    surface.N = normalize(Normal);
+    surface.V = normalize(camPos - WorldPos);
     // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
     // of 0.04 and if it's a metal, use their albedo colour as F0 (metallic workflow)
-    vec3 F0 = vec3(0.04); 
-    F0 = mix(F0, albedo, metallic);
+    surface.F0 = mix(vec3(0.04), albedo, metallic);
+#if defined(FAST_BRDF) || defined(BRDF_LUT)
+    surface.diffuse = albedo * ((1.0 - metallic) / PI);
+    surface.NdotV = max(dot(surface.N, surface.V), 0.0);
+    float a = roughness * roughness;
+    surface.a2 = a * a;
+    float r = roughness + 1.0;
+    surface.k = r * r / 8.0;
+#ifdef BRDF_LUT
+    surface.geometryV = texture(brdfLUT, vec2(surface.NdotV, roughness)).r;
+#else
+    surface.geometryV = surface.NdotV / (surface.NdotV * (1.0 - surface.k) + surface.k);
+#endif
+#endif
+    return surface;
+}
+#if defined(FAST_BRDF) || defined(BRDF_LUT)
+// ----------------------------------------------------------------------------
+// the same Cook-Torrance BRDF as the reference below with one inverse square root for the light direction and
+// distance, and an early out for lights behind the surface or out of range which contribute nothing anyway
+vec3 shadeLight(Light light, Surface surface)
+{
+    vec3 toLight = light.position.xyz - WorldPos;
+    float distanceSq = dot(toLight, toLight);
+    float invDistance = inversesqrt(distanceSq);
+    vec3 L = toLight * invDistance;
+    float NdotL = dot(surface.N, L);
+    // ratio^4 is (distance^2 / radius^2)^2
+    float ratioSq = distanceSq / (light.position.w * light.position.w);
+    float window = clamp(1.0 - ratioSq * ratioSq, 0.0, 1.0);
+    if (NdotL <= 0.0 || window <= 0.0)
+    {
+        return vec3(0.0);
+    }
+    vec3 H = normalize(surface.V + L);
+    float NdotH = max(dot(surface.N, H), 0.0);
+    float HdotV = max(dot(H, surface.V), 0.0);
+    float denom = NdotH * NdotH * (surface.a2 - 1.0) + 1.0;
+    float NDF = surface.a2 / (PI * denom * denom);
+#ifdef BRDF_LUT
+    float geometryL = texture(brdfLUT, vec2(NdotL, roughness)).r;
+    float fresnel = texture(brdfLUT, vec2(HdotV, roughness)).g;
+#else
+    float geometryL = NdotL / (NdotL * (1.0 - surface.k) + surface.k);
+    // spherical gaussian approximation of (1 - HdotV)^5
+    float fresnel = exp2((-5.55473 * HdotV - 6.98316) * HdotV);
+#endif
+    vec3 F = surface.F0 + (1.0 - surface.F0) * fresnel;
+    vec3 brdf = F * (NDF * geometryL * surface.geometryV / (4.0 * surface.NdotV * NdotL + 0.001));
+    vec3 radiance = light.colour.rgb * (window * window / distanceSq);
+    return ((1.0 - F) * surface.diffuse + brdf) * radiance * NdotL;
+}
+#else
+// ----------------------------------------------------------------------------
+vec3 shadeLight(Light light, Surface surface)
+{
+    vec3 N = surface.N;
+    vec3 V = surface.V;
+    vec3 F0 = surface.F0;
+    // calculate per-light radiance
+    vec3 L = normalize(light.position.xyz - WorldPos);
+    vec3 H = normalize(V + L);
+    float distance = length(light.position.xyz - WorldPos);
+    // inverse square falloff windowed to reach zero at the light radius (position.w)
+    float ratio = distance / light.position.w;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    float attenuation = window * window / (distance * distance);
+    vec3 radiance = light.colour.rgb * attenuation;
+
+    // Cook-Torrance BRDF
+    float NDF = DistributionGGX(N, H, roughness);   
+    float G   = GeometrySmith(N, V, L, roughness);      
+    vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
+       
+    vec3 nominator    = NDF * G * F; 
+    float denominator = 4 * max(dot(V, N), 0.0) * max(dot(L, N), 0.0) + 0.001; // 0.001 to prevent divide by zero.
+    vec3 brdf = nominator / denominator;
+    
+    // kS is equal to Fresnel
+    vec3 kS = F;
+    // for energy conservation, the diffuse and specular light can't
+    // be above 1.0 (unless the surface emits light); to preserve this
+    // relationship the diffuse component (kD) should equal 1.0 - kS.
+    vec3 kD = vec3(1.0) - kS;
+    // multiply kD by the inverse metalness such that only non-metals 
+    // have diffuse lighting, or a linear blend if partly metal (pure metals
+    // have no diffuse light).
+    kD *= 1.0 - metallic;	  
+
+    // scale light by NdotL
+    float NdotL = max(dot(N, L), 0.0);        
+
+    // outgoing radiance from this light
+    return (kD * albedo / PI + brdf) * radiance * NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+}
+#endif
+#ifdef SHADOWS
+// ----------------------------------------------------------------------------
+// the fraction of the light that reaches the fragment. The face is the one whose axis the direction from the light
+// is largest along, and the lookup stays half a texel inside it so the filter never reads the next face
+float shadow(uint index)
+{
+    int slot = lightShadows[index];
+    if (slot < 0)
+    {
+        return 1.0;
+    }
+    vec3 fromLight = WorldPos - lights[index].position.xyz;
+    vec3 a = abs(fromLight);
+    int face = a.x >= a.y && a.x >= a.z ? (fromLight.x >= 0.0 ? 0 : 1) : (a.y >= a.z ? (fromLight.y >= 0.0 ? 2 : 3) : (fromLight.z >= 0.0 ? 4 : 5));
+    vec4 clip = shadowSlots[slot].faces[face] * vec4(WorldPos, 1.0);
+    vec3 ndc = clip.xyz / clip.w * 0.5 + 0.5;
+    vec4 rect = shadowSlots[slot].rect;
+    vec2 halfTexel = 0.5 / (rect.zw * vec2(textureSize(shadowAtlas, 0)));
+    vec2 uv = rect.xy + (vec2(face % 3, face / 3) + clamp(ndc.xy, halfTexel, 1.0 - halfTexel)) * rect.zw;
+    return texture(shadowAtlas, vec3(uv, ndc.z));
+}
+#endif
+// ----------------------------------------------------------------------------
+vec3 shadeIndexed(uint index, Surface surface)
+{
+    vec3 Lo = shadeLight(lights[index], surface);
+#ifdef SHADOWS
+    // the lookup is only worth it where the light reaches
+    if (Lo != vec3(0.0))
+    {
+        Lo *= shadow(index);
+    }
+#endif
+    return Lo;
+}
+#ifdef STOCHASTIC
+// ----------------------------------------------------------------------------
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+// ----------------------------------------------------------------------------
+float random(inout uint state)
+{
+    state = hash(state);
+    // 24 bits so the result is always below 1
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+// ----------------------------------------------------------------------------
+// a cheap estimate of a light's contribution, its power through the falloff and the cosine term without the BRDF
+float targetWeight(Light light, vec3 N)
+{
+    vec3 toLight = light.position.xyz - WorldPos;
+    float distance = length(toLight);
+    float ratio = distance / light.position.w;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    float NdotL = max(dot(N, toLight / distance), 0.0);
+    return dot(light.colour.rgb, vec3(0.2126, 0.7152, 0.0722)) * window * window / (distance * distance) * NdotL;
+}
+// ----------------------------------------------------------------------------
+// resampled importance sampling: each sample streams stochasticCandidates lights through a one entry weighted
+// reservoir, the candidates are drawn by power (or uniformly from the cluster list) and the survivor is picked in
+// proportion to targetWeight. Only the survivor is fully shaded so the cost per fragment is fixed
+vec3 sampleLights(Surface surface)
+{
+#ifdef CLUSTERED
+    uvec2 range = clusterRange();
+    uint count = range.y;
+#else
+    uint count = uint(numLights);
+#endif
+    if (count == 0u)
+    {
+        return vec3(0.0);
+    }
+    uint state = hash(uint(gl_FragCoord.x) + hash(uint(gl_FragCoord.y) + hash(uint(frameIndex))));
+    vec3 Lo = vec3(0.0);
+    for (int s = 0; s < stochasticSamples; ++s)
+    {
+        uint chosen = 0u;
+        float chosenTarget = 0.0;
+        float weightSum = 0.0;
+        for (int c = 0; c < stochasticCandidates; ++c)
+        {
+#ifdef CLUSTERED
+            uint index = clusterLights[range.x + min(uint(random(state) * float(count)), count - 1u)];
+            float pdf = 1.0 / float(count);
+#else
+            // alias method, a uniform slot then either its own light or its alias
+            uint slot = min(uint(random(state) * float(count)), count - 1u);
+            uint index = random(state) < aliasTable[slot].threshold ? slot : aliasTable[slot].alias;
+            float pdf = aliasTable[index].pdf;
+#endif
+            float target = targetWeight(lights[index], surface.N);
+            float weight = target / pdf;
+            weightSum += weight;
+            if (weight > 0.0 && random(state) * weightSum < weight)
+            {
+                chosen = index;
+                chosenTarget = target;
+            }
+        }
+        if (chosenTarget > 0.0)
+        {
+            Lo += shadeIndexed(chosen, surface) * (weightSum / (float(stochasticCandidates) * chosenTarget));
+        }
+    }
+    return Lo / float(stochasticSamples);
+}
+#endif
+// ----------------------------------------------------------------------------
+void main()
+{		
+    Surface surface = makeSurface();
 
     // reflectance equation
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < @numLights; ++i)
+#if defined(STOCHASTIC)
+    Lo = sampleLights(surface);
+#elif defined(CLUSTERED)
     {
-        // calculate per-light radiance
-        vec3 L = normalize(lightPositions[i] - WorldPos);
-        vec3 H = normalize(V + L);
-        float distance = length(lightPositions[i] - WorldPos);
-        float attenuation = 1.0 / (distance * distance);
-        vec3 radiance = lightColours[i] * attenuation;
-
-        // Cook-Torrance BRDF
-        float NDF = DistributionGGX(N, H, roughness);   
-        float G   = GeometrySmith(N, V, L, roughness);      
-        vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
-           
-        vec3 nominator    = NDF * G * F; 
-        float denominator = 4 * max(dot(V, N), 0.0) * max(dot(L, N), 0.0) + 0.001; // 0.001 to prevent divide by zero.
-        vec3 brdf = nominator / denominator;
-        
-        // kS is equal to Fresnel
-        vec3 kS = F;
-        // for energy conservation, the diffuse and specular light can't
-        // be above 1.0 (unless the surface emits light); to preserve this
-        // relationship the diffuse component (kD) should equal 1.0 - kS.
-        vec3 kD = vec3(1.0) - kS;
-        // multiply kD by the inverse metalness such that only non-metals 
-        // have diffuse lighting, or a linear blend if partly metal (pure metals
-        // have no diffuse light).
-        kD *= 1.0 - metallic;	  
-
-        // scale light by NdotL
-        float NdotL = max(dot(N, L), 0.0);        
-
-        // add to outgoing radiance Lo
-        Lo += (kD * albedo / PI + brdf) * radiance * NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
-    }   
+        uvec2 range = clusterRange();
+        for(uint i = range.x; i < range.x + range.y; ++i)
+        {
+            Lo += shadeIndexed(clusterLights[i], surface);
+        }
+    }
+#else
+    for(int i = 0; i < numLights; ++i)
+    {
+#ifdef CULLED
+        Lo += shadeIndexed(visibleLights[i], surface);
+#else
+        Lo += shadeIndexed(uint(i), surface);
+#endif
+    }
+#endif
     
     // ambient lighting (note that the next IBL tutorial will replace 
     // this ambient lighting with environment lighting).
@@ -117,10 +419,15 @@ void main()
 
     vec3 colour = ambient + Lo;
 
+#ifdef STOCHASTIC
+    // left linear, StochasticLights accumulates it over frames then tonemaps
+    fragColour = vec4(colour, 1.0);
+#else
     // HDR tonemapping
     colour = colour / (colour + vec3(1.0));
     // gamma correct
     colour = pow(colour, vec3(1.0/2.2));
 
     fragColour = vec4(colour, 1.0);
+#endif
 }
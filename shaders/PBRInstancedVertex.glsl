@@ -0,0 +1,38 @@
+#version 430 core
+// PBRVertex.glsl for instanced objects, the camera comes from a block set once per frame and the model matrix
+// from a buffer indexed by instance, so a draw needs no per object uniforms at all
+layout (location = 0) in vec3 inVert;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+
+out vec2 TexCoords;
+out vec3 WorldPos;
+out vec3 Normal;
+// the depth pre-pass runs this shader in a different program, GL_EQUAL needs the same depth from both
+invariant gl_Position;
+
+// must match InstancedScene::CameraBlock
+layout (std140, binding = 0) uniform Camera
+{
+  mat4 view;
+  mat4 project;
+  // the mouse rotation, applied to the whole scene
+  mat4 scene;
+};
+
+layout (std430, binding = 4) readonly buffer InstanceBlock
+{
+  mat4 models[];
+};
+
+void main()
+{
+  mat4 M = scene * models[gl_InstanceID];
+  vec4 world = M * vec4(inVert, 1.0);
+  WorldPos = world.xyz;
+  // the inverse transpose keeps normals at right angles to the surface under non uniform scale, in world space
+  // to match WorldPos and the lights
+  Normal = transpose(inverse(mat3(M))) * inNormal;
+  TexCoords = inUV;
+  gl_Position = project * view * world;
+}
@@ -10,6 +10,8 @@ layout (location = 2) in vec2 inUV;
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+// the depth pre-pass runs this shader in a different program, GL_EQUAL needs the same depth from both
+invariant gl_Position;
 
 uniform mat4 MVP;
 uniform mat3 normalMatrix;
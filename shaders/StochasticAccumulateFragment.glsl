@@ -0,0 +1,38 @@
+#version 430 core
+// blends this frame's stochastic lighting into the history. With the view still the blend is 1 / frames so the
+// result converges on the exact sum, once anything moves the history is clipped to the spread of the current
+// frame around each pixel so moving edges don't leave trails
+layout (location = 0) out vec4 fragColour;
+
+uniform sampler2D currentTex;
+uniform sampler2D historyTex;
+// weight of the current frame
+uniform float blend;
+// standard deviations of the neighbourhood the history may sit outside, 0 to not clip
+uniform float historyClip;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 current = texelFetch(currentTex, pixel, 0).rgb;
+    vec3 history = texelFetch(historyTex, pixel, 0).rgb;
+    if(historyClip > 0.0)
+    {
+        ivec2 last = textureSize(currentTex, 0) - 1;
+        vec3 mean = vec3(0.0);
+        vec3 meanSq = vec3(0.0);
+        for(int y = -1; y <= 1; ++y)
+        {
+            for(int x = -1; x <= 1; ++x)
+            {
+                vec3 c = texelFetch(currentTex, clamp(pixel + ivec2(x, y), ivec2(0), last), 0).rgb;
+                mean += c;
+                meanSq += c * c;
+            }
+        }
+        mean /= 9.0;
+        vec3 spread = sqrt(max(meanSq / 9.0 - mean * mean, vec3(0.0))) * historyClip;
+        history = clamp(history, mean - spread, mean + spread);
+    }
+    fragColour = vec4(mix(history, current, blend), 1.0);
+}
@@ -0,0 +1,26 @@
+#version 430 core
+// tonemaps and gamma corrects the accumulated stochastic lighting as PBRFragment.glsl does for the exact path.
+// The scene depth is written out so the light gizmos still depth test against the objects
+layout (location = 0) out vec4 fragColour;
+
+uniform sampler2D historyTex;
+uniform sampler2D depthTex;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(depthTex, pixel, 0).r;
+    if(depth >= 1.0)
+    {
+        discard;
+    }
+    vec3 colour = texelFetch(historyTex, pixel, 0).rgb;
+
+    // HDR tonemapping
+    colour = colour / (colour + vec3(1.0));
+    // gamma correct
+    colour = pow(colour, vec3(1.0/2.2));
+
+    fragColour = vec4(colour, 1.0);
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,59 @@
+#include "BRDFLookup.h"
+#include <cmath>
+#include <vector>
+
+std::optional<BRDFMode> brdfModeFromName(std::string_view _name)
+{
+  for (size_t i = 0; i < BRDFModeNames.size(); ++i)
+  {
+    if (BRDFModeNames[i] == _name)
+    {
+      return static_cast<BRDFMode>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+BRDFLookup::~BRDFLookup()
+{
+  if (m_textureID != 0)
+  {
+    glDeleteTextures(1, &m_textureID);
+  }
+}
+
+void BRDFLookup::create()
+{
+  std::vector<float> table(Size * Size * 2);
+  for (int y = 0; y < Size; ++y)
+  {
+    // each texel holds the value at its centre, where linear filtering puts it
+    float roughness = (y + 0.5f) / Size;
+    float r = roughness + 1.0f;
+    float k = r * r / 8.0f;
+    for (int x = 0; x < Size; ++x)
+    {
+      float cosine = (x + 0.5f) / Size;
+      auto *texel = &table[(y * Size + x) * 2];
+      // must match GeometrySchlickGGX and fresnelSchlick in PBRFragment.glsl
+      texel[0] = cosine / (cosine * (1.0f - k) + k);
+      texel[1] = std::pow(1.0f - cosine, 5.0f);
+    }
+  }
+  glGenTextures(1, &m_textureID);
+  glBindTexture(GL_TEXTURE_2D, m_textureID);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, Size, Size);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Size, Size, GL_RG, GL_FLOAT, table.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void BRDFLookup::bind(GLuint _unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + _unit);
+  glBindTexture(GL_TEXTURE_2D, m_textureID);
+  glActiveTexture(GL_TEXTURE0);
+}
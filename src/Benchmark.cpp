@@ -0,0 +1,1036 @@
+#include "Benchmark.h"
+#include "NGLScene.h"
+#include "LightGenerator.h"
+#include "LightFile.h"
+#include "CPURenderer.h"
+#include "LightCuller.h"
+#include <ngl/NGLInit.h>
+#include <ngl/Random.h>
+#include <ngl/Util.h>
+#include <ngl/VAOPrimitives.h>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QImage>
+#include <QDir>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <random>
+
+namespace
+{
+struct Summary
+{
+  float mean = 0.0f;
+  float min = 0.0f;
+  float p50 = 0.0f;
+  float p99 = 0.0f;
+  float max = 0.0f;
+};
+
+Summary summarise(std::vector<float> _samples)
+{
+  Summary s;
+  if (_samples.empty())
+  {
+    return s;
+  }
+  std::sort(_samples.begin(), _samples.end());
+  // nearest rank percentiles
+  auto rank = [&_samples](float _p)
+  {
+    auto index = static_cast<size_t>(std::ceil(_p * _samples.size())) - 1;
+    return _samples[std::min(index, _samples.size() - 1)];
+  };
+  s.mean = std::accumulate(_samples.begin(), _samples.end(), 0.0f) / _samples.size();
+  s.min = _samples.front();
+  s.p50 = rank(0.5f);
+  s.p99 = rank(0.99f);
+  s.max = _samples.back();
+  return s;
+}
+
+std::string toJSON(const Summary &_s)
+{
+  return fmt::format("{{\"mean\": {0:.4f}, \"min\": {1:.4f}, \"p50\": {2:.4f}, \"p99\": {3:.4f}, \"max\": {4:.4f}}}",
+                     _s.mean, _s.min, _s.p50, _s.p99, _s.max);
+}
+
+std::string escapeJSON(const std::string &_s)
+{
+  std::string out;
+  for (auto c : _s)
+  {
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out;
+}
+// NGLScene clears to 0.4 grey
+constexpr unsigned char BackgroundByte = 102;
+
+struct ImageError
+{
+  double rmse = 0.0;
+  double max = 0.0;
+};
+
+// only the pixels the objects cover, the background and gizmos match exactly and would dilute the error
+ImageError compareImages(const std::vector<unsigned char> &_reference, const std::vector<unsigned char> &_image)
+{
+  ImageError error;
+  double sumSq = 0.0;
+  size_t count = 0;
+  for (size_t p = 0; p < _reference.size(); p += 4)
+  {
+    if (_reference[p] == BackgroundByte && _reference[p + 1] == BackgroundByte && _reference[p + 2] == BackgroundByte)
+    {
+      continue;
+    }
+    for (size_t c = 0; c < 3; ++c)
+    {
+      double d = (_image[p + c] - _reference[p + c]) / 255.0;
+      sumSq += d * d;
+      error.max = std::max(error.max, std::abs(d));
+    }
+    ++count;
+  }
+  error.rmse = count > 0 ? std::sqrt(sumSq / (count * 3)) : 0.0;
+  return error;
+}
+
+// the positions and normals of a VAOPrimitives mesh as a triangle list, read back from wherever its VAO points
+// attributes 0 and 1 so we don't depend on how NGL interleaves them. Empty if it isn't an unindexed triangle list
+std::vector<CPURenderer::Vertex> readMesh(std::string_view _name)
+{
+  std::vector<CPURenderer::Vertex> mesh;
+  auto vao = ngl::VAOPrimitives::getVAOFromName(_name);
+  if (vao == nullptr || vao->getMode() != GL_TRIANGLES)
+  {
+    return mesh;
+  }
+  struct Attribute
+  {
+    GLint buffer = 0;
+    GLint stride = 0;
+    void *offset = nullptr;
+  };
+  Attribute attributes[2];
+  GLint elements = 0;
+  vao->bind();
+  glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elements);
+  for (GLuint i = 0; i < 2; ++i)
+  {
+    glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &attributes[i].buffer);
+    glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_STRIDE, &attributes[i].stride);
+    glGetVertexAttribPointerv(i, GL_VERTEX_ATTRIB_ARRAY_POINTER, &attributes[i].offset);
+  }
+  vao->unbind();
+  if (elements != 0 || attributes[0].buffer == 0 || attributes[1].buffer == 0)
+  {
+    return mesh;
+  }
+  mesh.resize(vao->numIndices());
+  std::vector<unsigned char> data;
+  for (GLuint i = 0; i < 2; ++i)
+  {
+    // a stride of 0 means tightly packed
+    size_t stride = attributes[i].stride != 0 ? static_cast<size_t>(attributes[i].stride) : 3 * sizeof(float);
+    data.resize((mesh.size() - 1) * stride + 3 * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(attributes[i].buffer));
+    glGetBufferSubData(GL_ARRAY_BUFFER, reinterpret_cast<GLintptr>(attributes[i].offset), static_cast<GLsizeiptr>(data.size()), data.data());
+    for (size_t v = 0; v < mesh.size(); ++v)
+    {
+      float value[3];
+      std::memcpy(value, &data[v * stride], sizeof(value));
+      (i == 0 ? mesh[v].position : mesh[v].normal).set(value[0], value[1], value[2]);
+    }
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  return mesh;
+}
+} // end anon namespace
+
+Benchmark::Benchmark(const QSurfaceFormat &_format, const Options &_options) : m_format(_format), m_options(_options)
+{
+}
+
+Benchmark::~Benchmark()
+{
+  if (m_context)
+  {
+    // the scene releases its GL objects in its dtor so our context must be current
+    m_context->makeCurrent(m_surface.get());
+    m_scene.reset();
+    if (m_fbo != 0)
+    {
+      glDeleteFramebuffers(1, &m_fbo);
+      glDeleteRenderbuffers(1, &m_colour);
+      glDeleteRenderbuffers(1, &m_depth);
+    }
+    m_context->doneCurrent();
+  }
+}
+
+bool Benchmark::createContext()
+{
+  // we render to our own single sample FBO and never swap
+  m_format.setSamples(0);
+  m_format.setSwapInterval(0);
+  m_surface = std::make_unique<QOffscreenSurface>();
+  m_surface->setFormat(m_format);
+  m_surface->create();
+  if (!m_surface->isValid())
+  {
+    std::cerr << "unable to create offscreen surface\n";
+    return false;
+  }
+  m_context = std::make_unique<QOpenGLContext>();
+  m_context->setFormat(m_format);
+  if (!m_context->create() || !m_context->makeCurrent(m_surface.get()))
+  {
+    std::cerr << "unable to create OpenGL " << m_format.majorVersion() << "." << m_format.minorVersion() << " context\n";
+    return false;
+  }
+  return true;
+}
+
+void Benchmark::createFramebuffer()
+{
+  glGenRenderbuffers(1, &m_colour);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_colour);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_options.width, m_options.height);
+  glGenRenderbuffers(1, &m_depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_options.width, m_options.height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colour);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+}
+
+void Benchmark::renderFrame(int _frame, GLuint _startQuery, GLuint _endQuery)
+{
+  // a slow orbit around the teapot, the same for every run with the same frame count. The lights step at a fixed
+  // 60Hz so the animated light set only depends on the seed and frame number
+  int spinY = (_frame * 360) / std::max(m_options.frames, 1);
+  m_scene->setPose(15, spinY, static_cast<ngl::Real>(_frame), _frame / 60.0f);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, m_options.width, m_options.height);
+  // timestamps rather than GL_TIME_ELAPSED as the deferred renderer times its own passes with that
+  glQueryCounter(_startQuery, GL_TIMESTAMP);
+  m_scene->paintGL();
+  glQueryCounter(_endQuery, GL_TIMESTAMP);
+}
+
+bool Benchmark::createScene()
+{
+  m_scene = std::make_unique<NGLScene>();
+  m_scene->setNumLights(m_options.numLights);
+  m_scene->setSeed(m_options.seed);
+  m_scene->setDeferred(m_options.deferred);
+  m_scene->setClustered(m_options.clustered);
+  m_scene->setShowLights(m_options.showLights);
+  m_scene->setAnimateLights(m_options.animate);
+  m_scene->setLightFile(m_options.lightFile);
+  m_scene->setNumObjects(m_options.numObjects);
+  m_scene->setStochastic(m_options.stochasticSamples);
+  m_scene->setDepthPrepass(m_options.depthPrepass);
+  m_scene->setLightingScale(m_options.lightingScale);
+  m_scene->setTargetFrameMs(m_options.targetMs);
+  m_scene->setBRDFMode(m_options.brdf);
+  m_scene->setShadows(m_options.shadows);
+  m_scene->setShadowBudget(m_options.shadowBudget);
+  m_scene->setShadowFaceSize(m_options.shadowSize);
+  m_scene->setCullLights(m_options.cullLights);
+  m_scene->setLightCutoff(m_options.lightCutoff);
+  m_scene->setShowHUD(false);
+  m_scene->setShaderCacheDirectory(m_options.shaderCache);
+  m_scene->setClearShaderCache(m_options.clearShaderCache);
+  // the benchmark never switches permutation, a background compile would only add noise
+  m_scene->setPrecompileShaders(false);
+  // initializeGL loads the GL function pointers so the FBO has to wait until after it
+  auto startupStart = std::chrono::steady_clock::now();
+  m_scene->initializeGL();
+  std::chrono::duration<float, std::milli> startup = std::chrono::steady_clock::now() - startupStart;
+  m_startupMs = startup.count();
+  m_scene->resizeGL(m_options.width, m_options.height);
+  createFramebuffer();
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr << "offscreen framebuffer incomplete\n";
+    return false;
+  }
+  m_scene->setRenderTarget(m_fbo);
+  m_renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  return true;
+}
+
+bool Benchmark::run()
+{
+  if (!createContext())
+  {
+    return false;
+  }
+  if (m_options.lightGeneration)
+  {
+    return runLightGeneration();
+  }
+  if (m_options.lightFiles)
+  {
+    return runLightFiles();
+  }
+  if (m_options.lightCulling)
+  {
+    return runLightCulling();
+  }
+  if (!createScene())
+  {
+    return false;
+  }
+  if (m_options.cpuBench)
+  {
+    return runCPUBench();
+  }
+
+  std::vector<GLuint> queries(static_cast<size_t>(m_options.frames) * 2);
+  glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+  GLuint warmupQueries[2];
+  glGenQueries(2, warmupQueries);
+  for (int i = 0; i < m_options.warmup; ++i)
+  {
+    renderFrame(0, warmupQueries[0], warmupQueries[1]);
+  }
+  // a large light file streams in over several frames, the timed frames all see the whole set
+  while (m_scene->streamingLights())
+  {
+    renderFrame(0, warmupQueries[0], warmupQueries[1]);
+  }
+  glFinish();
+
+  if (!m_options.trace.empty())
+  {
+    m_scene->profiler().startTrace();
+  }
+  m_cpuMs.resize(m_options.frames);
+  for (int i = 0; i < m_options.frames; ++i)
+  {
+    auto start = std::chrono::steady_clock::now();
+    renderFrame(i, queries[i * 2], queries[i * 2 + 1]);
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    m_cpuMs[i] = elapsed.count();
+    if (m_scene->shadowed())
+    {
+      auto &shadows = m_scene->shadowAtlas().stats();
+      m_shadowedLights.push_back(static_cast<float>(shadows.shadowedLights));
+      m_shadowRendered.push_back(static_cast<float>(shadows.renderedViews));
+      m_shadowReused.push_back(static_cast<float>(shadows.reusedViews));
+      m_shadowEmpty.push_back(static_cast<float>(shadows.emptyViews));
+      m_shadowStale.push_back(static_cast<float>(shadows.staleLights));
+      m_shadowUpdateMs.push_back(shadows.updateMs);
+    }
+    if (m_scene->cullingLights())
+    {
+      auto &culling = m_scene->lightCuller().stats();
+      m_culledLights.push_back(static_cast<float>(culling.visibleLights));
+      m_culledGizmos.push_back(static_cast<float>(culling.visibleGizmos));
+      m_cullMs.push_back(culling.cullMs);
+    }
+  }
+  glFinish();
+
+  m_gpuMs.resize(m_options.frames);
+  for (int i = 0; i < m_options.frames; ++i)
+  {
+    GLuint64 start;
+    GLuint64 end;
+    glGetQueryObjectui64v(queries[i * 2], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+    m_gpuMs[i] = (end - start) / 1.0e6f;
+  }
+  glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+
+  // the GPU is idle so cycling the profiler's frames collects every outstanding query
+  for (size_t i = 0; i < Profiler::FramesInFlight; ++i)
+  {
+    m_scene->profiler().beginFrame();
+  }
+  m_passes = passTimings();
+  m_lightingScale = m_scene->lightingScale();
+  bool ok = true;
+  if (!m_options.trace.empty())
+  {
+    ok &= m_scene->profiler().stopTrace(m_options.trace);
+  }
+  // after the timings and trace are taken as they render extra frames
+  if (m_options.brdf != BRDFMode::Reference && !m_options.deferred)
+  {
+    ok &= measureBRDFError(warmupQueries);
+  }
+  if (m_options.deferred)
+  {
+    ok &= measureDeferredError(warmupQueries);
+  }
+  if (m_options.stochasticSamples > 0 && !m_options.deferred)
+  {
+    measureStochasticError(warmupQueries);
+  }
+  if (m_options.cpuReference)
+  {
+    ok &= measureCPUReference(warmupQueries);
+  }
+  glDeleteQueries(2, warmupQueries);
+
+  ok &= writeResults();
+  if (!m_options.png.empty())
+  {
+    ok &= savePNG(m_options.png, readFrame());
+  }
+  return ok;
+}
+
+std::string Benchmark::passTimings() const
+{
+  // GPU time of the passes whose cost depends on how many fragments are shaded
+  auto &profiler = m_scene->profiler();
+  std::string results;
+  for (auto name : {"shadows", "depthPrepass", m_options.numObjects > 1 ? "objects" : "teapot"})
+  {
+    auto stats = profiler.stats(name);
+    results += fmt::format("{0}\"{1}\": {{\"gpu_avg_ms\": {2:.4f}, \"gpu_p99_ms\": {3:.4f}}}", results.empty() ? "" : ", ", name, stats.gpuAvg, stats.gpuP99);
+  }
+  return "{" + results + "}";
+}
+
+bool Benchmark::writeResults() const
+{
+  std::string text;
+  bool csv = m_options.output.size() > 4 && m_options.output.compare(m_options.output.size() - 4, 4, ".csv") == 0;
+  if (csv)
+  {
+    text = "frame,cpu_ms,gpu_ms\n";
+    for (size_t i = 0; i < m_cpuMs.size(); ++i)
+    {
+      text += fmt::format("{0},{1:.4f},{2:.4f}\n", i, m_cpuMs[i], m_gpuMs[i]);
+    }
+  }
+  else
+  {
+    auto shaders = m_scene->shaderCache().stats();
+    auto shaderStats = fmt::format("{{\"memory\": {0}, \"disk\": {1}, \"compiled\": {2}, \"load_ms\": {3:.2f}}}",
+                                   shaders.memoryHits, shaders.diskHits, shaders.compiles, shaders.loadMs);
+    auto &state = m_scene->shaderState().lastFrame();
+    auto glState = fmt::format("{{\"program_binds\": {0}, \"program_skips\": {1}, \"uniform_sets\": {2}, \"uniform_skips\": {3}}}",
+                               state.programBinds, state.programSkips, state.uniformSets, state.uniformSkips);
+    std::string mode = m_options.deferred ? "deferred" : (m_options.clustered ? "forward-clustered" : "forward");
+    text = fmt::format("{{\n  \"renderer\": \"{0}\",\n  \"mode\": \"{1}\",\n  \"animated\": {2},\n  \"lights\": {3},\n  \"objects\": {4},\n",
+                       escapeJSON(m_renderer), mode, m_options.animate ? "true" : "false", m_scene->lights().size(), m_options.numObjects);
+    text += fmt::format("  \"stochastic_samples\": {0},\n  \"depth_prepass\": {1},\n  \"brdf\": \"{2}\",\n  \"passes\": {3},\n",
+                        m_options.stochasticSamples, m_options.depthPrepass ? "true" : "false", brdfModeName(m_options.brdf), m_passes);
+    text += fmt::format("  \"target_ms\": {0:.2f},\n  \"lighting_scale\": {1:.3f},\n  \"light_file\": \"{2}\",\n",
+                        m_options.targetMs, m_lightingScale, escapeJSON(m_options.lightFile));
+    text += fmt::format("  \"light_cutoff\": {0:.4g},\n", m_scene->lightCutoff());
+    text += fmt::format("  \"width\": {0},\n  \"height\": {1},\n  \"frames\": {2},\n  \"seed\": {3},\n  \"startup_ms\": {4:.2f},\n",
+                        m_options.width, m_options.height, m_options.frames, m_options.seed, m_startupMs);
+    text += fmt::format("  \"shader_cache\": {0},\n  \"gl_state_last_frame\": {1},\n", shaderStats, glState);
+    // the sections of the modes that ran
+    if (!m_stochasticError.empty())
+    {
+      text += fmt::format("  \"stochastic_error\": {0},\n", m_stochasticError);
+    }
+    if (!m_brdfError.empty())
+    {
+      text += fmt::format("  \"brdf_error\": {0},\n", m_brdfError);
+    }
+    if (!m_deferredError.empty())
+    {
+      text += fmt::format("  \"deferred_error\": {0},\n", m_deferredError);
+    }
+    if (!m_cpuReference.empty())
+    {
+      text += fmt::format("  \"cpu_reference\": {0},\n", m_cpuReference);
+    }
+    // per frame counts summarised like the timings, a view is one face of a light's cube
+    if (!m_shadowRendered.empty())
+    {
+      text += fmt::format("  \"shadows\": {{\"budget\": {0}, \"face_size\": {1}, \"lights\": {2}, \"rendered_views\": {3}, "
+                          "\"reused_views\": {4}, \"empty_views\": {5}, \"stale_lights\": {6}, \"update_ms\": {7}}},\n",
+                          m_scene->shadowAtlas().budget(), m_scene->shadowAtlas().faceSize(), toJSON(summarise(m_shadowedLights)),
+                          toJSON(summarise(m_shadowRendered)), toJSON(summarise(m_shadowReused)), toJSON(summarise(m_shadowEmpty)),
+                          toJSON(summarise(m_shadowStale)), toJSON(summarise(m_shadowUpdateMs)));
+    }
+    // cull_ms is the last cull before each frame, the orbit moves the camera every frame so it is never skipped
+    if (!m_cullMs.empty())
+    {
+      auto &culling = m_scene->lightCuller().stats();
+      text += fmt::format("  \"culling\": {{\"visible_lights\": {0}, \"visible_gizmos\": {1}, \"cull_ms\": {2}, "
+                          "\"build_ms\": {3:.3f}, \"rebuilds\": {4}}},\n",
+                          toJSON(summarise(m_culledLights)), toJSON(summarise(m_culledGizmos)), toJSON(summarise(m_cullMs)),
+                          culling.buildMs, culling.rebuilds);
+    }
+    text += fmt::format("  \"cpu_ms\": {0},\n  \"gpu_ms\": {1},\n  \"samples\": [", toJSON(summarise(m_cpuMs)),
+                        toJSON(summarise(m_gpuMs)));
+    for (size_t i = 0; i < m_cpuMs.size(); ++i)
+    {
+      text += fmt::format("{0}[{1:.4f}, {2:.4f}]", i == 0 ? "" : ", ", m_cpuMs[i], m_gpuMs[i]);
+    }
+    text += "]\n}\n";
+  }
+  return writeText(text);
+}
+
+bool Benchmark::writeText(const std::string &_text) const
+{
+  if (m_options.output.empty())
+  {
+    std::cout << _text;
+    return true;
+  }
+  std::ofstream file(m_options.output);
+  if (!file)
+  {
+    std::cerr << "unable to write " << m_options.output << '\n';
+    return false;
+  }
+  file << _text;
+  return true;
+}
+
+bool Benchmark::runLightGeneration()
+{
+  ngl::NGLInit::initialize();
+  m_renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  constexpr int Iterations = 10;
+  constexpr float Cutoff = 0.25f;
+  LightBuffer buffer;
+  buffer.create(0);
+  std::string results;
+
+  // each method is timed to the end of generation on the CPU and again once the GPU has the lights
+  auto measure = [&](size_t _numLights, const char *_method, auto &&_generate, auto &&_upload)
+  {
+    std::vector<float> generateMs(Iterations);
+    std::vector<float> totalMs(Iterations);
+    for (int i = 0; i < Iterations; ++i)
+    {
+      glFinish();
+      auto start = std::chrono::steady_clock::now();
+      _generate(i);
+      std::chrono::duration<float, std::milli> generated = std::chrono::steady_clock::now() - start;
+      _upload();
+      glFinish();
+      std::chrono::duration<float, std::milli> total = std::chrono::steady_clock::now() - start;
+      generateMs[i] = generated.count();
+      totalMs[i] = total.count();
+    }
+    results += fmt::format("{0}\n    {{\"lights\": {1}, \"method\": \"{2}\", \"generate_ms\": {3}, \"total_ms\": {4}}}",
+                           results.empty() ? "" : ",", _numLights, _method, toJSON(summarise(generateMs)), toJSON(summarise(totalMs)));
+  };
+
+  for (size_t numLights : {size_t(1000), size_t(100000), size_t(1000000)})
+  {
+    // the loop createLights used before LightGenerator, one ngl::Random call per component into an AoS array
+    std::vector<Light> array(numLights);
+    ngl::Random::setSeed(m_options.seed);
+    measure(numLights, "aos-ngl-random",
+         [&](int)
+         {
+           for (auto &light : array)
+           {
+             light.position = ngl::Random::getRandomPoint(20, 20, 20);
+             light.colour = ngl::Vec3(0.1f, 0.1f, 0.1f) + ngl::Random::getRandomColour3() * 100;
+             auto intensity = std::max({light.colour.m_x, light.colour.m_y, light.colour.m_z});
+             light.radius = std::sqrt(intensity / Cutoff);
+           }
+         },
+         [&]() { buffer.upload(array); });
+
+    LightSoA lights;
+    lights.resize(numLights);
+    // single threaded then every hardware thread, if there is more than one
+    std::vector<unsigned int> threadCounts = {1u};
+    if (LightGenerator().threads() > 1)
+    {
+      threadCounts.push_back(0u);
+    }
+    for (auto threads : threadCounts)
+    {
+      LightGenerator generator(threads);
+      Light *mapped = nullptr;
+      auto method = fmt::format("soa-{0}-{1}t", LightGenerator::instructionSet(), generator.threads());
+      LightGenerator::Params params;
+      params.cutoff = Cutoff;
+      params.seed = m_options.seed;
+      measure(numLights, method.c_str(),
+           [&](int _iteration)
+           {
+             params.generation = static_cast<uint32_t>(_iteration);
+             mapped = buffer.map(numLights);
+             generator.generate(lights, params, mapped);
+           },
+           [&]() { buffer.unmap(); });
+    }
+  }
+  return writeText(fmt::format("{{\n  \"renderer\": \"{0}\",\n  \"seed\": {1},\n  \"iterations\": {2},\n  \"results\": [{3}\n  ]\n}}\n",
+                               escapeJSON(m_renderer), m_options.seed, Iterations, results));
+}
+
+bool Benchmark::runLightFiles()
+{
+  ngl::NGLInit::initialize();
+  m_renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  constexpr int Iterations = 10;
+  // JSON is for small rigs, parsing a million lights only shows it is the wrong tool
+  constexpr size_t MaxJSONLights = 100000;
+  LightBuffer buffer;
+  buffer.create(0);
+  LightSoA loaded;
+  std::string results;
+  auto result = [&results](size_t _numLights, const char *_method, const std::vector<float> &_totalMs, const std::string &_extra)
+  {
+    results += fmt::format("{0}\n    {{\"lights\": {1}, \"method\": \"{2}\", \"total_ms\": {3}{4}}}",
+                           results.empty() ? "" : ",", _numLights, _method, toJSON(summarise(_totalMs)), _extra);
+  };
+  auto elapsedMs = [](std::chrono::steady_clock::time_point _start)
+  { return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - _start).count(); };
+
+  for (size_t numLights : {size_t(1000), size_t(100000), size_t(1000000)})
+  {
+    LightSoA lights;
+    lights.resize(numLights);
+    LightGenerator::Params params;
+    params.seed = m_options.seed;
+    LightGenerator().generate(lights, params);
+    auto path = fmt::format("{0}/lights_bench_{1}.lights", QDir::tempPath().toStdString(), numLights);
+    if (!LightFile::write(path, lights))
+    {
+      std::cerr << "unable to write " << path << '\n';
+      return false;
+    }
+    // every iteration reads a file the OS already has cached, so these are warm load times
+    // mapped and streamed a chunk per frame as NGLScene does it, the chunk times are what a frame would stall by
+    std::vector<float> totalMs(Iterations);
+    std::vector<float> chunkMs;
+    for (int i = 0; i < Iterations; ++i)
+    {
+      glFinish();
+      auto start = std::chrono::steady_clock::now();
+      LightFile file;
+      if (!file.open(path))
+      {
+        std::cerr << file.error() << '\n';
+        return false;
+      }
+      file.beginStream(buffer, loaded);
+      for (bool done = false; !done;)
+      {
+        auto chunkStart = std::chrono::steady_clock::now();
+        done = file.streamChunk(buffer, loaded);
+        chunkMs.push_back(elapsedMs(chunkStart));
+      }
+      glFinish();
+      totalMs[i] = elapsedMs(start);
+    }
+    auto chunks = (numLights + LightFile::ChunkLights - 1) / LightFile::ChunkLights;
+    result(numLights, "mmap-stream", totalMs, fmt::format(", \"chunks\": {0}, \"chunk_ms\": {1}", chunks, toJSON(summarise(chunkMs))));
+
+    // the copying path for comparison, read into memory then one upload
+    for (int i = 0; i < Iterations; ++i)
+    {
+      glFinish();
+      auto start = std::chrono::steady_clock::now();
+      std::ifstream file(path, std::ios::binary);
+      file.seekg(LightFile::HeaderSize);
+      std::vector<Light> array(numLights);
+      file.read(reinterpret_cast<char *>(array.data()), static_cast<std::streamsize>(numLights * sizeof(Light)));
+      buffer.upload(array);
+      loaded.resize(numLights);
+      loaded.set(0, array.data(), numLights);
+      glFinish();
+      totalMs[i] = elapsedMs(start);
+    }
+    result(numLights, "read-upload", totalMs, std::string());
+    std::remove(path.c_str());
+
+    if (numLights <= MaxJSONLights)
+    {
+      auto jsonPath = fmt::format("{0}/lights_bench_{1}.json", QDir::tempPath().toStdString(), numLights);
+      {
+        std::ofstream json(jsonPath);
+        json << "{\"lights\": [\n";
+        for (size_t l = 0; l < numLights; ++l)
+        {
+          json << fmt::format("{{\"position\": [{0}, {1}, {2}], \"colour\": [{3}, {4}, {5}]}}{6}\n", lights.x[l], lights.y[l], lights.z[l],
+                              lights.r[l], lights.g[l], lights.b[l], l + 1 < numLights ? "," : "");
+        }
+        json << "]}\n";
+      }
+      for (int i = 0; i < Iterations; ++i)
+      {
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        std::string error;
+        if (!LightFile::importJSON(jsonPath, params.cutoff, loaded, error))
+        {
+          std::cerr << error << '\n';
+          return false;
+        }
+        std::vector<Light> array(loaded.size());
+        LightGenerator().interleave(loaded, array.data());
+        buffer.upload(array);
+        glFinish();
+        totalMs[i] = elapsedMs(start);
+      }
+      result(numLights, "json-import", totalMs, std::string());
+      std::remove(jsonPath.c_str());
+    }
+  }
+  return writeText(fmt::format("{{\n  \"renderer\": \"{0}\",\n  \"seed\": {1},\n  \"iterations\": {2},\n  \"chunk_lights\": {3},\n  \"results\": [{4}\n  ]\n}}\n",
+                               escapeJSON(m_renderer), m_options.seed, Iterations, LightFile::ChunkLights, results));
+}
+
+bool Benchmark::runLightCulling()
+{
+  ngl::NGLInit::initialize();
+  m_renderer = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+  constexpr int Iterations = 10;
+  // far enough to move lights between leaves, as a few seconds of animation would
+  constexpr float Jitter = 0.5f;
+  // the teapot at its default scale, as NGLScene bounds it
+  constexpr float ObjectRadius = 16.0f;
+  // the scene's starting camera, and one in among the lights where most of them are behind it
+  struct View
+  {
+    const char *name;
+    float distance;
+    float height;
+  };
+  constexpr View Views[] = {{"orbit", 20.0f, 10.0f}, {"close", 6.0f, 2.0f}};
+  auto project = ngl::perspective(45.0f, static_cast<float>(m_options.width) / m_options.height, 0.05f, 350.0f);
+  LightCuller culler;
+  culler.create(8, 9);
+  std::string results;
+  auto elapsedMs = [](std::chrono::steady_clock::time_point _start)
+  { return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - _start).count(); };
+
+  for (size_t numLights : {size_t(1000), size_t(100000), size_t(1000000)})
+  {
+    LightSoA lights;
+    lights.resize(numLights);
+    // the radii the scene would give this many lights
+    LightGenerator::Params params;
+    params.cutoff = m_options.lightCutoff > 0.0f ? m_options.lightCutoff : LightGenerator::scaledCutoff(params.cutoff, numLights);
+    params.seed = m_options.seed;
+    LightGenerator().generate(lights, params);
+    auto rest = lights;
+
+    std::vector<float> buildMs(Iterations);
+    for (int i = 0; i < Iterations; ++i)
+    {
+      culler.build(lights, numLights);
+      buildMs[i] = culler.stats().buildMs;
+    }
+    // each refit sees every light moved from where the tree was built, the growth is what decides on a rebuild
+    std::vector<float> refitMs(Iterations);
+    std::vector<float> growth(Iterations);
+    std::minstd_rand random(m_options.seed);
+    std::uniform_real_distribution<float> offset(-Jitter, Jitter);
+    for (int i = 0; i < Iterations; ++i)
+    {
+      for (size_t l = 0; l < numLights; ++l)
+      {
+        lights.x[l] = rest.x[l] + offset(random);
+        lights.y[l] = rest.y[l] + offset(random);
+        lights.z[l] = rest.z[l] + offset(random);
+      }
+      growth[i] = culler.refit(lights);
+      refitMs[i] = culler.stats().refitMs;
+    }
+    culler.build(lights, numLights);
+
+    std::string views;
+    for (const auto &view : Views)
+    {
+      std::vector<float> cullMs(Iterations);
+      std::vector<float> totalMs(Iterations);
+      std::vector<float> linearMs(Iterations);
+      std::vector<float> visibleLights(Iterations);
+      std::vector<float> visibleGizmos(Iterations);
+      std::vector<float> outsideFrustum(Iterations);
+      std::vector<float> outOfReach(Iterations);
+      std::vector<float> nodesVisited(Iterations);
+      size_t mismatches = 0;
+      std::vector<uint32_t> linearLights;
+      std::vector<uint32_t> linearGizmos;
+      for (int i = 0; i < Iterations; ++i)
+      {
+        // a new angle every iteration, an unchanged camera would skip the cull
+        float angle = ngl::radians(360.0f * static_cast<float>(i) / Iterations);
+        auto viewProject = project * ngl::lookAt(ngl::Vec3(view.distance * std::sin(angle), view.height, view.distance * std::cos(angle)),
+                                                 ngl::Vec3(0.0f, 0.0f, 0.0f), ngl::Vec3(0.0f, 1.0f, 0.0f));
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        culler.cull(viewProject, viewProject, ngl::Vec3(0.0f, 0.0f, 0.0f), ObjectRadius);
+        glFinish();
+        totalMs[i] = elapsedMs(start);
+        const auto &stats = culler.stats();
+        cullMs[i] = stats.cullMs;
+        visibleLights[i] = static_cast<float>(stats.visibleLights);
+        visibleGizmos[i] = static_cast<float>(stats.visibleGizmos);
+        outsideFrustum[i] = static_cast<float>(stats.outsideFrustum);
+        outOfReach[i] = static_cast<float>(stats.outOfReach);
+        nodesVisited[i] = static_cast<float>(stats.nodesVisited);
+
+        // the same tests on every light, what the hierarchy saves
+        start = std::chrono::steady_clock::now();
+        auto planes = LightCuller::frustumPlanes(viewProject);
+        auto inFrustum = [&planes](size_t _l, const LightSoA &_lights, float _radius)
+        {
+          for (const auto &plane : planes)
+          {
+            if (plane[0] * _lights.x[_l] + plane[1] * _lights.y[_l] + plane[2] * _lights.z[_l] + plane[3] < -_radius)
+            {
+              return false;
+            }
+          }
+          return true;
+        };
+        linearLights.clear();
+        linearGizmos.clear();
+        for (size_t l = 0; l < numLights; ++l)
+        {
+          float reach = lights.radius[l] + ObjectRadius;
+          float distanceSq = lights.x[l] * lights.x[l] + lights.y[l] * lights.y[l] + lights.z[l] * lights.z[l];
+          if (inFrustum(l, lights, lights.radius[l]) && distanceSq <= reach * reach)
+          {
+            linearLights.push_back(static_cast<uint32_t>(l));
+          }
+          if (inFrustum(l, lights, LightCuller::GizmoRadius))
+          {
+            linearGizmos.push_back(static_cast<uint32_t>(l));
+          }
+        }
+        linearMs[i] = elapsedMs(start);
+        if (linearLights.size() != stats.visibleLights || linearGizmos.size() != stats.visibleGizmos)
+        {
+          ++mismatches;
+        }
+      }
+      views += fmt::format("{0}\n        {{\"view\": \"{1}\", \"cull_ms\": {2}, \"cull_upload_ms\": {3}, \"linear_ms\": {4}, "
+                           "\"visible_lights\": {5}, \"visible_gizmos\": {6}, \"outside_frustum\": {7}, \"out_of_reach\": {8}, "
+                           "\"nodes_visited\": {9}, \"mismatches\": {10}}}",
+                           views.empty() ? "" : ",", view.name, toJSON(summarise(cullMs)), toJSON(summarise(totalMs)),
+                           toJSON(summarise(linearMs)), toJSON(summarise(visibleLights)), toJSON(summarise(visibleGizmos)),
+                           toJSON(summarise(outsideFrustum)), toJSON(summarise(outOfReach)), toJSON(summarise(nodesVisited)), mismatches);
+    }
+    results += fmt::format("{0}\n    {{\"lights\": {1}, \"light_cutoff\": {6:.4g}, \"build_ms\": {2}, \"refit_ms\": {3}, \"refit_growth\": {4}, "
+                           "\"views\": [{5}\n      ]}}",
+                           results.empty() ? "" : ",", numLights, toJSON(summarise(buildMs)),
+                           toJSON(summarise(refitMs)), toJSON(summarise(growth)), views, params.cutoff);
+  }
+  return writeText(fmt::format("{{\n  \"renderer\": \"{0}\",\n  \"seed\": {1},\n  \"iterations\": {2},\n  \"jitter\": {3},\n  \"results\": [{4}\n  ]\n}}\n",
+                               escapeJSON(m_renderer), m_options.seed, Iterations, Jitter, results));
+}
+
+void Benchmark::measureStochasticError(const GLuint *_queries)
+{
+  // the last timed pose rendered exactly, then sampled. Nothing moves so the history averages every frame and
+  // the error at each count shows both the raw noise and how quickly accumulation removes it
+  constexpr int ReportFrames[] = {1, 4, 16, 64};
+  int frame = std::max(m_options.frames - 1, 0);
+  m_scene->setStochastic(0);
+  renderFrame(frame, _queries[0], _queries[1]);
+  auto reference = readFrame();
+  m_scene->setStochastic(m_options.stochasticSamples);
+  std::string results;
+  for (int i = 1, report = 0; report < static_cast<int>(std::size(ReportFrames)); ++i)
+  {
+    renderFrame(frame, _queries[0], _queries[1]);
+    if (i != ReportFrames[report])
+    {
+      continue;
+    }
+    ++report;
+    double rmse = compareImages(reference, readFrame()).rmse;
+    double psnr = rmse > 0.0 ? 20.0 * std::log10(1.0 / rmse) : 100.0;
+    results += fmt::format("{0}{{\"frames\": {1}, \"rmse\": {2:.5f}, \"psnr\": {3:.2f}}}", results.empty() ? "" : ", ", i, rmse, psnr);
+  }
+  m_stochasticError = "[" + results + "]";
+}
+
+bool Benchmark::measureBRDFError(const GLuint *_queries)
+{
+  // the last timed pose with every light shaded exactly, so the only difference is the BRDF
+  int frame = std::max(m_options.frames - 1, 0);
+  m_scene->setStochastic(0);
+  renderFrame(frame, _queries[0], _queries[1]);
+  auto image = readFrame();
+  m_scene->setBRDFMode(BRDFMode::Reference);
+  renderFrame(frame, _queries[0], _queries[1]);
+  auto error = compareImages(readFrame(), image);
+  m_scene->setBRDFMode(m_options.brdf);
+  m_scene->setStochastic(m_options.stochasticSamples);
+  bool pass = error.rmse <= m_options.brdfTolerance;
+  m_brdfError = fmt::format("{{\"rmse\": {0:.5f}, \"max\": {1:.5f}, \"tolerance\": {2:.5f}, \"pass\": {3}}}",
+                            error.rmse, error.max, m_options.brdfTolerance, pass ? "true" : "false");
+  if (!pass)
+  {
+    std::cerr << "brdf " << brdfModeName(m_options.brdf) << " differs from the reference by " << error.rmse << " RMSE, above "
+              << m_options.brdfTolerance << '\n';
+  }
+  return pass;
+}
+
+bool Benchmark::measureDeferredError(const GLuint *_queries)
+{
+  // the last timed pose shaded forward with every light and the BRDF the deferred passes use, so the difference
+  // is the G-buffer precision and the lighting resolution the run settled at, which is held for both frames
+  int frame = std::max(m_options.frames - 1, 0);
+  m_scene->setTargetFrameMs(0.0f);
+  m_scene->setDeferred(false);
+  m_scene->setClustered(false);
+  m_scene->setBRDFMode(BRDFMode::Reference);
+  m_scene->setShadows(false);
+  renderFrame(frame, _queries[0], _queries[1]);
+  auto reference = readFrame();
+  m_scene->setShadows(m_options.shadows);
+  m_scene->setBRDFMode(m_options.brdf);
+  m_scene->setClustered(m_options.clustered);
+  m_scene->setDeferred(true);
+  renderFrame(frame, _queries[0], _queries[1]);
+  auto error = compareImages(reference, readFrame());
+  m_scene->setTargetFrameMs(m_options.targetMs);
+  bool pass = error.rmse <= m_options.deferredTolerance;
+  m_deferredError = fmt::format("{{\"rmse\": {0:.5f}, \"max\": {1:.5f}, \"lighting_scale\": {2:.3f}, \"tolerance\": {3:.5f}, \"pass\": {4}}}",
+                                error.rmse, error.max, m_scene->lightingScale(), m_options.deferredTolerance, pass ? "true" : "false");
+  if (!pass)
+  {
+    std::cerr << "deferred differs from forward by " << error.rmse << " RMSE, above " << m_options.deferredTolerance << '\n';
+  }
+  return pass;
+}
+
+bool Benchmark::measureCPUReference(const GLuint *_queries)
+{
+  if (m_options.numObjects > 1 || m_options.animate)
+  {
+    std::cerr << "the CPU reference only draws the single teapot with static lights\n";
+    return false;
+  }
+  auto mesh = readMesh("teapot");
+  if (mesh.empty())
+  {
+    std::cerr << "unable to read the teapot mesh back\n";
+    return false;
+  }
+  // the last timed pose with every light shaded by the reference BRDF and nothing but the teapot drawn
+  int frame = std::max(m_options.frames - 1, 0);
+  m_scene->setStochastic(0);
+  m_scene->setBRDFMode(BRDFMode::Reference);
+  m_scene->setShowLights(false);
+  renderFrame(frame, _queries[0], _queries[1]);
+  auto image = readFrame();
+  m_scene->setShowLights(m_options.showLights);
+  m_scene->setBRDFMode(m_options.brdf);
+  m_scene->setStochastic(m_options.stochasticSamples);
+
+  CPURenderer renderer;
+  std::vector<unsigned char> reference;
+  renderer.render(mesh, m_scene->cpuCamera(), m_scene->material(), m_scene->lights(), m_options.width, m_options.height, reference);
+  auto error = compareImages(reference, image);
+  auto &stats = renderer.stats();
+  m_cpuReference = fmt::format("{{\"threads\": {0}, \"instruction_set\": \"{1}\", \"total_ms\": {2:.2f}, \"setup_ms\": {3:.2f}, \"tile_ms\": {4}, "
+                               "\"shaded_pixels\": {5}, \"rmse\": {6:.5f}, \"max\": {7:.5f}}}",
+                               stats.threads, CPURenderer::instructionSet(), stats.totalMs, stats.setupMs, toJSON(summarise(stats.tileMs)),
+                               stats.shadedPixels, error.rmse, error.max);
+  return m_options.cpuPng.empty() || savePNG(m_options.cpuPng, reference);
+}
+
+bool Benchmark::runCPUBench()
+{
+  constexpr int Iterations = 3;
+  constexpr float Cutoff = 0.25f;
+  auto mesh = readMesh("teapot");
+  if (mesh.empty())
+  {
+    std::cerr << "unable to read the teapot mesh back\n";
+    return false;
+  }
+  // the first pose of the orbit, painted once so the scene's transforms are set
+  m_scene->setPose(15, 0, 0.0f);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  m_scene->paintGL();
+  auto camera = m_scene->cpuCamera();
+  std::vector<unsigned int> threadCounts;
+  for (unsigned int threads = 1; threads < CPURenderer().threads(); threads *= 2)
+  {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(CPURenderer().threads());
+
+  std::string results;
+  std::vector<unsigned char> image;
+  for (size_t numLights : {size_t(16), size_t(256), size_t(4096)})
+  {
+    LightSoA lights;
+    lights.resize(numLights);
+    LightGenerator::Params params;
+    params.cutoff = Cutoff;
+    params.seed = m_options.seed;
+    LightGenerator().generate(lights, params);
+    for (auto threads : threadCounts)
+    {
+      CPURenderer renderer(threads);
+      std::vector<float> totalMs(Iterations);
+      std::vector<float> tileMs;
+      for (int i = 0; i < Iterations; ++i)
+      {
+        renderer.render(mesh, camera, m_scene->material(), lights, m_options.width, m_options.height, image);
+        totalMs[i] = renderer.stats().totalMs;
+        tileMs.insert(tileMs.end(), renderer.stats().tileMs.begin(), renderer.stats().tileMs.end());
+      }
+      // every pixel shades every light, so this is comparable across light counts and machines
+      auto best = *std::min_element(totalMs.begin(), totalMs.end());
+      auto pixelLights = static_cast<double>(renderer.stats().shadedPixels) * numLights / (best / 1000.0);
+      results += fmt::format("{0}\n    {{\"lights\": {1}, \"threads\": {2}, \"total_ms\": {3}, \"tile_ms\": {4}, \"shaded_pixels\": {5}, \"pixel_lights_per_s\": {6:.4g}}}",
+                             results.empty() ? "" : ",", numLights, threads, toJSON(summarise(totalMs)), toJSON(summarise(tileMs)),
+                             renderer.stats().shadedPixels, pixelLights);
+    }
+  }
+  return writeText(fmt::format("{{\n  \"renderer\": \"{0}\",\n  \"instruction_set\": \"{1}\",\n  \"width\": {2},\n  \"height\": {3},\n  \"seed\": {4},\n"
+                               "  \"triangles\": {5},\n  \"iterations\": {6},\n  \"results\": [{7}\n  ]\n}}\n",
+                               escapeJSON(m_renderer), CPURenderer::instructionSet(), m_options.width, m_options.height, m_options.seed,
+                               mesh.size() / 3, Iterations, results));
+}
+
+std::vector<unsigned char> Benchmark::readFrame() const
+{
+  std::vector<unsigned char> pixels(static_cast<size_t>(m_options.width) * m_options.height * 4);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, m_options.width, m_options.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  return pixels;
+}
+
+bool Benchmark::savePNG(const std::string &_path, const std::vector<unsigned char> &_pixels) const
+{
+  QImage image(m_options.width, m_options.height, QImage::Format_RGBA8888);
+  std::copy(_pixels.begin(), _pixels.end(), image.bits());
+  // GL rows start at the bottom
+  if (!image.mirrored().save(QString::fromStdString(_path)))
+  {
+    std::cerr << "unable to save " << _path << '\n';
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,390 @@
+#include "CPURenderer.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CPU_RENDERER_USE_SSE2
+#endif
+
+namespace
+{
+constexpr float PI = 3.14159265359f;
+
+// GLSL mat4 * vec4 with the matrix as it is uploaded, column major
+inline std::array<float, 4> transform(const ngl::Mat4 &_m, const std::array<float, 4> &_v)
+{
+  const float *m = _m.m_openGL;
+  std::array<float, 4> out;
+  for (int r = 0; r < 4; ++r)
+  {
+    out[r] = m[r] * _v[0] + m[4 + r] * _v[1] + m[8 + r] * _v[2] + m[12 + r] * _v[3];
+  }
+  return out;
+}
+
+inline float dot(const float *_a, const float *_b)
+{
+  return _a[0] * _b[0] + _a[1] * _b[1] + _a[2] * _b[2];
+}
+
+inline void normalise(float *_v)
+{
+  float length = std::sqrt(dot(_v, _v));
+  for (int i = 0; i < 3; ++i)
+  {
+    _v[i] /= length;
+  }
+}
+
+// everything in the shader's light loop that only depends on the pixel
+struct PixelTerms
+{
+  float position[3];
+  float N[3];
+  float V[3];
+  float NdotV;
+  float geometryV;
+  float a2;
+  float k;
+  float F0[3];
+  // albedo / PI scaled by the inverse metalness, kD in the shader is (1 - F) times this
+  float diffuse[3];
+};
+
+// shadeLight in PBRFragment.glsl for light _i, added to _Lo
+inline void shadeScalar(const PixelTerms &_p, const LightSoA &_lights, size_t _i, float *_Lo)
+{
+  float L[3] = {_lights.x[_i] - _p.position[0], _lights.y[_i] - _p.position[1], _lights.z[_i] - _p.position[2]};
+  float distance = std::sqrt(dot(L, L));
+  for (auto &c : L)
+  {
+    c /= distance;
+  }
+  float H[3] = {_p.V[0] + L[0], _p.V[1] + L[1], _p.V[2] + L[2]};
+  normalise(H);
+  float ratio = distance / _lights.radius[_i];
+  float ratioSq = ratio * ratio;
+  float window = std::clamp(1.0f - ratioSq * ratioSq, 0.0f, 1.0f);
+  float attenuation = window * window / (distance * distance);
+
+  float NdotH = std::max(dot(_p.N, H), 0.0f);
+  float denom = NdotH * NdotH * (_p.a2 - 1.0f) + 1.0f;
+  float NDF = _p.a2 / (PI * denom * denom);
+  float NdotL = std::max(dot(_p.N, L), 0.0f);
+  float G = NdotL / (NdotL * (1.0f - _p.k) + _p.k) * _p.geometryV;
+  float f = 1.0f - std::max(dot(H, _p.V), 0.0f);
+  float f5 = f * f * f * f * f;
+  float specular = NDF * G / (4.0f * _p.NdotV * NdotL + 0.001f);
+  float colour[3] = {_lights.r[_i], _lights.g[_i], _lights.b[_i]};
+  for (int c = 0; c < 3; ++c)
+  {
+    float F = _p.F0[c] + (1.0f - _p.F0[c]) * f5;
+    _Lo[c] += ((1.0f - F) * _p.diffuse[c] + specular * F) * colour[c] * attenuation * NdotL;
+  }
+}
+
+#ifdef CPU_RENDERER_USE_SSE2
+inline __m128 dot4(const __m128 *_a, const __m128 *_b)
+{
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_a[0], _b[0]), _mm_mul_ps(_a[1], _b[1])), _mm_mul_ps(_a[2], _b[2]));
+}
+
+inline float sum4(__m128 _v)
+{
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, _v);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+// shadeScalar for lights _i to _i + 3, one per lane
+inline void shade4(const PixelTerms &_p, const LightSoA &_lights, size_t _i, __m128 *_Lo)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 N[3] = {_mm_set1_ps(_p.N[0]), _mm_set1_ps(_p.N[1]), _mm_set1_ps(_p.N[2])};
+  __m128 V[3] = {_mm_set1_ps(_p.V[0]), _mm_set1_ps(_p.V[1]), _mm_set1_ps(_p.V[2])};
+  __m128 L[3] = {_mm_sub_ps(_mm_loadu_ps(&_lights.x[_i]), _mm_set1_ps(_p.position[0])),
+                 _mm_sub_ps(_mm_loadu_ps(&_lights.y[_i]), _mm_set1_ps(_p.position[1])),
+                 _mm_sub_ps(_mm_loadu_ps(&_lights.z[_i]), _mm_set1_ps(_p.position[2]))};
+  __m128 distanceSq = dot4(L, L);
+  __m128 distance = _mm_sqrt_ps(distanceSq);
+  for (auto &c : L)
+  {
+    c = _mm_div_ps(c, distance);
+  }
+  __m128 H[3] = {_mm_add_ps(V[0], L[0]), _mm_add_ps(V[1], L[1]), _mm_add_ps(V[2], L[2])};
+  __m128 lengthH = _mm_sqrt_ps(dot4(H, H));
+  for (auto &c : H)
+  {
+    c = _mm_div_ps(c, lengthH);
+  }
+  __m128 ratio = _mm_div_ps(distance, _mm_loadu_ps(&_lights.radius[_i]));
+  __m128 ratioSq = _mm_mul_ps(ratio, ratio);
+  __m128 window = _mm_min_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(ratioSq, ratioSq)), zero), one);
+  __m128 attenuation = _mm_div_ps(_mm_mul_ps(window, window), _mm_mul_ps(distance, distance));
+
+  __m128 NdotH = _mm_max_ps(dot4(N, H), zero);
+  __m128 a2 = _mm_set1_ps(_p.a2);
+  __m128 denom = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(NdotH, NdotH), _mm_sub_ps(a2, one)), one);
+  __m128 NDF = _mm_div_ps(a2, _mm_mul_ps(_mm_set1_ps(PI), _mm_mul_ps(denom, denom)));
+  __m128 NdotL = _mm_max_ps(dot4(N, L), zero);
+  __m128 k = _mm_set1_ps(_p.k);
+  __m128 G = _mm_mul_ps(_mm_div_ps(NdotL, _mm_add_ps(_mm_mul_ps(NdotL, _mm_sub_ps(one, k)), k)), _mm_set1_ps(_p.geometryV));
+  __m128 f = _mm_sub_ps(one, _mm_max_ps(dot4(H, V), zero));
+  __m128 f2 = _mm_mul_ps(f, f);
+  __m128 f5 = _mm_mul_ps(_mm_mul_ps(f2, f2), f);
+  __m128 specular = _mm_div_ps(_mm_mul_ps(NDF, G), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(4.0f * _p.NdotV), NdotL), _mm_set1_ps(0.001f)));
+  __m128 scale = _mm_mul_ps(attenuation, NdotL);
+  const float *colour[3] = {&_lights.r[_i], &_lights.g[_i], &_lights.b[_i]};
+  for (int c = 0; c < 3; ++c)
+  {
+    __m128 F0 = _mm_set1_ps(_p.F0[c]);
+    __m128 F = _mm_add_ps(F0, _mm_mul_ps(_mm_sub_ps(one, F0), f5));
+    __m128 brdf = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, F), _mm_set1_ps(_p.diffuse[c])), _mm_mul_ps(specular, F));
+    _Lo[c] = _mm_add_ps(_Lo[c], _mm_mul_ps(brdf, _mm_mul_ps(_mm_loadu_ps(colour[c]), scale)));
+  }
+}
+#endif
+
+// the tonemap, gamma and conversion to unorm8 at the end of the shader
+inline unsigned char toByte(float _linear)
+{
+  float mapped = std::pow(_linear / (_linear + 1.0f), 1.0f / 2.2f);
+  return static_cast<unsigned char>(std::lround(std::clamp(mapped, 0.0f, 1.0f) * 255.0f));
+}
+} // end anon namespace
+
+CPURenderer::CPURenderer(unsigned int _threads)
+  : m_threads(_threads != 0 ? _threads : std::max(std::thread::hardware_concurrency(), 1u))
+{
+}
+
+void CPURenderer::render(const std::vector<Vertex> &_mesh, const Camera &_camera, const Material &_material, const LightSoA &_lights,
+                         int _width, int _height, std::vector<unsigned char> &_rgba)
+{
+  auto start = std::chrono::steady_clock::now();
+  m_width = std::max(_width, 1);
+  m_height = std::max(_height, 1);
+  m_tilesX = (m_width + TileSize - 1) / TileSize;
+  m_tilesY = (m_height + TileSize - 1) / TileSize;
+  auto numTiles = static_cast<size_t>(m_tilesX) * m_tilesY;
+  _rgba.resize(static_cast<size_t>(m_width) * m_height * 4);
+  m_bins.resize(numTiles);
+  for (auto &bin : m_bins)
+  {
+    bin.clear();
+  }
+
+  // PBRVertex.glsl, world position from M, clip position from MVP and the normal by the upper 3x3 of MV
+  m_vertices.resize(_mesh.size());
+  for (size_t i = 0; i < _mesh.size(); ++i)
+  {
+    const auto &in = _mesh[i];
+    auto world = transform(_camera.model, {in.position.m_x, in.position.m_y, in.position.m_z, 1.0f});
+    auto clip = transform(_camera.project, transform(_camera.view, world));
+    auto normal = transform(_camera.view, transform(_camera.model, {in.normal.m_x, in.normal.m_y, in.normal.m_z, 0.0f}));
+    auto &out = m_vertices[i];
+    out.w = clip[3];
+    out.x = (clip[0] / clip[3] * 0.5f + 0.5f) * m_width;
+    out.y = (clip[1] / clip[3] * 0.5f + 0.5f) * m_height;
+    out.z = clip[2] / clip[3];
+    out.world.set(world[0], world[1], world[2]);
+    out.normal.set(normal[0], normal[1], normal[2]);
+  }
+  // there is no near plane clipping, a triangle with a vertex behind the eye is dropped
+  for (uint32_t triangle = 0; triangle < m_vertices.size() / 3; ++triangle)
+  {
+    const auto *v = &m_vertices[triangle * 3];
+    if (v[0].w <= 0.0f || v[1].w <= 0.0f || v[2].w <= 0.0f)
+    {
+      continue;
+    }
+    auto minX = std::max(static_cast<int>(std::floor(std::min({v[0].x, v[1].x, v[2].x}))), 0);
+    auto maxX = std::min(static_cast<int>(std::floor(std::max({v[0].x, v[1].x, v[2].x}))), m_width - 1);
+    auto minY = std::max(static_cast<int>(std::floor(std::min({v[0].y, v[1].y, v[2].y}))), 0);
+    auto maxY = std::min(static_cast<int>(std::floor(std::max({v[0].y, v[1].y, v[2].y}))), m_height - 1);
+    for (int ty = minY / TileSize; ty <= maxY / TileSize && minX <= maxX; ++ty)
+    {
+      for (int tx = minX / TileSize; tx <= maxX / TileSize; ++tx)
+      {
+        m_bins[static_cast<size_t>(ty) * m_tilesX + tx].push_back(triangle);
+      }
+    }
+  }
+  m_stats.setupMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  // every thread takes the next tile until there are none left, so uneven tiles balance themselves
+  m_stats.tileMs.assign(numTiles, 0.0f);
+  std::atomic<size_t> nextTile{0};
+  std::atomic<size_t> shadedPixels{0};
+  auto worker = [&]()
+  {
+    size_t shaded = 0;
+    for (size_t tile = nextTile++; tile < numTiles; tile = nextTile++)
+    {
+      auto tileStart = std::chrono::steady_clock::now();
+      shaded += renderTile(tile, _material, _camera.eye, _lights, _rgba);
+      m_stats.tileMs[tile] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tileStart).count();
+    }
+    shadedPixels += shaded;
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(m_threads - 1);
+  for (unsigned int i = 1; i < m_threads; ++i)
+  {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : workers)
+  {
+    thread.join();
+  }
+  m_stats.threads = m_threads;
+  m_stats.shadedPixels = shadedPixels;
+  m_stats.totalMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+size_t CPURenderer::renderTile(size_t _tile, const Material &_material, const ngl::Vec3 &_eye, const LightSoA &_lights,
+                               std::vector<unsigned char> &_rgba) const
+{
+  constexpr int TilePixels = TileSize * TileSize;
+  int x0 = static_cast<int>(_tile % m_tilesX) * TileSize;
+  int y0 = static_cast<int>(_tile / m_tilesX) * TileSize;
+  int x1 = std::min(x0 + TileSize, m_width);
+  int y1 = std::min(y0 + TileSize, m_height);
+  // the cleared depth buffer and the varyings of the nearest fragment so far
+  std::array<float, TilePixels> depth;
+  depth.fill(1.0f);
+  std::array<float, TilePixels * 3> world;
+  std::array<float, TilePixels * 3> normal;
+
+  for (auto triangle : m_bins[_tile])
+  {
+    const auto &a = m_vertices[triangle * 3];
+    const auto &b = m_vertices[triangle * 3 + 1];
+    const auto &c = m_vertices[triangle * 3 + 2];
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area == 0.0f)
+    {
+      continue;
+    }
+    // both windings are drawn, face culling is off in NGLScene
+    int minX = std::max(static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))), x0);
+    int maxX = std::min(static_cast<int>(std::floor(std::max({a.x, b.x, c.x}))), x1 - 1);
+    int minY = std::max(static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))), y0);
+    int maxY = std::min(static_cast<int>(std::floor(std::max({a.y, b.y, c.y}))), y1 - 1);
+    for (int y = minY; y <= maxY; ++y)
+    {
+      float py = y + 0.5f;
+      for (int x = minX; x <= maxX; ++x)
+      {
+        float px = x + 0.5f;
+        // barycentrics at the pixel centre from the signed areas opposite each vertex
+        float b0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) / area;
+        float b1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) / area;
+        float b2 = 1.0f - b0 - b1;
+        if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f)
+        {
+          continue;
+        }
+        // NDC z is linear in screen space, the default depth range maps it to 0 to 1
+        float z = (b0 * a.z + b1 * b.z + b2 * c.z) * 0.5f + 0.5f;
+        auto index = (y - y0) * TileSize + (x - x0);
+        if (z < 0.0f || z >= depth[index])
+        {
+          continue;
+        }
+        depth[index] = z;
+        // perspective correct varyings
+        float q0 = b0 / a.w;
+        float q1 = b1 / b.w;
+        float q2 = b2 / c.w;
+        float q = 1.0f / (q0 + q1 + q2);
+        q0 *= q;
+        q1 *= q;
+        q2 *= q;
+        float *w = &world[index * 3];
+        w[0] = q0 * a.world.m_x + q1 * b.world.m_x + q2 * c.world.m_x;
+        w[1] = q0 * a.world.m_y + q1 * b.world.m_y + q2 * c.world.m_y;
+        w[2] = q0 * a.world.m_z + q1 * b.world.m_z + q2 * c.world.m_z;
+        float *n = &normal[index * 3];
+        n[0] = q0 * a.normal.m_x + q1 * b.normal.m_x + q2 * c.normal.m_x;
+        n[1] = q0 * a.normal.m_y + q1 * b.normal.m_y + q2 * c.normal.m_y;
+        n[2] = q0 * a.normal.m_z + q1 * b.normal.m_z + q2 * c.normal.m_z;
+      }
+    }
+  }
+
+  // the terms that are the same for every pixel
+  float a = _material.roughness * _material.roughness;
+  float r = _material.roughness + 1.0f;
+  float albedo[3] = {_material.albedo.m_x, _material.albedo.m_y, _material.albedo.m_z};
+  size_t shaded = 0;
+  for (int y = y0; y < y1; ++y)
+  {
+    for (int x = x0; x < x1; ++x)
+    {
+      auto index = (y - y0) * TileSize + (x - x0);
+      auto *out = &_rgba[(static_cast<size_t>(y) * m_width + x) * 4];
+      out[3] = 255;
+      if (depth[index] >= 1.0f)
+      {
+        out[0] = out[1] = out[2] = Background;
+        continue;
+      }
+      ++shaded;
+      PixelTerms p;
+      std::copy_n(&world[index * 3], 3, p.position);
+      std::copy_n(&normal[index * 3], 3, p.N);
+      normalise(p.N);
+      p.V[0] = _eye.m_x - p.position[0];
+      p.V[1] = _eye.m_y - p.position[1];
+      p.V[2] = _eye.m_z - p.position[2];
+      normalise(p.V);
+      p.NdotV = std::max(dot(p.N, p.V), 0.0f);
+      p.a2 = a * a;
+      p.k = r * r / 8.0f;
+      p.geometryV = p.NdotV / (p.NdotV * (1.0f - p.k) + p.k);
+      for (int c = 0; c < 3; ++c)
+      {
+        p.F0[c] = 0.04f + (albedo[c] - 0.04f) * _material.metallic;
+        p.diffuse[c] = (1.0f - _material.metallic) * albedo[c] / PI;
+      }
+      float Lo[3] = {0.0f, 0.0f, 0.0f};
+      size_t i = 0;
+#ifdef CPU_RENDERER_USE_SSE2
+      __m128 Lo4[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+      for (; i + 4 <= _lights.size(); i += 4)
+      {
+        shade4(p, _lights, i, Lo4);
+      }
+      for (int c = 0; c < 3; ++c)
+      {
+        Lo[c] = sum4(Lo4[c]);
+      }
+#endif
+      for (; i < _lights.size(); ++i)
+      {
+        shadeScalar(p, _lights, i, Lo);
+      }
+      for (int c = 0; c < 3; ++c)
+      {
+        out[c] = toByte(0.03f * albedo[c] * _material.ao + Lo[c]);
+      }
+    }
+  }
+  return shaded;
+}
+
+const char *CPURenderer::instructionSet()
+{
+#ifdef CPU_RENDERER_USE_SSE2
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
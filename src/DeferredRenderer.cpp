@@ -0,0 +1,208 @@
+#include "DeferredRenderer.h"
+#include "ShaderCache.h"
+#include "ShaderState.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cmath>
+
+constexpr auto LightShader = "DeferredLight";
+constexpr auto ResolveShader = "DeferredResolve";
+
+DeferredRenderer::~DeferredRenderer()
+{
+  if (m_emptyVAO != 0)
+  {
+    releaseTargets();
+    glDeleteVertexArrays(1, &m_emptyVAO);
+    for (auto &set : m_queries)
+    {
+      glDeleteQueries(NumPasses, set.data());
+    }
+  }
+}
+
+void DeferredRenderer::create(ShaderCache &_shaders)
+{
+  // the geometry pass shares the forward vertex shader so the G-buffer sees exactly the same inputs
+  _shaders.load({GBufferShader, "shaders/PBRVertex.glsl", "shaders/GBufferFragment.glsl", {}});
+  _shaders.load({LightShader, "shaders/DeferredLightVertex.glsl", "shaders/DeferredLightFragment.glsl", {}});
+  ngl::ShaderLib::use(LightShader);
+  ngl::ShaderLib::setUniform("albedoAOTex", 0);
+  ngl::ShaderLib::setUniform("normalMaterialTex", 1);
+  ngl::ShaderLib::setUniform("depthTex", 2);
+  _shaders.load({ResolveShader, "shaders/DeferredResolveVertex.glsl", "shaders/DeferredResolveFragment.glsl", {}});
+  ngl::ShaderLib::use(ResolveShader);
+  ngl::ShaderLib::setUniform("albedoAOTex", 0);
+  ngl::ShaderLib::setUniform("normalMaterialTex", 1);
+  ngl::ShaderLib::setUniform("lightAccumTex", 3);
+  ngl::ShaderLib::setUniform("depthTex", 2);
+
+  glGenVertexArrays(1, &m_emptyVAO);
+  for (auto &set : m_queries)
+  {
+    glGenQueries(NumPasses, set.data());
+  }
+}
+
+void DeferredRenderer::resize(int _width, int _height)
+{
+  m_width = std::max(_width, 1);
+  m_height = std::max(_height, 1);
+  m_targetsDirty = true;
+}
+
+void DeferredRenderer::setLightingScale(float _scale)
+{
+  m_lightingScale = std::clamp(_scale, MinLightingScale, 1.0f);
+}
+
+void DeferredRenderer::releaseTargets()
+{
+  if (m_gbufferFBO != 0)
+  {
+    glDeleteFramebuffers(1, &m_gbufferFBO);
+    glDeleteFramebuffers(1, &m_accumFBO);
+    GLuint textures[] = {m_albedoAO, m_normalMaterial, m_depth, m_lightAccum};
+    glDeleteTextures(4, textures);
+    m_gbufferFBO = 0;
+  }
+}
+
+void DeferredRenderer::allocateTargets()
+{
+  releaseTargets();
+  auto makeTexture = [this](GLenum _internalFormat)
+  {
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexStorage2D(GL_TEXTURE_2D, 1, _internalFormat, m_width, m_height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return id;
+  };
+  m_albedoAO = makeTexture(GL_RGBA8);
+  // 16 bit float as metallic is allowed to go outside 0-1 in this demo
+  m_normalMaterial = makeTexture(GL_RGBA16F);
+  m_depth = makeTexture(GL_DEPTH_COMPONENT32F);
+  m_lightAccum = makeTexture(GL_RGBA16F);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &m_gbufferFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_gbufferFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_albedoAO, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_normalMaterial, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth, 0);
+  GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+
+  glGenFramebuffers(1, &m_accumFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_accumFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_lightAccum, 0);
+  m_targetsDirty = false;
+}
+
+void DeferredRenderer::readTimings()
+{
+  // last frame's set, only read if every pass has finished so we never wait on the GPU
+  auto &set = m_queries[(m_frame + 1) % 2];
+  if (!m_queriesIssued[(m_frame + 1) % 2])
+  {
+    return;
+  }
+  GLint available = 0;
+  glGetQueryObjectiv(set[Resolve], GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available)
+  {
+    GLuint64 ns[NumPasses];
+    for (int i = 0; i < NumPasses; ++i)
+    {
+      glGetQueryObjectui64v(set[i], GL_QUERY_RESULT, &ns[i]);
+    }
+    m_timings.geometryMs = ns[Geometry] / 1.0e6f;
+    m_timings.lightingMs = ns[Lighting] / 1.0e6f;
+    m_timings.resolveMs = ns[Resolve] / 1.0e6f;
+    m_timings.lightingScale = m_queryScale[(m_frame + 1) % 2];
+    ++m_timings.samples;
+  }
+}
+
+void DeferredRenderer::beginGeometryPass()
+{
+  if (m_targetsDirty)
+  {
+    allocateTargets();
+  }
+  readTimings();
+  glBeginQuery(GL_TIME_ELAPSED, m_queries[m_frame % 2][Geometry]);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_gbufferFBO);
+  glViewport(0, 0, m_width, m_height);
+  // depth must clear to the far plane so the later passes can spot background pixels
+  const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+  const GLfloat farDepth = 1.0f;
+  glClearBufferfv(GL_COLOR, 0, zero);
+  glClearBufferfv(GL_COLOR, 1, zero);
+  glClearBufferfv(GL_DEPTH, 0, &farDepth);
+}
+
+void DeferredRenderer::shade(ShaderState &_state, size_t _numLights, const ngl::Mat4 &_VP, const ngl::Vec3 &_camPos, GLuint _target)
+{
+  auto &queries = m_queries[m_frame % 2];
+  glEndQuery(GL_TIME_ELAPSED);
+  // the full screen passes must not be drawn as wireframe if that mode is on
+  GLint polygonMode[2];
+  glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glBindVertexArray(m_emptyVAO);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_albedoAO);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_normalMaterial);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+
+  // lighting, one additively blended quad per light, into the lower left lightWidth x lightHeight of the target
+  auto lightWidth = std::max(static_cast<int>(std::ceil(m_width * m_lightingScale)), 1);
+  auto lightHeight = std::max(static_cast<int>(std::ceil(m_height * m_lightingScale)), 1);
+  auto inverseVP = ngl::Mat4(_VP).inverse();
+  glBeginQuery(GL_TIME_ELAPSED, queries[Lighting]);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_accumFBO);
+  const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+  glClearBufferfv(GL_COLOR, 0, zero);
+  glViewport(0, 0, lightWidth, lightHeight);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  _state.use(LightShader);
+  _state.setUniform("VP", _VP);
+  _state.setUniform("inverseVP", inverseVP);
+  _state.setUniform("camPos", _camPos);
+  _state.setUniform("lightingScale", m_lightingScale);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(_numLights));
+  glDisable(GL_BLEND);
+  glViewport(0, 0, m_width, m_height);
+  glEndQuery(GL_TIME_ELAPSED);
+
+  // resolve, writes the G-buffer depth so anything drawn afterwards is occluded correctly
+  glBeginQuery(GL_TIME_ELAPSED, queries[Resolve]);
+  glBindFramebuffer(GL_FRAMEBUFFER, _target);
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D, m_lightAccum);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_ALWAYS);
+  _state.use(ResolveShader);
+  _state.setUniform("lightingScale", m_lightingScale);
+  _state.setUniform("lightingSize", lightWidth, lightHeight);
+  _state.setUniform("inverseVP", inverseVP);
+  _state.setUniform("camPos", _camPos);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glDepthFunc(GL_LESS);
+  glEndQuery(GL_TIME_ELAPSED);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindVertexArray(0);
+  glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(polygonMode[0]));
+  m_queriesIssued[m_frame % 2] = true;
+  m_queryScale[m_frame % 2] = m_lightingScale;
+  ++m_frame;
+}
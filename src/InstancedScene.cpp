@@ -0,0 +1,91 @@
+#include "InstancedScene.h"
+#include <ngl/AbstractVAO.h>
+#include <ngl/VAOPrimitives.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+static_assert(sizeof(ngl::Mat4) == 16 * sizeof(float), "model matrices are uploaded as an array of mat4");
+
+InstancedScene::~InstancedScene()
+{
+  if (m_cameraID != 0)
+  {
+    glDeleteBuffers(1, &m_cameraID);
+    glDeleteBuffers(1, &m_instanceID);
+  }
+}
+
+void InstancedScene::create(GLuint _cameraBinding, GLuint _instanceBinding)
+{
+  m_cameraBinding = _cameraBinding;
+  m_instanceBinding = _instanceBinding;
+  glGenBuffers(1, &m_cameraID);
+  glGenBuffers(1, &m_instanceID);
+  glBindBuffer(GL_UNIFORM_BUFFER, m_cameraID);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void InstancedScene::layout(size_t _count, float _extent, unsigned int _seed)
+{
+  m_count = _count;
+  m_models.resize(_count);
+  // mt19937 output is fixed by the standard, the distributions aren't, so floats are made by hand
+  std::mt19937 rng(_seed);
+  auto random = [&rng]() { return static_cast<float>(rng() >> 8) * (1.0f / 16777216.0f); };
+  auto side = std::max(static_cast<int>(std::ceil(std::cbrt(static_cast<double>(_count)))), 1);
+  float cell = 2.0f * _extent / side;
+  for (size_t i = 0; i < _count; ++i)
+  {
+    auto x = static_cast<int>(i % side);
+    auto y = static_cast<int>((i / side) % side);
+    auto z = static_cast<int>(i / (static_cast<size_t>(side) * side));
+    // the teapot is about 3.5 units across at unit scale, fill most of the cell and jitter within the rest
+    float scale = cell * (0.15f + 0.1f * random());
+    float jitter = cell * 0.25f;
+    auto translate = ngl::Mat4::translate(-_extent + (x + 0.5f) * cell + jitter * (random() - 0.5f),
+                                          -_extent + (y + 0.5f) * cell + jitter * (random() - 0.5f),
+                                          -_extent + (z + 0.5f) * cell + jitter * (random() - 0.5f));
+    m_models[i] = translate * ngl::Mat4::rotateY(360.0f * random()) * ngl::Mat4::rotateX(30.0f * (random() - 0.5f)) *
+                  ngl::Mat4::scale(scale, scale, scale);
+  }
+  auto bytes = std::max<size_t>(m_models.size(), 1) * sizeof(ngl::Mat4);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceID);
+  // the layout is static between edits, a new store each time avoids waiting on frames still reading the old one
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(bytes), m_models.empty() ? nullptr : m_models[0].m_openGL, GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  m_stats.instanceBytes += bytes;
+}
+
+void InstancedScene::setCamera(const ngl::Mat4 &_view, const ngl::Mat4 &_project, const ngl::Mat4 &_scene)
+{
+  CameraBlock camera{_view, _project, _scene};
+  if (m_cameraValid && std::memcmp(&camera, &m_camera, sizeof(CameraBlock)) == 0)
+  {
+    ++m_stats.cameraSkips;
+    return;
+  }
+  m_camera = camera;
+  m_cameraValid = true;
+  glBindBuffer(GL_UNIFORM_BUFFER, m_cameraID);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &m_camera);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  ++m_stats.cameraUploads;
+}
+
+void InstancedScene::draw(const std::string &_primitive)
+{
+  if (m_count == 0)
+  {
+    return;
+  }
+  glBindBufferBase(GL_UNIFORM_BUFFER, m_cameraBinding, m_cameraID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_instanceBinding, m_instanceID);
+  auto vao = ngl::VAOPrimitives::getVAOFromName(_primitive);
+  vao->bind();
+  glDrawArraysInstanced(vao->getMode(), 0, static_cast<GLsizei>(vao->numIndices()), static_cast<GLsizei>(m_count));
+  vao->unbind();
+  ++m_stats.draws;
+}
@@ -0,0 +1,57 @@
+#include "LightAnimator.h"
+#include "LightBuffer.h"
+#include "ShaderCache.h"
+#include "ShaderState.h"
+#include <ngl/ShaderLib.h>
+
+constexpr auto AnimateShader = "LightAnimate";
+
+LightAnimator::~LightAnimator()
+{
+  if (m_rest != 0)
+  {
+    glDeleteBuffers(1, &m_rest);
+  }
+}
+
+void LightAnimator::create(ShaderCache &_shaders, GLuint _restBinding)
+{
+  m_restBinding = _restBinding;
+  _shaders.load({AnimateShader, "", "", {}, "shaders/LightAnimateCompute.glsl"});
+  ngl::ShaderLib::use(AnimateShader);
+  ngl::ShaderLib::setUniform("maxOrbit", MaxOrbit);
+  glGenBuffers(1, &m_rest);
+}
+
+void LightAnimator::setRestState(const LightBuffer &_lights, size_t _numLights)
+{
+  auto size = static_cast<GLsizeiptr>(_numLights * sizeof(Light));
+  glBindBuffer(GL_COPY_READ_BUFFER, _lights.getID());
+  glBindBuffer(GL_COPY_WRITE_BUFFER, m_rest);
+  // only grow the storage, the copy never leaves the GPU
+  if (size > m_capacity)
+  {
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    m_capacity = size;
+  }
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  m_numLights = _numLights;
+}
+
+void LightAnimator::update(ShaderState &_state, float _time, unsigned int _seed)
+{
+  if (m_numLights == 0)
+  {
+    return;
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_restBinding, m_rest);
+  _state.use(AnimateShader);
+  _state.setUniform("numLights", static_cast<int>(m_numLights));
+  _state.setUniform("seed", static_cast<int>(_seed));
+  _state.setUniform("time", _time);
+  glDispatchCompute(static_cast<GLuint>((m_numLights + GroupSize - 1) / GroupSize), 1, 1);
+  // the forward, deferred and gizmo shaders all read the lights as shader storage
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,114 @@
+#include "LightBuffer.h"
+
+void LightSoA::resize(size_t _size)
+{
+  for (auto array : {&x, &y, &z, &radius, &r, &g, &b})
+  {
+    array->resize(_size);
+  }
+}
+
+Light LightSoA::get(size_t _index) const
+{
+  Light light;
+  light.position.set(x[_index], y[_index], z[_index]);
+  light.radius = radius[_index];
+  light.colour.set(r[_index], g[_index], b[_index]);
+  return light;
+}
+
+void LightSoA::set(size_t _first, const Light *_lights, size_t _count)
+{
+  for (size_t i = 0; i < _count; ++i)
+  {
+    auto index = _first + i;
+    x[index] = _lights[i].position.m_x;
+    y[index] = _lights[i].position.m_y;
+    z[index] = _lights[i].position.m_z;
+    radius[index] = _lights[i].radius;
+    r[index] = _lights[i].colour.m_x;
+    g[index] = _lights[i].colour.m_y;
+    b[index] = _lights[i].colour.m_z;
+  }
+}
+
+LightBuffer::~LightBuffer()
+{
+  if (m_id != 0)
+  {
+    glDeleteBuffers(1, &m_id);
+  }
+}
+
+void LightBuffer::create(GLuint _binding)
+{
+  m_binding = _binding;
+  glGenBuffers(1, &m_id);
+  bind();
+}
+
+void LightBuffer::upload(const std::vector<Light> &_lights)
+{
+  auto size = static_cast<GLsizeiptr>(_lights.size() * sizeof(Light));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+  // passing the data straight to glBufferData both orphans the previous storage and fills the new one
+  glBufferData(GL_SHADER_STORAGE_BUFFER, size, _lights.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  ++m_stats.calls;
+  m_stats.bytes += static_cast<size_t>(size);
+}
+
+Light *LightBuffer::map(size_t _numLights)
+{
+  auto size = static_cast<GLsizeiptr>(_numLights * sizeof(Light));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+  // orphan first so the map never waits on draws still reading the old lights
+  glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+  auto lights = static_cast<Light *>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  ++m_stats.calls;
+  m_stats.bytes += static_cast<size_t>(size);
+  return lights;
+}
+
+bool LightBuffer::unmap()
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+  auto ok = glUnmapBuffer(GL_SHADER_STORAGE_BUFFER) == GL_TRUE;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return ok;
+}
+
+void LightBuffer::allocate(size_t _numLights)
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(_numLights * sizeof(Light)), nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  ++m_stats.calls;
+}
+
+Light *LightBuffer::mapRange(size_t _first, size_t _count)
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+  auto lights = static_cast<Light *>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(_first * sizeof(Light)),
+                                                      static_cast<GLsizeiptr>(_count * sizeof(Light)),
+                                                      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  ++m_stats.calls;
+  m_stats.bytes += _count * sizeof(Light);
+  return lights;
+}
+
+void LightBuffer::uploadRange(size_t _first, const Light *_lights, size_t _count)
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_id);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(_first * sizeof(Light)), static_cast<GLsizeiptr>(_count * sizeof(Light)), _lights);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  ++m_stats.calls;
+  m_stats.bytes += _count * sizeof(Light);
+}
+
+void LightBuffer::bind() const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_binding, m_id);
+}
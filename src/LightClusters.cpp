@@ -0,0 +1,201 @@
+#include "LightClusters.h"
+#include "ShaderState.h"
+#include <ngl/Util.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+bool sphereIntersectsAABB(const ngl::Vec3 &_min, const ngl::Vec3 &_max, const ngl::Vec3 &_centre, float _radius)
+{
+  float distSq = 0.0f;
+  for (int i = 0; i < 3; ++i)
+  {
+    float v = _centre.m_openGL[i];
+    if (v < _min.m_openGL[i])
+    {
+      distSq += (_min.m_openGL[i] - v) * (_min.m_openGL[i] - v);
+    }
+    else if (v > _max.m_openGL[i])
+    {
+      distSq += (v - _max.m_openGL[i]) * (v - _max.m_openGL[i]);
+    }
+  }
+  return distSq <= _radius * _radius;
+}
+} // end anon namespace
+
+LightClusters::~LightClusters()
+{
+  if (m_gridID != 0)
+  {
+    glDeleteBuffers(1, &m_gridID);
+    glDeleteBuffers(1, &m_indexID);
+  }
+}
+
+void LightClusters::create(GLuint _gridBinding, GLuint _indexBinding)
+{
+  m_gridBinding = _gridBinding;
+  m_indexBinding = _indexBinding;
+  glGenBuffers(1, &m_gridID);
+  glGenBuffers(1, &m_indexID);
+}
+
+void LightClusters::setProjection(float _fovy, float _aspect, float _near, float _far, int _width, int _height)
+{
+  m_width = std::max(_width, 1);
+  m_height = std::max(_height, 1);
+  m_near = _near;
+  m_far = _far;
+  m_tanHalfFovY = std::tan(ngl::radians(_fovy * 0.5f));
+  m_tanHalfFovX = m_tanHalfFovY * _aspect;
+  m_dimX = (m_width + TileSize - 1) / TileSize;
+  m_dimY = (m_height + TileSize - 1) / TileSize;
+  m_dimZ = DepthSlices;
+  m_sliceScale = m_dimZ / std::log(m_far / m_near);
+
+  m_bounds.resize(numClusters());
+  for (int z = 0; z < m_dimZ; ++z)
+  {
+    float dNear = m_near * std::pow(m_far / m_near, static_cast<float>(z) / m_dimZ);
+    float dFar = m_near * std::pow(m_far / m_near, static_cast<float>(z + 1) / m_dimZ);
+    for (int y = 0; y < m_dimY; ++y)
+    {
+      float ndcY0 = 2.0f * (y * TileSize) / m_height - 1.0f;
+      float ndcY1 = 2.0f * std::min((y + 1) * TileSize, m_height) / m_height - 1.0f;
+      for (int x = 0; x < m_dimX; ++x)
+      {
+        float ndcX0 = 2.0f * (x * TileSize) / m_width - 1.0f;
+        float ndcX1 = 2.0f * std::min((x + 1) * TileSize, m_width) / m_width - 1.0f;
+        // the tile frustum widens with depth so take the extremes at both ends of the slice
+        auto &b = m_bounds[clusterIndex(x, y, z)];
+        b.min.m_x = std::min(ndcX0 * dNear, ndcX0 * dFar) * m_tanHalfFovX;
+        b.max.m_x = std::max(ndcX1 * dNear, ndcX1 * dFar) * m_tanHalfFovX;
+        b.min.m_y = std::min(ndcY0 * dNear, ndcY0 * dFar) * m_tanHalfFovY;
+        b.max.m_y = std::max(ndcY1 * dNear, ndcY1 * dFar) * m_tanHalfFovY;
+        b.min.m_z = -dFar;
+        b.max.m_z = -dNear;
+      }
+    }
+  }
+}
+
+int LightClusters::sliceForDepth(float _depth) const
+{
+  int slice = static_cast<int>(std::log(_depth / m_near) * m_sliceScale);
+  return std::clamp(slice, 0, m_dimZ - 1);
+}
+
+void LightClusters::build(const LightSoA &_lights, const ngl::Mat4 &_view, float _radiusPadding)
+{
+  auto start = std::chrono::steady_clock::now();
+  m_stats = Stats();
+  m_pairs.clear();
+  m_grid.assign(numClusters() * 2, 0);
+
+  for (uint32_t lightIndex = 0; lightIndex < _lights.size(); ++lightIndex)
+  {
+    auto p = _view * ngl::Vec4(_lights.x[lightIndex], _lights.y[lightIndex], _lights.z[lightIndex], 1.0f);
+    ngl::Vec3 centre(p.m_x, p.m_y, p.m_z);
+    float r = _lights.radius[lightIndex] + _radiusPadding;
+    float depth = -p.m_z;
+    float dMin = depth - r;
+    float dMax = depth + r;
+    if (dMax < m_near || dMin > m_far)
+    {
+      continue;
+    }
+    int z0 = sliceForDepth(std::max(dMin, m_near));
+    int z1 = sliceForDepth(std::min(dMax, m_far));
+    int x0 = 0;
+    int x1 = m_dimX - 1;
+    int y0 = 0;
+    int y1 = m_dimY - 1;
+    // a sphere crossing the near plane can cover the whole screen, otherwise find its screen rectangle.
+    // x/d and y/d are monotonic in each term so the extremes over the sphere's box are at its corners
+    if (dMin > m_near)
+    {
+      float minX = std::min((centre.m_x - r) / dMin, (centre.m_x - r) / dMax) / m_tanHalfFovX;
+      float maxX = std::max((centre.m_x + r) / dMin, (centre.m_x + r) / dMax) / m_tanHalfFovX;
+      float minY = std::min((centre.m_y - r) / dMin, (centre.m_y - r) / dMax) / m_tanHalfFovY;
+      float maxY = std::max((centre.m_y + r) / dMin, (centre.m_y + r) / dMax) / m_tanHalfFovY;
+      if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+      {
+        continue;
+      }
+      auto toTile = [](float _ndc, int _size, int _dim)
+      {
+        int t = static_cast<int>((_ndc * 0.5f + 0.5f) * _size) / TileSize;
+        return std::clamp(t, 0, _dim - 1);
+      };
+      x0 = toTile(minX, m_width, m_dimX);
+      x1 = toTile(maxX, m_width, m_dimX);
+      y0 = toTile(minY, m_height, m_dimY);
+      y1 = toTile(maxY, m_height, m_dimY);
+    }
+
+    bool binned = false;
+    for (int z = z0; z <= z1; ++z)
+    {
+      for (int y = y0; y <= y1; ++y)
+      {
+        for (int x = x0; x <= x1; ++x)
+        {
+          auto index = clusterIndex(x, y, z);
+          if (sphereIntersectsAABB(m_bounds[index].min, m_bounds[index].max, centre, r))
+          {
+            m_pairs.emplace_back(static_cast<uint32_t>(index), lightIndex);
+            ++m_grid[index * 2 + 1];
+            binned = true;
+          }
+        }
+      }
+    }
+    m_stats.lightsBinned += binned ? 1 : 0;
+  }
+
+  // prefix sum the counts into offsets, then scatter re-counting as we go
+  uint32_t offset = 0;
+  for (size_t c = 0; c < numClusters(); ++c)
+  {
+    auto count = m_grid[c * 2 + 1];
+    m_stats.maxPerCluster = std::max<size_t>(m_stats.maxPerCluster, count);
+    m_grid[c * 2] = offset;
+    m_grid[c * 2 + 1] = 0;
+    offset += count;
+  }
+  // never upload an empty buffer, the shader won't read past the counts anyway
+  m_indices.resize(std::max<size_t>(m_pairs.size(), 1));
+  for (const auto &pair : m_pairs)
+  {
+    auto c = pair.first;
+    m_indices[m_grid[c * 2] + m_grid[c * 2 + 1]++] = pair.second;
+  }
+  m_stats.indices = m_pairs.size();
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gridID);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_grid.size() * sizeof(uint32_t)), m_grid.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_indexID);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_indices.size() * sizeof(uint32_t)), m_indices.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  bind();
+
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  m_stats.buildMs = elapsed.count();
+}
+
+void LightClusters::bind() const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_gridBinding, m_gridID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_indexBinding, m_indexID);
+}
+
+void LightClusters::loadToShader(ShaderState &_state) const
+{
+  _state.setUniform("clusterDims", m_dimX, m_dimY, m_dimZ);
+  _state.setUniform("clusterTileSize", static_cast<float>(TileSize));
+  _state.setUniform("clusterNear", m_near);
+  _state.setUniform("clusterSliceScale", m_sliceScale);
+}
@@ -0,0 +1,453 @@
+#include "LightCuller.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+enum class Overlap
+{
+  Outside,
+  Partial,
+  Inside
+};
+// what is still undecided about a subtree's lights or its gizmos as the traversal goes down, no tests left means
+// every one of them is visible
+constexpr int Accepted = 0;
+constexpr int TestFrustum = 1;
+constexpr int TestReach = 2;
+constexpr int Rejected = 4;
+
+ngl::Vec3 minimum(const ngl::Vec3 &_a, const ngl::Vec3 &_b)
+{
+  return ngl::Vec3(std::min(_a.m_x, _b.m_x), std::min(_a.m_y, _b.m_y), std::min(_a.m_z, _b.m_z));
+}
+
+ngl::Vec3 maximum(const ngl::Vec3 &_a, const ngl::Vec3 &_b)
+{
+  return ngl::Vec3(std::max(_a.m_x, _b.m_x), std::max(_a.m_y, _b.m_y), std::max(_a.m_z, _b.m_z));
+}
+
+// the low 10 bits of _v moved to every third bit, so three of them interleave into a Morton code
+uint64_t spreadBits(uint32_t _v)
+{
+  uint64_t v = _v & 0x3ff;
+  v = (v | v << 16) & 0x30000ff;
+  v = (v | v << 8) & 0x300f00f;
+  v = (v | v << 4) & 0x30c30c3;
+  v = (v | v << 2) & 0x9249249;
+  return v;
+}
+
+float surfaceArea(const ngl::Vec3 &_min, const ngl::Vec3 &_max)
+{
+  auto d = _max - _min;
+  return 2.0f * (d.m_x * d.m_y + d.m_y * d.m_z + d.m_z * d.m_x);
+}
+
+// outside if no point of the box grown by _grow is in front of every plane, inside if all of the inner box is
+Overlap classify(const LightCuller::Planes &_planes, const ngl::Vec3 &_min, const ngl::Vec3 &_max, float _grow,
+                 const ngl::Vec3 &_innerMin, const ngl::Vec3 &_innerMax)
+{
+  bool inside = true;
+  for (const auto &plane : _planes)
+  {
+    float outer = plane[3];
+    float inner = plane[3];
+    for (int a = 0; a < 3; ++a)
+    {
+      float n = plane[a];
+      outer += n * (n > 0.0f ? _max.m_openGL[a] + _grow : _min.m_openGL[a] - _grow);
+      inner += n * (n > 0.0f ? _innerMin.m_openGL[a] : _innerMax.m_openGL[a]);
+    }
+    if (outer < 0.0f)
+    {
+      return Overlap::Outside;
+    }
+    inside &= inner >= 0.0f;
+  }
+  return inside ? Overlap::Inside : Overlap::Partial;
+}
+
+bool sphereInFrustum(const LightCuller::Planes &_planes, float _x, float _y, float _z, float _radius)
+{
+  for (const auto &plane : _planes)
+  {
+    if (plane[0] * _x + plane[1] * _y + plane[2] * _z + plane[3] < -_radius)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+} // end anon namespace
+
+LightCuller::Planes LightCuller::frustumPlanes(const ngl::Mat4 &_viewProject)
+{
+  // from the rows of the column major matrix, normalised so the sphere tests are in world units
+  const float *m = _viewProject.m_openGL;
+  Planes planes;
+  for (int p = 0; p < 6; ++p)
+  {
+    int row = p / 2;
+    float sign = p % 2 == 0 ? 1.0f : -1.0f;
+    float length = 0.0f;
+    for (int c = 0; c < 4; ++c)
+    {
+      planes[p][c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+      length += c < 3 ? planes[p][c] * planes[p][c] : 0.0f;
+    }
+    length = std::sqrt(length);
+    for (auto &c : planes[p])
+    {
+      c /= length;
+    }
+  }
+  return planes;
+}
+
+LightCuller::~LightCuller()
+{
+  if (m_lightID != 0)
+  {
+    glDeleteBuffers(1, &m_lightID);
+    glDeleteBuffers(1, &m_gizmoID);
+  }
+}
+
+void LightCuller::create(GLuint _lightBinding, GLuint _gizmoBinding)
+{
+  m_lightBinding = _lightBinding;
+  m_gizmoBinding = _gizmoBinding;
+  glGenBuffers(1, &m_lightID);
+  glGenBuffers(1, &m_gizmoID);
+}
+
+void LightCuller::update(const LightSoA &_lights, size_t _numLights)
+{
+  if (!m_lightsChanged)
+  {
+    return;
+  }
+  m_lightsChanged = false;
+  // a new count is a different set of lights, the same count is assumed to have moved and is refitted unless that
+  // leaves the bounds so loose the queries would suffer
+  if (_numLights != m_items.size() || refit(_lights) > RebuildGrowth)
+  {
+    build(_lights, _numLights);
+  }
+}
+
+void LightCuller::fitItems(Node &_node) const
+{
+  constexpr float Max = std::numeric_limits<float>::max();
+  float centreMin[3] = {Max, Max, Max};
+  float centreMax[3] = {-Max, -Max, -Max};
+  float sphereMin[3] = {Max, Max, Max};
+  float sphereMax[3] = {-Max, -Max, -Max};
+  for (uint32_t i = _node.first; i < _node.first + _node.count; ++i)
+  {
+    const auto &item = m_items[i];
+    const float p[3] = {item.x, item.y, item.z};
+    for (int a = 0; a < 3; ++a)
+    {
+      centreMin[a] = std::min(centreMin[a], p[a]);
+      centreMax[a] = std::max(centreMax[a], p[a]);
+      sphereMin[a] = std::min(sphereMin[a], p[a] - item.radius);
+      sphereMax[a] = std::max(sphereMax[a], p[a] + item.radius);
+    }
+  }
+  _node.centreMin.set(centreMin[0], centreMin[1], centreMin[2]);
+  _node.centreMax.set(centreMax[0], centreMax[1], centreMax[2]);
+  _node.sphereMin.set(sphereMin[0], sphereMin[1], sphereMin[2]);
+  _node.sphereMax.set(sphereMax[0], sphereMax[1], sphereMax[2]);
+}
+
+void LightCuller::build(const LightSoA &_lights, size_t _numLights)
+{
+  auto start = std::chrono::steady_clock::now();
+  // sorting along a Morton curve puts lights that are close together next to each other, then every range is split
+  // in half so the tree is balanced and each node covers a compact block of space
+  constexpr float Max = std::numeric_limits<float>::max();
+  float boundsMin[3] = {Max, Max, Max};
+  float boundsMax[3] = {-Max, -Max, -Max};
+  const float *positions[3] = {_lights.x.data(), _lights.y.data(), _lights.z.data()};
+  for (size_t i = 0; i < _numLights; ++i)
+  {
+    for (int a = 0; a < 3; ++a)
+    {
+      boundsMin[a] = std::min(boundsMin[a], positions[a][i]);
+      boundsMax[a] = std::max(boundsMax[a], positions[a][i]);
+    }
+  }
+  m_keys.resize(_numLights);
+  for (uint32_t i = 0; i < _numLights; ++i)
+  {
+    uint64_t code = 0;
+    for (int a = 0; a < 3; ++a)
+    {
+      float extent = boundsMax[a] - boundsMin[a];
+      float t = extent > 0.0f ? (positions[a][i] - boundsMin[a]) / extent : 0.0f;
+      code |= spreadBits(static_cast<uint32_t>(std::clamp(t * 1024.0f, 0.0f, 1023.0f))) << a;
+    }
+    m_keys[i] = code << 32 | i;
+  }
+  // least significant digit radix sort on the 30 bit codes, a few times quicker than a comparison sort at 100k
+  m_scratch.resize(_numLights);
+  for (int shift = 32; shift < 62; shift += 10)
+  {
+    std::array<uint32_t, 1025> offsets{};
+    for (auto key : m_keys)
+    {
+      ++offsets[(key >> shift & 1023) + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    for (auto key : m_keys)
+    {
+      m_scratch[offsets[key >> shift & 1023]++] = key;
+    }
+    m_keys.swap(m_scratch);
+  }
+  m_items.resize(_numLights);
+  for (size_t i = 0; i < _numLights; ++i)
+  {
+    auto light = static_cast<uint32_t>(m_keys[i]);
+    m_items[i] = {_lights.x[light], _lights.y[light], _lights.z[light], _lights.radius[light], light};
+  }
+
+  m_nodes.clear();
+  if (_numLights > 0)
+  {
+    // a balanced tree has about two nodes per leaf
+    m_nodes.reserve(2 * (_numLights / LeafSize + 1));
+    Node root;
+    root.count = static_cast<uint32_t>(_numLights);
+    m_nodes.push_back(root);
+    for (size_t index = 0; index < m_nodes.size(); ++index)
+    {
+      Node node = m_nodes[index];
+      if (node.count <= LeafSize)
+      {
+        continue;
+      }
+      m_nodes[index].left = static_cast<uint32_t>(m_nodes.size());
+      Node child;
+      child.first = node.first;
+      child.count = node.count / 2;
+      m_nodes.push_back(child);
+      child.first = node.first + node.count / 2;
+      child.count = node.count - node.count / 2;
+      m_nodes.push_back(child);
+    }
+  }
+  m_builtArea = fitNodes();
+  m_treeChanged = true;
+  ++m_stats.rebuilds;
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  m_stats.buildMs = elapsed.count();
+}
+
+float LightCuller::refit(const LightSoA &_lights)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (auto &item : m_items)
+  {
+    item.x = _lights.x[item.light];
+    item.y = _lights.y[item.light];
+    item.z = _lights.z[item.light];
+    item.radius = _lights.radius[item.light];
+  }
+  float area = fitNodes();
+  m_treeChanged = true;
+  ++m_stats.refits;
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  m_stats.refitMs = elapsed.count();
+  return m_builtArea > 0.0f ? area / m_builtArea : 1.0f;
+}
+
+float LightCuller::fitNodes()
+{
+  // children are stored after their parents so walking backwards fits every child before its parent
+  float area = 0.0f;
+  for (size_t i = m_nodes.size(); i-- > 0;)
+  {
+    auto &node = m_nodes[i];
+    if (node.left == 0)
+    {
+      fitItems(node);
+    }
+    else
+    {
+      const auto &left = m_nodes[node.left];
+      const auto &right = m_nodes[node.left + 1];
+      node.centreMin = minimum(left.centreMin, right.centreMin);
+      node.centreMax = maximum(left.centreMax, right.centreMax);
+      node.sphereMin = minimum(left.sphereMin, right.sphereMin);
+      node.sphereMax = maximum(left.sphereMax, right.sphereMax);
+    }
+    area += surfaceArea(node.sphereMin, node.sphereMax);
+  }
+  return area;
+}
+
+void LightCuller::cull(const ngl::Mat4 &_viewProject, const ngl::Mat4 &_gizmoMVP, const ngl::Vec3 &_objectCentre,
+                       float _objectRadius, float _radiusPadding)
+{
+  // nothing has moved, the lists uploaded last time still hold
+  if (!m_treeChanged && std::memcmp(_viewProject.m_openGL, m_viewProject.m_openGL, sizeof(m_viewProject.m_openGL)) == 0 &&
+      std::memcmp(_gizmoMVP.m_openGL, m_gizmoMVP.m_openGL, sizeof(m_gizmoMVP.m_openGL)) == 0 &&
+      std::memcmp(_objectCentre.m_openGL, m_objectCentre.m_openGL, sizeof(m_objectCentre.m_openGL)) == 0 &&
+      _objectRadius == m_objectRadius && _radiusPadding == m_radiusPadding)
+  {
+    return;
+  }
+  m_treeChanged = false;
+  m_viewProject = _viewProject;
+  m_gizmoMVP = _gizmoMVP;
+  m_objectCentre = _objectCentre;
+  m_objectRadius = _objectRadius;
+  m_radiusPadding = _radiusPadding;
+
+  auto start = std::chrono::steady_clock::now();
+  auto lightPlanes = frustumPlanes(_viewProject);
+  // the gizmos are drawn with the mouse transform on top, a rigid transform so its planes are still in world units
+  auto gizmoPlanes = frustumPlanes(_gizmoMVP);
+  float gizmoRadius = GizmoRadius + _radiusPadding;
+  m_visibleLights.clear();
+  m_visibleGizmos.clear();
+  m_stats.lights = m_items.size();
+  m_stats.outsideFrustum = 0;
+  m_stats.outOfReach = 0;
+  m_stats.nodesVisited = 0;
+
+  struct Entry
+  {
+    uint32_t node;
+    int light;
+    int gizmo;
+  };
+  std::vector<Entry> stack;
+  if (!m_nodes.empty())
+  {
+    stack.push_back({0, TestFrustum | TestReach, TestFrustum});
+  }
+  while (!stack.empty())
+  {
+    auto entry = stack.back();
+    stack.pop_back();
+    const auto &node = m_nodes[entry.node];
+    ++m_stats.nodesVisited;
+    if (entry.light & TestFrustum)
+    {
+      auto overlap = classify(lightPlanes, node.sphereMin, node.sphereMax, _radiusPadding, node.centreMin, node.centreMax);
+      if (overlap == Overlap::Outside)
+      {
+        m_stats.outsideFrustum += node.count;
+        entry.light = Rejected;
+      }
+      else if (overlap == Overlap::Inside)
+      {
+        entry.light &= ~TestFrustum;
+      }
+    }
+    if (entry.light & TestReach)
+    {
+      // none of the spheres touch the objects, or every light is inside them and so reaches them
+      float outside = 0.0f;
+      float farthest = 0.0f;
+      for (int a = 0; a < 3; ++a)
+      {
+        float c = _objectCentre.m_openGL[a];
+        float d = std::max({node.sphereMin.m_openGL[a] - _radiusPadding - c, c - node.sphereMax.m_openGL[a] - _radiusPadding, 0.0f});
+        float f = std::max(c - node.centreMin.m_openGL[a], node.centreMax.m_openGL[a] - c);
+        outside += d * d;
+        farthest += f * f;
+      }
+      if (outside > _objectRadius * _objectRadius)
+      {
+        m_stats.outOfReach += node.count;
+        entry.light = Rejected;
+      }
+      else if (farthest <= _objectRadius * _objectRadius)
+      {
+        entry.light &= ~TestReach;
+      }
+    }
+    if (entry.gizmo & TestFrustum)
+    {
+      auto overlap = classify(gizmoPlanes, node.centreMin, node.centreMax, gizmoRadius, node.centreMin, node.centreMax);
+      entry.gizmo = overlap == Overlap::Outside ? Rejected : overlap == Overlap::Inside ? Accepted : TestFrustum;
+    }
+    if (entry.light == Rejected && entry.gizmo == Rejected)
+    {
+      continue;
+    }
+    // a leaf, or a subtree with everything decided, is walked light by light
+    bool decided = (entry.light == Accepted || entry.light == Rejected) && (entry.gizmo == Accepted || entry.gizmo == Rejected);
+    if (node.left != 0 && !decided)
+    {
+      stack.push_back({node.left + 1, entry.light, entry.gizmo});
+      stack.push_back({node.left, entry.light, entry.gizmo});
+      continue;
+    }
+    for (uint32_t i = node.first; i < node.first + node.count; ++i)
+    {
+      const auto &item = m_items[i];
+      if (entry.light != Rejected)
+      {
+        float radius = item.radius + _radiusPadding;
+        float dx = item.x - _objectCentre.m_x;
+        float dy = item.y - _objectCentre.m_y;
+        float dz = item.z - _objectCentre.m_z;
+        float reach = radius + _objectRadius;
+        if ((entry.light & TestFrustum) && !sphereInFrustum(lightPlanes, item.x, item.y, item.z, radius))
+        {
+          ++m_stats.outsideFrustum;
+        }
+        else if ((entry.light & TestReach) && dx * dx + dy * dy + dz * dz > reach * reach)
+        {
+          ++m_stats.outOfReach;
+        }
+        else
+        {
+          m_visibleLights.push_back(item.light);
+        }
+      }
+      if (entry.gizmo == Accepted || (entry.gizmo == TestFrustum && sphereInFrustum(gizmoPlanes, item.x, item.y, item.z, gizmoRadius)))
+      {
+        m_visibleGizmos.push_back(item.light);
+      }
+    }
+  }
+  m_stats.visibleLights = m_visibleLights.size();
+  m_stats.visibleGizmos = m_visibleGizmos.size();
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  m_stats.cullMs = elapsed.count();
+  upload();
+}
+
+void LightCuller::upload()
+{
+  auto send = [](GLuint _id, const std::vector<uint32_t> &_indices)
+  {
+    // never an empty buffer, the loops and draws don't read past the counts anyway
+    const uint32_t none = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(_indices.size(), 1) * sizeof(uint32_t)),
+                 _indices.empty() ? &none : _indices.data(), GL_DYNAMIC_DRAW);
+  };
+  send(m_lightID, m_visibleLights);
+  send(m_gizmoID, m_visibleGizmos);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  bind();
+}
+
+void LightCuller::bind() const
+{
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_lightBinding, m_lightID);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_gizmoBinding, m_gizmoID);
+}
@@ -0,0 +1,171 @@
+#include "LightFile.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+LightFile::~LightFile()
+{
+  close();
+}
+
+bool LightFile::open(const std::string &_path)
+{
+  close();
+  m_file.setFileName(QString::fromStdString(_path));
+  if (!m_file.open(QIODevice::ReadOnly))
+  {
+    m_error = fmt::format("unable to open {0}", _path);
+    return false;
+  }
+  auto fileSize = static_cast<size_t>(m_file.size());
+  Header header;
+  if (fileSize < HeaderSize || (m_map = m_file.map(0, m_file.size())) == nullptr)
+  {
+    m_error = fmt::format("unable to map {0}", _path);
+    close();
+    return false;
+  }
+  std::memcpy(&header, m_map, HeaderSize);
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.lightSize != sizeof(Light))
+  {
+    m_error = fmt::format("{0} is not a version {1} light file", _path, Version);
+    close();
+    return false;
+  }
+  if (header.count > (fileSize - HeaderSize) / sizeof(Light))
+  {
+    m_error = fmt::format("{0} holds {1} lights but is too short for them", _path, header.count);
+    close();
+    return false;
+  }
+  m_count = static_cast<size_t>(header.count);
+  m_lights = reinterpret_cast<const Light *>(m_map + HeaderSize);
+  m_error.clear();
+  return true;
+}
+
+void LightFile::close()
+{
+  if (m_map != nullptr)
+  {
+    m_file.unmap(m_map);
+    m_map = nullptr;
+  }
+  m_file.close();
+  m_lights = nullptr;
+  m_count = 0;
+  m_streamed = 0;
+}
+
+void LightFile::beginStream(LightBuffer &_buffer, LightSoA &_lights)
+{
+  _buffer.allocate(m_count);
+  _lights.resize(0);
+  // reserve once so growing by a chunk a frame never reallocates
+  for (auto array : {&_lights.x, &_lights.y, &_lights.z, &_lights.radius, &_lights.r, &_lights.g, &_lights.b})
+  {
+    array->reserve(m_count);
+  }
+  m_streamed = 0;
+}
+
+bool LightFile::streamChunk(LightBuffer &_buffer, LightSoA &_lights, size_t _maxLights)
+{
+  auto count = std::min(_maxLights, m_count - m_streamed);
+  if (count > 0)
+  {
+    const Light *source = m_lights + m_streamed;
+    // straight from the file mapping into the buffer mapping, if either map fails the driver takes the copy
+    auto mapped = _buffer.mapRange(m_streamed, count);
+    if (mapped != nullptr)
+    {
+      std::memcpy(mapped, source, count * sizeof(Light));
+    }
+    if (mapped == nullptr || !_buffer.unmap())
+    {
+      _buffer.uploadRange(m_streamed, source, count);
+    }
+    _lights.resize(m_streamed + count);
+    _lights.set(m_streamed, source, count);
+    m_streamed += count;
+  }
+  return !streaming();
+}
+
+bool LightFile::write(const std::string &_path, const LightSoA &_lights)
+{
+  QFile file(QString::fromStdString(_path));
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+  {
+    return false;
+  }
+  Header header = {};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.lightSize = sizeof(Light);
+  header.count = _lights.size();
+  bool ok = file.write(reinterpret_cast<const char *>(&header), HeaderSize) == static_cast<qint64>(HeaderSize);
+  // interleaved a chunk at a time so a large set never needs a second full copy in memory
+  std::vector<Light> chunk;
+  for (size_t first = 0; ok && first < _lights.size(); first += ChunkLights)
+  {
+    chunk.resize(std::min(ChunkLights, _lights.size() - first));
+    for (size_t i = 0; i < chunk.size(); ++i)
+    {
+      chunk[i] = _lights.get(first + i);
+    }
+    auto bytes = static_cast<qint64>(chunk.size() * sizeof(Light));
+    ok = file.write(reinterpret_cast<const char *>(chunk.data()), bytes) == bytes;
+  }
+  return ok;
+}
+
+bool LightFile::importJSON(const std::string &_path, float _cutoff, LightSoA &_lights, std::string &_error)
+{
+  QFile file(QString::fromStdString(_path));
+  if (!file.open(QIODevice::ReadOnly))
+  {
+    _error = fmt::format("unable to open {0}", _path);
+    return false;
+  }
+  QJsonParseError parseError;
+  auto document = QJsonDocument::fromJson(file.readAll(), &parseError);
+  if (document.isNull())
+  {
+    _error = fmt::format("{0}: {1} at offset {2}", _path, parseError.errorString().toStdString(), parseError.offset);
+    return false;
+  }
+  auto rig = document.object().value("lights");
+  if (!rig.isArray())
+  {
+    _error = fmt::format("{0} has no \"lights\" array", _path);
+    return false;
+  }
+  auto array = rig.toArray();
+  _lights.resize(static_cast<size_t>(array.size()));
+  for (int i = 0; i < array.size(); ++i)
+  {
+    auto light = array[i].toObject();
+    auto position = light.value("position").toArray();
+    auto colour = light.value("colour").toArray();
+    if (position.size() != 3 || colour.size() != 3)
+    {
+      _error = fmt::format("{0}: light {1} needs a three component position and colour", _path, i);
+      return false;
+    }
+    _lights.x[i] = static_cast<float>(position[0].toDouble());
+    _lights.y[i] = static_cast<float>(position[1].toDouble());
+    _lights.z[i] = static_cast<float>(position[2].toDouble());
+    _lights.r[i] = static_cast<float>(colour[0].toDouble());
+    _lights.g[i] = static_cast<float>(colour[1].toDouble());
+    _lights.b[i] = static_cast<float>(colour[2].toDouble());
+    // the same falloff as LightGenerator unless the rig says otherwise
+    auto brightest = std::max({_lights.r[i], _lights.g[i], _lights.b[i], 0.0f});
+    _lights.radius[i] = static_cast<float>(light.value("radius").toDouble(std::sqrt(brightest / _cutoff)));
+  }
+  return true;
+}
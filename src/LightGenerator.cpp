@@ -0,0 +1,231 @@
+#include "LightGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIGHTS_USE_SSE2
+#endif
+
+namespace
+{
+// the same integer hash as LightAnimateCompute.glsl
+inline uint32_t hash(uint32_t _x)
+{
+  _x ^= _x >> 16;
+  _x *= 0x7feb352dU;
+  _x ^= _x >> 15;
+  _x *= 0x846ca68bU;
+  _x ^= _x >> 16;
+  return _x;
+}
+
+// top 24 bits so the conversion to float is exact, [0, 1)
+inline float unitFloat(uint32_t _h)
+{
+  return static_cast<float>(_h >> 8) * (1.0f / 16777216.0f);
+}
+
+// the per light random values in the order they are drawn, shared by both kernels so they match bit for bit
+enum Draw
+{
+  PosX,
+  PosY,
+  PosZ,
+  ColourR,
+  ColourG,
+  ColourB,
+  NumDraws
+};
+
+void generateScalar(LightSoA &_lights, const LightGenerator::Params &_params, uint32_t _seedHash, size_t _begin, size_t _end)
+{
+  for (size_t i = _begin; i < _end; ++i)
+  {
+    uint32_t state = hash(static_cast<uint32_t>(i) ^ _seedHash);
+    float u[NumDraws];
+    for (auto &value : u)
+    {
+      state = hash(state);
+      value = unitFloat(state);
+    }
+    _lights.x[i] = (u[PosX] * 2.0f - 1.0f) * _params.extent;
+    _lights.y[i] = (u[PosY] * 2.0f - 1.0f) * _params.extent;
+    _lights.z[i] = (u[PosZ] * 2.0f - 1.0f) * _params.extent;
+    _lights.r[i] = u[ColourR] * _params.colourScale + _params.minColour;
+    _lights.g[i] = u[ColourG] * _params.colourScale + _params.minColour;
+    _lights.b[i] = u[ColourB] * _params.colourScale + _params.minColour;
+    _lights.radius[i] = std::sqrt(std::max({_lights.r[i], _lights.g[i], _lights.b[i]}) / _params.cutoff);
+  }
+}
+
+void interleaveScalar(const LightSoA &_lights, Light *_mapped, size_t _begin, size_t _end)
+{
+  for (size_t i = _begin; i < _end; ++i)
+  {
+    _mapped[i] = _lights.get(i);
+  }
+}
+
+#ifdef LIGHTS_USE_SSE2
+// SSE2 has no 32 bit low multiply (that is SSE4.1) so build it from two 32x32->64 multiplies
+inline __m128i mullo(__m128i _a, __m128i _b)
+{
+  __m128i even = _mm_mul_epu32(_a, _b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(_a, 32), _mm_srli_epi64(_b, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128i hash4(__m128i _x)
+{
+  _x = _mm_xor_si128(_x, _mm_srli_epi32(_x, 16));
+  _x = mullo(_x, _mm_set1_epi32(0x7feb352d));
+  _x = _mm_xor_si128(_x, _mm_srli_epi32(_x, 15));
+  _x = mullo(_x, _mm_set1_epi32(static_cast<int>(0x846ca68bU)));
+  _x = _mm_xor_si128(_x, _mm_srli_epi32(_x, 16));
+  return _x;
+}
+
+inline __m128 unitFloat4(__m128i _h)
+{
+  return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(_h, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+// transpose four lights from SoA into the 32 byte GPU layout, mapped memory is usually write combined so the
+// stores are kept strictly sequential
+inline void store4(Light *_out, __m128 _x, __m128 _y, __m128 _z, __m128 _radius, __m128 _r, __m128 _g, __m128 _b)
+{
+  __m128 pad = _mm_setzero_ps();
+  _MM_TRANSPOSE4_PS(_x, _y, _z, _radius);
+  _MM_TRANSPOSE4_PS(_r, _g, _b, pad);
+  auto out = reinterpret_cast<float *>(_out);
+  _mm_storeu_ps(out, _x);
+  _mm_storeu_ps(out + 4, _r);
+  _mm_storeu_ps(out + 8, _y);
+  _mm_storeu_ps(out + 12, _g);
+  _mm_storeu_ps(out + 16, _z);
+  _mm_storeu_ps(out + 20, _b);
+  _mm_storeu_ps(out + 24, _radius);
+  _mm_storeu_ps(out + 28, pad);
+}
+#endif
+
+void generateRange(LightSoA &_lights, const LightGenerator::Params &_params, uint32_t _seedHash, Light *_mapped, size_t _begin, size_t _end)
+{
+  size_t i = _begin;
+#ifdef LIGHTS_USE_SSE2
+  const __m128 two = _mm_set1_ps(2.0f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 extent = _mm_set1_ps(_params.extent);
+  const __m128 colourScale = _mm_set1_ps(_params.colourScale);
+  const __m128 minColour = _mm_set1_ps(_params.minColour);
+  const __m128 cutoff = _mm_set1_ps(_params.cutoff);
+  const __m128i seedHash = _mm_set1_epi32(static_cast<int>(_seedHash));
+  for (; i + 4 <= _end; i += 4)
+  {
+    auto index = static_cast<int>(i);
+    __m128i state = hash4(_mm_xor_si128(_mm_setr_epi32(index, index + 1, index + 2, index + 3), seedHash));
+    __m128 u[NumDraws];
+    for (auto &value : u)
+    {
+      state = hash4(state);
+      value = unitFloat4(state);
+    }
+    __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u[PosX], two), one), extent);
+    __m128 y = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u[PosY], two), one), extent);
+    __m128 z = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(u[PosZ], two), one), extent);
+    __m128 r = _mm_add_ps(_mm_mul_ps(u[ColourR], colourScale), minColour);
+    __m128 g = _mm_add_ps(_mm_mul_ps(u[ColourG], colourScale), minColour);
+    __m128 b = _mm_add_ps(_mm_mul_ps(u[ColourB], colourScale), minColour);
+    __m128 radius = _mm_sqrt_ps(_mm_div_ps(_mm_max_ps(_mm_max_ps(r, g), b), cutoff));
+    _mm_storeu_ps(&_lights.x[i], x);
+    _mm_storeu_ps(&_lights.y[i], y);
+    _mm_storeu_ps(&_lights.z[i], z);
+    _mm_storeu_ps(&_lights.r[i], r);
+    _mm_storeu_ps(&_lights.g[i], g);
+    _mm_storeu_ps(&_lights.b[i], b);
+    _mm_storeu_ps(&_lights.radius[i], radius);
+    if (_mapped != nullptr)
+    {
+      store4(_mapped + i, x, y, z, radius, r, g, b);
+    }
+  }
+#endif
+  generateScalar(_lights, _params, _seedHash, i, _end);
+  if (_mapped != nullptr)
+  {
+    interleaveScalar(_lights, _mapped, i, _end);
+  }
+}
+} // end anon namespace
+
+LightGenerator::LightGenerator(unsigned int _threads)
+  : m_threads(_threads != 0 ? _threads : std::max(std::thread::hardware_concurrency(), 1u))
+{
+}
+
+template <typename Kernel>
+void LightGenerator::parallelFor(size_t _count, Kernel &&_kernel) const
+{
+  auto chunks = std::min<size_t>(m_threads, _count / MinLightsPerThread);
+  if (chunks <= 1)
+  {
+    _kernel(0, _count);
+    return;
+  }
+  // chunk boundaries are kept a multiple of 4 so only the last chunk has a scalar tail
+  auto chunkSize = ((_count + chunks - 1) / chunks + 3) & ~size_t(3);
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (size_t begin = chunkSize; begin < _count; begin += chunkSize)
+  {
+    workers.emplace_back(_kernel, begin, std::min(begin + chunkSize, _count));
+  }
+  _kernel(0, std::min(chunkSize, _count));
+  for (auto &worker : workers)
+  {
+    worker.join();
+  }
+}
+
+void LightGenerator::generate(LightSoA &_lights, const Params &_params, Light *_mapped) const
+{
+  uint32_t seedHash = hash(_params.seed ^ hash(_params.generation + 0x9e3779b9U));
+  parallelFor(_lights.size(), [&](size_t _begin, size_t _end)
+              { generateRange(_lights, _params, seedHash, _mapped, _begin, _end); });
+}
+
+void LightGenerator::interleave(const LightSoA &_lights, Light *_mapped) const
+{
+  parallelFor(_lights.size(), [&](size_t _begin, size_t _end)
+              {
+                size_t i = _begin;
+#ifdef LIGHTS_USE_SSE2
+                for (; i + 4 <= _end; i += 4)
+                {
+                  store4(_mapped + i, _mm_loadu_ps(&_lights.x[i]), _mm_loadu_ps(&_lights.y[i]), _mm_loadu_ps(&_lights.z[i]),
+                         _mm_loadu_ps(&_lights.radius[i]), _mm_loadu_ps(&_lights.r[i]), _mm_loadu_ps(&_lights.g[i]),
+                         _mm_loadu_ps(&_lights.b[i]));
+                }
+#endif
+                interleaveScalar(_lights, _mapped, i, _end);
+              });
+}
+
+float LightGenerator::scaledCutoff(float _cutoff, size_t _numLights)
+{
+  // a radius goes as 1 / sqrt(cutoff), so a cutoff growing as the count to the 2/3 keeps the total volume of the
+  // spheres, and so their overlap, fixed
+  float ratio = std::max(static_cast<float>(_numLights) / ReferenceLights, 1.0f);
+  return _cutoff * std::cbrt(ratio * ratio);
+}
+
+const char *LightGenerator::instructionSet()
+{
+#ifdef LIGHTS_USE_SSE2
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
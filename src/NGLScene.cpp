@@ -1,12 +1,19 @@
 #include <QMouseEvent>
 #include <QGuiApplication>
+#include <QScreen>
 
 #include "NGLScene.h"
 #include <ngl/Transformation.h>
 #include <ngl/NGLInit.h>
 #include <ngl/VAOPrimitives.h>
-#include <ngl/Random.h>
+#include <ngl/AbstractVAO.h>
 #include <ngl/ShaderLib.h>
+#include <ngl/Util.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <utility>
 #ifdef WIN32
 #define NOMINMAX
 #endif
@@ -14,26 +21,144 @@
 NGLScene::NGLScene()
 {
   setTitle("Multiple Point Lights");
-  m_lightArray.resize(m_numLights);
+  m_lights.resize(m_numLights);
 }
 
-constexpr auto PBRShader = "PBR";
-constexpr auto VertexShader = "PBRVertex";
-constexpr auto FragmentShader = "PBRFragment";
+constexpr auto GBufferInstancedShader = "GBufferInstanced";
+constexpr auto GizmoShader = "LightGizmo";
+// the forward shader is built with and without the cluster lookup, stochastic light selection, shadows and the
+// culled light list, and each again for the instanced objects which take their transforms from buffers rather than
+// uniforms. The BRDFMode is the bits above those
+enum ForwardPermutation
+{
+  Instanced = 1,
+  Clustered = 2,
+  Stochastic = 4,
+  Shadowed = 8,
+  Culled = 16,
+  BRDFModeShift = 5,
+  NumForwardVariants = static_cast<int>(BRDFModeNames.size()) << BRDFModeShift
+};
+const std::array<ShaderCache::Variant, NumForwardVariants> ForwardVariants = []()
+{
+  std::array<ShaderCache::Variant, NumForwardVariants> variants;
+  for (int i = 0; i < NumForwardVariants; ++i)
+  {
+    auto &variant = variants[i];
+    variant = {"PBR", i & Instanced ? "shaders/PBRInstancedVertex.glsl" : "shaders/PBRVertex.glsl", "shaders/PBRFragment.glsl", {}};
+    if (i & Instanced)
+    {
+      variant.name += "Instanced";
+    }
+    if (i & Stochastic)
+    {
+      variant.name += "Stochastic";
+      variant.defines.push_back("STOCHASTIC");
+    }
+    if (i & Clustered)
+    {
+      variant.name += "Clustered";
+      variant.defines.push_back("CLUSTERED");
+    }
+    if (i & Shadowed)
+    {
+      variant.name += "Shadowed";
+      variant.defines.push_back("SHADOWS");
+    }
+    if (i & Culled)
+    {
+      variant.name += "Culled";
+      variant.defines.push_back("CULLED");
+    }
+    switch (static_cast<BRDFMode>(i >> BRDFModeShift))
+    {
+    case BRDFMode::Reference:
+      break;
+    case BRDFMode::Fast:
+      variant.name += "FastBRDF";
+      variant.defines.push_back("FAST_BRDF");
+      break;
+    case BRDFMode::LUT:
+      variant.name += "LUTBRDF";
+      variant.defines.push_back("BRDF_LUT");
+      break;
+    }
+  }
+  return variants;
+}();
+const ShaderCache::Variant GBufferInstancedVariant{GBufferInstancedShader, "shaders/PBRInstancedVertex.glsl", "shaders/GBufferFragment.glsl", {}};
+// the depth pre-pass shares the vertex shaders so its depth matches the shading pass exactly
+const ShaderCache::Variant DepthVariant{"Depth", "shaders/PBRVertex.glsl", "shaders/DepthFragment.glsl", {}};
+const ShaderCache::Variant DepthInstancedVariant{"DepthInstanced", "shaders/PBRInstancedVertex.glsl", "shaders/DepthFragment.glsl", {}};
+const ShaderCache::Variant GizmoVariant{GizmoShader, "shaders/LightGizmoVertex.glsl", "shaders/LightGizmoFragment.glsl", {}};
+const ShaderCache::Variant GizmoCulledVariant{"LightGizmoCulled", "shaders/LightGizmoVertex.glsl", "shaders/LightGizmoFragment.glsl", {"CULLED"}};
+constexpr auto HUDFont = "fonts/DejaVuSansMono.ttf";
+constexpr auto TraceFile = "lights_trace.json";
+// must match the binding of LightBlock in PBRFragment.glsl
+constexpr GLuint LightBinding = 0;
+// bindings of ClusterGrid / ClusterIndices in PBRFragment.glsl
+constexpr GLuint ClusterGridBinding = 1;
+constexpr GLuint ClusterIndexBinding = 2;
+// binding of RestBlock in LightAnimateCompute.glsl
+constexpr GLuint RestBinding = 3;
+// uniform block binding of Camera and storage binding of InstanceBlock in PBRInstancedVertex.glsl
+constexpr GLuint CameraBinding = 0;
+constexpr GLuint InstanceBinding = 4;
+// binding of AliasTable in PBRFragment.glsl
+constexpr GLuint AliasTableBinding = 5;
+// texture unit of brdfLUT in PBRFragment.glsl, above the ones the deferred and stochastic passes use
+constexpr GLuint BRDFLookupUnit = 4;
+// bindings of ShadowSlots / LightShadows and the unit of shadowAtlas in PBRFragment.glsl
+constexpr GLuint ShadowSlotBinding = 6;
+constexpr GLuint LightShadowBinding = 7;
+constexpr GLuint ShadowAtlasUnit = 5;
+// bindings of VisibleLights in PBRFragment.glsl and VisibleGizmos in LightGizmoVertex.glsl
+constexpr GLuint VisibleLightBinding = 8;
+constexpr GLuint VisibleGizmoBinding = 9;
+// a bounding radius of the teapot at unit scale, it is about 3.5 units across
+constexpr float TeapotRadius = 2.0f;
+// instanced objects fill the same volume as the lights
+constexpr float ObjectExtent = 20.0f;
+// the simulation runs at a fixed rate whatever the frame rate, frames interpolate between steps
+constexpr std::chrono::duration<double> SimulationStep(1.0 / 60.0);
+// longer frames (a stall, dragging the window) are clamped rather than caught up with a burst of steps
+constexpr std::chrono::duration<double> MaxFrameTime(0.25);
+// degrees per second, the old 20 ms timer added a degree a tick
+constexpr float TeapotSpeed = 50.0f;
+// camera projection, shared with the light clusters
+constexpr float FOV = 45.0f;
+constexpr float NearPlane = 0.05f;
+constexpr float FarPlane = 350.0f;
+// radiance below which a light is treated as having no influence, sets each light's radius. This is the cutoff
+// for LightGenerator::ReferenceLights, more lights raise it so the radii stay local
+constexpr float LightCutoff = 0.25f;
 NGLScene::~NGLScene()
 {
+  // the light buffer is released by its dtor so it needs our context
+  makeCurrent();
   ngl::NGLMessage::addMessage("Shutting down NGL, removing VAO's and Shaders");
 }
 
 void NGLScene::resizeGL(int _w, int _h)
 {
-  m_project = ngl::perspective(45.0f, static_cast<float>(_w) / _h, 0.05f, 350.0f);
+  m_project = ngl::perspective(FOV, static_cast<float>(_w) / _h, NearPlane, FarPlane);
   m_win.width = static_cast<int>(_w * devicePixelRatio());
   m_win.height = static_cast<int>(_h * devicePixelRatio());
+  m_lightClusters.setProjection(FOV, static_cast<float>(_w) / _h, NearPlane, FarPlane, m_win.width, m_win.height);
+  m_deferredRenderer.resize(m_win.width, m_win.height);
+  m_stochasticLights.resize(m_win.width, m_win.height);
+  if (m_text)
+  {
+    m_text->setScreenSize(_w, _h);
+  }
+  m_clustersDirty = true;
+  // a resize is always followed by a paint
+  m_dirty |= CameraDirty;
 }
 
 void NGLScene::initializeGL()
 {
+  auto startupStart = std::chrono::steady_clock::now();
   ngl::NGLInit::initialize();
 
   glClearColor(0.4f, 0.4f, 0.4f, 1.0f); // Grey Background
@@ -47,57 +172,131 @@ void NGLScene::initializeGL()
   ngl::Vec3 to(0, 0, 0);
   ngl::Vec3 up(0, 1, 0);
 
+  m_eye = from;
   m_view = ngl::lookAt(from, to, up);
   // set the shape using FOV 45 Aspect Ratio based on Width and Height
   // The final two are near and far clipping planes of 0.5 and 10
   m_project = ngl::perspective(45.0f, 720.0f / 576.0f, 0.5f, 150.0f);
 
-  ngl::ShaderLib::createShaderProgram(PBRShader);
-
-  ngl::ShaderLib::attachShader(VertexShader, ngl::ShaderType::VERTEX);
-  ngl::ShaderLib::attachShader(FragmentShader, ngl::ShaderType::FRAGMENT);
-  ngl::ShaderLib::loadShaderSource(VertexShader, "shaders/PBRVertex.glsl");
-  ngl::ShaderLib::loadShaderSource(FragmentShader, "shaders/PBRFragment.glsl");
-  // the shader has a tag called @numLights, edit this and set to 8
-  ngl::ShaderLib::editShader(FragmentShader, "@numLights", "8");
-  ngl::ShaderLib::compileShader(VertexShader);
-  ngl::ShaderLib::compileShader(FragmentShader);
-  ngl::ShaderLib::attachShaderToProgram(PBRShader, VertexShader);
-  ngl::ShaderLib::attachShaderToProgram(PBRShader, FragmentShader);
+  if (m_clearShaderCache)
+  {
+    m_shaderCache.clear();
+  }
+  // only the permutations needed for the first frame are loaded here, see forwardShader
+  m_deferredRenderer.create(m_shaderCache);
+  m_stochasticLights.create(m_shaderCache, AliasTableBinding);
+  m_shaderCache.load(GizmoVariant);
+  loadShaderDefaults(DeferredRenderer::GBufferShader);
+  forwardShader();
 
-  ngl::ShaderLib::linkProgramObject(PBRShader);
-  ngl::ShaderLib::use(PBRShader);
+  // create the lights
+  m_lightBuffer.create(LightBinding);
+  m_lightClusters.create(ClusterGridBinding, ClusterIndexBinding);
+  m_lightAnimator.create(m_shaderCache, RestBinding);
+  m_instances.create(CameraBinding, InstanceBinding);
+  m_brdfLookup.create();
+  m_shadowAtlas.create(ShadowSlotBinding, LightShadowBinding);
+  m_lightCuller.create(VisibleLightBinding, VisibleGizmoBinding);
+  if (m_lightFilePath.empty() || !loadLights(m_lightFilePath))
+  {
+    createLights();
+  }
+  if (std::ifstream(HUDFont))
+  {
+    m_text = std::make_unique<ngl::Text>(HUDFont, 14);
+    m_text->setColour(1.0f, 1.0f, 1.0f);
+  }
+  else
+  {
+    ngl::NGLMessage::addWarning(fmt::format("{0} not found, profiler HUD disabled", HUDFont));
+  }
+  // draw again as soon as a frame is presented, so the loop runs at the display rate with vsync on and as fast
+  // as possible with it off. On demand the loop only continues while something has changed or moves by itself
+  // only when Qt drives us as a window, the benchmark and RenderWindow's thread call paintGL themselves
+  if (context() != nullptr)
+  {
+    connect(this, &QOpenGLWindow::frameSwapped, this, [this]()
+            {
+              m_frameScheduled = false;
+              if (needsFrame())
+              {
+                scheduleFrame();
+              }
+              else
+              {
+                idle();
+              }
+            });
+    m_lightChangeTimer = startTimer(1000);
+    m_lastReport = std::chrono::steady_clock::now();
+  }
+  // the other permutations are linked in the background so pressing C, D or 6 doesn't wait on the compiler
+  if (m_precompileShaders)
+  {
+    std::vector<ShaderCache::Variant> others;
+    for (const auto *variant : {&GBufferInstancedVariant, &DepthVariant, &DepthInstancedVariant, &GizmoCulledVariant})
+    {
+      if (!m_shaderCache.isLoaded(variant->name))
+      {
+        others.push_back(*variant);
+      }
+    }
+    for (int i = 0; i < NumForwardVariants; ++i)
+    {
+      // the culled list only replaces the full light loop, with clusters or sampling it is never selected
+      bool unused = (i & Culled) && (i & (Clustered | Stochastic));
+      if (!unused && !m_shaderCache.isLoaded(ForwardVariants[i].name))
+      {
+        others.push_back(ForwardVariants[i]);
+      }
+    }
+    m_shaderCache.precompile(std::move(others));
+  }
+  std::chrono::duration<float, std::milli> startup = std::chrono::steady_clock::now() - startupStart;
+  m_startupMs = startup.count();
+  auto shaders = m_shaderCache.stats();
+  ngl::NGLMessage::addMessage(fmt::format("initializeGL {0:.1f} ms, shaders {1:.1f} ms : {2} from memory {3} from disk {4} compiled",
+                                          m_startupMs, shaders.loadMs, shaders.memoryHits, shaders.diskHits, shaders.compiles));
+}
 
-  loadShaderDefaults();
-  // now set the material and light values
+void NGLScene::loadShaderDefaults(std::string_view _shader)
+{
+  // the G-buffer pass takes the same material as the forward shaders so both paths produce the same image
+  m_shaderState.use(_shader);
+  m_shaderState.setUniform("albedo", m_material.albedo);
+  m_shaderState.setUniform("metallic", m_material.metallic);
+  m_shaderState.setUniform("roughness", m_material.roughness);
+  m_shaderState.setUniform("ao", m_material.ao);
+}
 
-  // create the lights
-  createLights();
-  m_rotationTimer = startTimer(20);
-  m_lightChangeTimer = startTimer(1000);
+std::string_view NGLScene::forwardShader()
+{
+  return cachedShader(ForwardVariants[(instanced() ? Instanced : 0) | (m_clustered ? Clustered : 0) | (stochastic() ? Stochastic : 0) |
+                                      (shadowed() ? Shadowed : 0) | (culledLoop() ? Culled : 0) | static_cast<int>(m_brdfMode) << BRDFModeShift]);
 }
 
-void NGLScene::loadShaderDefaults()
+std::string_view NGLScene::cachedShader(const ShaderCache::Variant &_variant)
 {
-  ngl::ShaderLib::use(PBRShader);
-  ngl::ShaderLib::setUniform("camPos", 0.0f, 10.0f, 20.0f);
-  ngl::ShaderLib::setUniform("albedo", 0.950f, 0.71f, 0.29f);
-  ngl::ShaderLib::setUniform("metallic", 1.02f);
-  ngl::ShaderLib::setUniform("roughness", 0.38f);
-  ngl::ShaderLib::setUniform("ao", 0.2f);
+  // a variant that failed stays unlinked, its draws do nothing and ShaderCache has already said why
+  if (!m_shaderCache.isLoaded(_variant.name) && m_shaderCache.load(_variant))
+  {
+    loadShaderDefaults(_variant.name);
+    // unused by the G-buffer programs, ShaderState drops uniforms a program doesn't have
+    m_shaderState.setUniform("camPos", m_eye);
+    m_shaderState.setUniform("brdfLUT", static_cast<int>(BRDFLookupUnit));
+    m_shaderState.setUniform("shadowAtlas", static_cast<int>(ShadowAtlasUnit));
+  }
+  return _variant.name;
 }
 
-void NGLScene::loadMatricesToColourShader(const ngl::Vec4 &_colour)
+CPURenderer::Camera NGLScene::cpuCamera()
 {
-  ngl::ShaderLib::use(ngl::nglColourShader);
-  ngl::Mat4 MVP = m_project * m_view * m_mouseGlobalTX * m_transform.getMatrix();
-  ngl::ShaderLib::setUniform("MVP", MVP);
-  ngl::ShaderLib::setUniform("Colour", _colour / 200.0f);
+  return {m_mouseGlobalTX * m_transform.getMatrix(), m_view, m_project, m_eye};
 }
 
-void NGLScene::loadMatricesToShader()
+void NGLScene::loadMatricesToShader(std::string_view _shader)
 {
-  ngl::ShaderLib::use(PBRShader);
+  m_shaderState.use(_shader);
 
   ngl::Mat4 MV;
   ngl::Mat4 MVP;
@@ -108,44 +307,362 @@ void NGLScene::loadMatricesToShader()
   MVP = m_project * MV;
   normalMatrix = MV;
   normalMatrix.inverse().transpose();
-  ngl::ShaderLib::setUniform("MVP", MVP);
-  ngl::ShaderLib::setUniform("normalMatrix", normalMatrix);
-  ngl::ShaderLib::setUniform("M", M);
+  m_shaderState.setUniform("MVP", MVP);
+  m_shaderState.setUniform("normalMatrix", normalMatrix);
+  m_shaderState.setUniform("M", M);
 }
 
-void NGLScene::paintGL()
+void NGLScene::useObjectShader(std::string_view _shader)
+{
+  if (instanced())
+  {
+    // the instanced programs read everything they need from the camera and instance buffers
+    m_shaderState.use(_shader);
+  }
+  else
+  {
+    // now set this value in the shader for the current ModelMatrix
+    loadMatricesToShader(_shader);
+  }
+}
+
+void NGLScene::drawObjects()
 {
-  // clear the screen and depth buffer
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  ngl::Transformation trans;
-  // Rotation based on the mouse position for our global
-  // transform
-  auto rotX = ngl::Mat4::rotateX(m_win.spinXFace);
-  auto rotY = ngl::Mat4::rotateY(m_win.spinYFace);
-  // multiply the rotations
-  m_mouseGlobalTX = rotY * rotX;
-  // add the translations
-  m_mouseGlobalTX.m_m[3][0] = m_modelPos.m_x;
-  m_mouseGlobalTX.m_m[3][1] = m_modelPos.m_y;
-  m_mouseGlobalTX.m_m[3][2] = m_modelPos.m_z;
-  // grab an instance of the primitives for drawing
-  if (m_showLights)
+  if (instanced())
   {
-    m_transform.reset();
+    m_instances.draw("teapot");
+  }
+  else
+  {
+    ngl::VAOPrimitives::draw("teapot");
+  }
+}
+
+void NGLScene::objectBounds(ngl::Vec3 &_centre, float &_radius)
+{
+  auto transform = instanced() ? m_mouseGlobalTX : m_mouseGlobalTX * m_transform.getMatrix();
+  _centre.set(transform.m_m[3][0], transform.m_m[3][1], transform.m_m[3][2]);
+  // InstancedScene keeps every object within the extent cube and smaller than the extent itself
+  _radius = instanced() ? ObjectExtent * (std::sqrt(3.0f) + 1.0f) : TeapotRadius * m_scale;
+}
 
-    for (auto &light : m_lightArray)
+void NGLScene::updateShadows()
+{
+  // the teapot's bounds or the whole instanced volume, a new version whenever any of it moves
+  ShadowAtlas::Casters casters;
+  auto casterKey = instanced() ? m_mouseGlobalTX : m_mouseGlobalTX * m_transform.getMatrix();
+  if (std::memcmp(casterKey.m_openGL, m_casterKey.m_openGL, sizeof(casterKey.m_openGL)) != 0)
+  {
+    m_casterKey = casterKey;
+    ++m_casterVersion;
+  }
+  objectBounds(casters.centre, casters.radius);
+  casters.version = m_casterVersion;
+  m_shadowAtlas.update(m_lights, static_cast<size_t>(m_numLights), m_project * m_view, m_project.m_m[1][1], m_eye, casters,
+                       [this](const ngl::Mat4 &_view, const ngl::Mat4 &_project)
+                       {
+                         if (instanced())
+                         {
+                           m_instances.setCamera(_view, _project, m_mouseGlobalTX);
+                           m_shaderState.use(cachedShader(DepthInstancedVariant));
+                         }
+                         else
+                         {
+                           m_shaderState.use(cachedShader(DepthVariant));
+                           m_shaderState.setUniform("MVP", _project * _view * m_mouseGlobalTX * m_transform.getMatrix());
+                         }
+                         drawObjects();
+                       });
+  if (instanced())
+  {
+    m_instances.setCamera(m_view, m_project, m_mouseGlobalTX);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, m_renderTarget.value_or(defaultFramebufferObject()));
+  glViewport(0, 0, m_win.width, m_win.height);
+}
+
+NGLScene::SimulationState NGLScene::advanceSimulation()
+{
+  auto now = std::chrono::steady_clock::now();
+  // the first frame has nothing to step from
+  std::chrono::duration<double> frameTime = m_lastFrame ? now - *m_lastFrame : std::chrono::duration<double>(0.0);
+  m_lastFrame = now;
+  m_frameMs = std::chrono::duration<float, std::milli>(frameTime).count();
+  m_frameMsSum += m_frameMs;
+  m_frameMsMax = std::max(m_frameMsMax, m_frameMs);
+
+  // paused holds the accumulator too, so the pose stays exactly where it stopped
+  if (!m_paused)
+  {
+    m_dirty |= TransformsDirty | (m_animateLights ? LightsDirty : 0u);
+    m_accumulator += std::min(frameTime, MaxFrameTime);
+    while (m_accumulator >= SimulationStep)
+    {
+      m_previousState = m_state;
+      stepSimulation();
+      m_accumulator -= SimulationStep;
+    }
+  }
+  auto alpha = static_cast<float>(m_accumulator / SimulationStep);
+  SimulationState pose;
+  pose.teapotRotation = ngl::lerp(m_previousState.teapotRotation, m_state.teapotRotation, alpha);
+  pose.lightTime = ngl::lerp(m_previousState.lightTime, m_state.lightTime, alpha);
+  return pose;
+}
+
+void NGLScene::stepSimulation()
+{
+  auto step = static_cast<float>(SimulationStep.count());
+  m_state.teapotRotation += TeapotSpeed * step;
+  if (m_animateLights)
+  {
+    m_state.lightTime += step;
+  }
+}
+
+void NGLScene::paintGL()
+{
+  m_profiler.beginFrame();
+  m_shaderState.beginFrame();
+  auto pose = m_externalPose ? m_state : advanceSimulation();
+  // anything changed from here on is for the next frame
+  auto dirty = std::exchange(m_dirty, 0u);
+  {
+    Profiler::Scope frameScope(m_profiler, "paintGL");
+    // clear the screen and depth buffer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (dirty & CameraDirty)
     {
-      m_transform.setPosition(light.position);
-      loadMatricesToColourShader(light.colour);
-      ngl::VAOPrimitives::draw("cube");
+      // Rotation based on the mouse position for our global
+      // transform
+      auto rotX = ngl::Mat4::rotateX(m_win.spinXFace);
+      auto rotY = ngl::Mat4::rotateY(m_win.spinYFace);
+      // multiply the rotations
+      m_mouseGlobalTX = rotY * rotX;
+      // add the translations
+      m_mouseGlobalTX.m_m[3][0] = m_modelPos.m_x;
+      m_mouseGlobalTX.m_m[3][1] = m_modelPos.m_y;
+      m_mouseGlobalTX.m_m[3][2] = m_modelPos.m_z;
     }
+    if (dirty & TransformsDirty)
+    {
+      m_transform.reset();
+      m_transform.setScale(m_scale, m_scale, m_scale);
+      m_transform.setRotation(pose.teapotRotation, pose.teapotRotation, pose.teapotRotation);
+    }
+    if (m_lightFile.streaming())
+    {
+      streamLights();
+    }
+    if (m_animateLights)
+    {
+      Profiler::Scope animateScope(m_profiler, "lightAnimate");
+      m_lightAnimator.update(m_shaderState, pose.lightTime, m_seed.value_or(0));
+    }
+    if (instanced())
+    {
+      if (m_objectsDirty)
+      {
+        m_instances.layout(static_cast<size_t>(m_numObjects), ObjectExtent, m_seed.value_or(0));
+        m_objectsDirty = false;
+        ++m_casterVersion;
+      }
+      // the one camera upload of the frame, shared by whichever instanced program draws
+      m_instances.setCamera(m_view, m_project, m_mouseGlobalTX);
+    }
+    if (m_cullLights)
+    {
+      Profiler::Scope cullScope(m_profiler, "lightCull");
+      // animated lights are culled by the sphere their orbit can reach, as they are binned, so the lists only change
+      // with the camera, the objects or a new light set
+      m_lightCuller.update(m_lights, static_cast<size_t>(m_numLights));
+      ngl::Vec3 centre;
+      float radius;
+      objectBounds(centre, radius);
+      m_lightCuller.cull(m_project * m_view, m_project * m_view * m_mouseGlobalTX, centre, radius,
+                         m_animateLights ? LightAnimator::MaxOrbit : 0.0f);
+    }
+    if (m_deferred)
+    {
+      Profiler::Scope teapotScope(m_profiler, instanced() ? "objects" : "teapot");
+      m_deferredRenderer.beginGeometryPass();
+      useObjectShader(instanced() ? cachedShader(GBufferInstancedVariant) : DeferredRenderer::GBufferShader);
+      drawObjects();
+      auto &timings = m_deferredRenderer.timings();
+      if (m_resolution.enabled() && timings.samples != m_resolutionSample)
+      {
+        m_resolutionSample = timings.samples;
+        m_deferredRenderer.setLightingScale(m_resolution.update(timings.geometryMs + timings.lightingMs + timings.resolveMs,
+                                                                timings.lightingMs, timings.lightingScale));
+      }
+      m_deferredRenderer.shade(m_shaderState, static_cast<size_t>(m_numLights), m_project * m_view, m_eye, m_renderTarget.value_or(defaultFramebufferObject()));
+    }
+    else
+    {
+      if (shadowed())
+      {
+        Profiler::Scope shadowScope(m_profiler, "shadows");
+        updateShadows();
+      }
+      if (m_clustered && m_clustersDirty)
+      {
+        Profiler::Scope clusterScope(m_profiler, "clusterBuild");
+        // animated lights are binned once by the sphere their orbit can reach rather than every frame
+        m_lightClusters.build(m_lights, m_view, m_animateLights ? LightAnimator::MaxOrbit : 0.0f);
+        m_clustersDirty = false;
+      }
+      if (stochastic())
+      {
+        // the clustered variant samples from the cluster lists and has no need of the table
+        if (!m_clustered && m_aliasTableDirty)
+        {
+          Profiler::Scope tableScope(m_profiler, "aliasTable");
+          m_stochasticLights.buildTable(m_lights);
+          m_aliasTableDirty = false;
+        }
+        m_stochasticLights.begin();
+      }
+      if (m_depthPrepass)
+      {
+        // lay down the nearest depth with a trivial program so the PBR pass only shades visible fragments
+        Profiler::Scope prepassScope(m_profiler, "depthPrepass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        useObjectShader(cachedShader(instanced() ? DepthInstancedVariant : DepthVariant));
+        drawObjects();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+      }
+      {
+        Profiler::Scope teapotScope(m_profiler, instanced() ? "objects" : "teapot");
+        useObjectShader(forwardShader());
+        m_shaderState.setUniform("numLights", culledLoop() ? static_cast<int>(m_lightCuller.visibleLights()) : m_numLights);
+        if (m_clustered)
+        {
+          m_lightClusters.loadToShader(m_shaderState);
+        }
+        if (stochastic())
+        {
+          m_shaderState.setUniform("stochasticSamples", m_stochasticSamples);
+          m_shaderState.setUniform("stochasticCandidates", StochasticLights::Candidates);
+          m_shaderState.setUniform("frameIndex", m_stochasticLights.frameIndex());
+        }
+        if (m_brdfMode == BRDFMode::LUT)
+        {
+          m_brdfLookup.bind(BRDFLookupUnit);
+        }
+        if (shadowed())
+        {
+          m_shadowAtlas.bind(ShadowAtlasUnit);
+        }
+        drawObjects();
+      }
+      if (m_depthPrepass)
+      {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+      }
+      if (stochastic())
+      {
+        Profiler::Scope resolveScope(m_profiler, "stochasticResolve");
+        // the history only converges while nothing on screen moves
+        auto viewKey = m_project * m_view * m_mouseGlobalTX * (instanced() ? ngl::Mat4() : m_transform.getMatrix());
+        bool moved = m_animateLights || std::memcmp(viewKey.m_openGL, m_stochasticView.m_openGL, sizeof(viewKey.m_openGL)) != 0;
+        m_stochasticView = viewKey;
+        m_stochasticLights.resolve(m_shaderState, moved, m_renderTarget.value_or(defaultFramebufferObject()));
+      }
+    }
+    // all the light gizmos in a single instanced draw, positions and colours come from the light buffer. Culled, the
+    // instances are only the lights on screen and index it through the visible list
+    if (m_showLights)
+    {
+      Profiler::Scope gizmoScope(m_profiler, "gizmos");
+      m_shaderState.use(m_cullLights ? cachedShader(GizmoCulledVariant) : GizmoShader);
+      m_shaderState.setUniform("MVP", m_project * m_view * m_mouseGlobalTX);
+      auto gizmos = m_cullLights ? m_lightCuller.visibleGizmos() : static_cast<size_t>(m_numLights);
+      auto cube = ngl::VAOPrimitives::getVAOFromName("cube");
+      cube->bind();
+      glDrawArraysInstanced(cube->getMode(), 0, static_cast<GLsizei>(cube->numIndices()), static_cast<GLsizei>(gizmos));
+      cube->unbind();
+    }
+  }
+  drawHUD();
+  ++m_framesSinceReport;
+  if (m_timeLightEdit)
+  {
+    // wait for the GPU so any deferred driver work caused by the edit is included
+    glFinish();
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - m_lightEditStart;
+    ngl::NGLMessage::addMessage(fmt::format("light count {0} : {1:.2f} ms from key press to frame complete", m_numLights, elapsed.count()));
+    m_lightEditMs = elapsed.count();
+    m_timeLightEdit = false;
+  }
+}
+
+void NGLScene::drawHUD()
+{
+  if (!m_showHUD || !m_text)
+  {
+    return;
+  }
+  // text is drawn over everything, filled, whatever mode the scene is in
+  GLint polygonMode[2];
+  glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glDisable(GL_DEPTH_TEST);
+  float y = 18.0f;
+  if (!m_externalPose)
+  {
+    m_text->renderText(10.0f, y, fmt::format("frame {0:.2f} ms {1:.0f} fps", m_frameMs, m_frameMs > 0.0f ? 1000.0f / m_frameMs : 0.0f));
+    y += 18.0f;
+  }
+  auto &state = m_shaderState.lastFrame();
+  m_text->renderText(10.0f, y, fmt::format("glUseProgram {0} skipped {1} glUniform {2} skipped {3}",
+                                           state.programBinds, state.programSkips, state.uniformSets, state.uniformSkips));
+  y += 18.0f;
+  if (m_lightFile.streaming())
+  {
+    m_text->renderText(10.0f, y, fmt::format("streaming lights {0} of {1}", m_lightFile.streamed(), m_lightFile.size()));
+    y += 18.0f;
+  }
+  if (shadowed())
+  {
+    auto &shadowStats = m_shadowAtlas.stats();
+    m_text->renderText(10.0f, y, fmt::format("shadows {0} lights, views {1} rendered {2} reused {3} empty, {4} stale",
+                                             shadowStats.shadowedLights, shadowStats.renderedViews, shadowStats.reusedViews,
+                                             shadowStats.emptyViews, shadowStats.staleLights));
+    y += 18.0f;
+  }
+  if (m_cullLights)
+  {
+    auto &cullStats = m_lightCuller.stats();
+    m_text->renderText(10.0f, y, fmt::format("culled {0} of {1} lights shaded {2} gizmos drawn, {3} out of view {4} out of reach",
+                                             cullStats.visibleLights, cullStats.lights, cullStats.visibleGizmos,
+                                             cullStats.outsideFrustum, cullStats.outOfReach));
+    y += 18.0f;
+    m_text->renderText(10.0f, y, fmt::format("cull {0:.2f} ms {1} nodes, build {2:.2f} ms x {3} refit {4:.2f} ms x {5}",
+                                             cullStats.cullMs, cullStats.nodesVisited, cullStats.buildMs, cullStats.rebuilds,
+                                             cullStats.refitMs, cullStats.refits));
+    y += 18.0f;
+  }
+  if (stochastic())
+  {
+    auto stochasticStats = m_stochasticLights.stats();
+    m_text->renderText(10.0f, y, fmt::format("stochastic {0} samples x {1} candidates, {2} frames accumulated",
+                                             m_stochasticSamples, StochasticLights::Candidates, stochasticStats.accumulatedFrames));
+    y += 18.0f;
+  }
+  for (const auto &line : m_profiler.summary())
+  {
+    m_text->renderText(10.0f, y, line);
+    y += 18.0f;
+  }
+  if (m_profiler.isTracing())
+  {
+    m_text->renderText(10.0f, y, "recording trace, T to stop");
   }
-  m_transform.reset();
-  m_transform.setScale(m_scale, m_scale, m_scale);
-  m_transform.setRotation(m_teapotRotation, m_teapotRotation, m_teapotRotation);
-  // now set this value in the shader for the current ModelMatrix
-  loadMatricesToShader();
-  ngl::VAOPrimitives::draw("teapot");
+  glEnable(GL_DEPTH_TEST);
+  glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(polygonMode[0]));
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -153,8 +670,15 @@ void NGLScene::paintGL()
 void NGLScene::keyPressEvent(QKeyEvent *_event)
 {
   // this method is called every time the main window recives a key event.
+  handleKey(_event->key());
+}
+
+void NGLScene::handleKey(int _key)
+{
   // we then switch on the key value and set the camera in the GLWindow
-  switch (_event->key())
+  // most keys change how the scene is drawn, the others say what they changed
+  uint32_t dirty = SettingsDirty;
+  switch (_key)
   {
   // escape key to quite
   case Qt::Key_Escape:
@@ -179,6 +703,7 @@ void NGLScene::keyPressEvent(QKeyEvent *_event)
   case Qt::Key_Equal:
   case Qt::Key_Plus:
     ++m_scale;
+    dirty = TransformsDirty;
     break;
   case Qt::Key_1:
     updateLights(-1);
@@ -186,68 +711,410 @@ void NGLScene::keyPressEvent(QKeyEvent *_event)
   case Qt::Key_2:
     updateLights(1);
     break;
+  // halve / double the light count
+  case Qt::Key_3:
+    updateLights(-m_numLights / 2);
+    break;
+  case Qt::Key_4:
+    updateLights(m_numLights);
+    break;
+  // halve / double the object count, more than one switches to the instanced scene
+  case Qt::Key_5:
+    setNumObjects(m_numObjects / 2);
+    dirty = TransformsDirty;
+    break;
+  case Qt::Key_6:
+    setNumObjects(m_numObjects * 2);
+    dirty = TransformsDirty;
+    break;
+  // toggle clustered shading against the full light loop
+  case Qt::Key_C:
+    m_clustered ^= true;
+    break;
+  // stochastic light selection on / off, 7 / 8 halve or double the samples per fragment
+  case Qt::Key_L:
+    setStochastic(m_stochastic ? 0 : m_stochasticSamples);
+    break;
+  case Qt::Key_7:
+    setStochastic(std::max(m_stochasticSamples / 2, 1));
+    break;
+  case Qt::Key_8:
+    setStochastic(m_stochasticSamples * 2);
+    break;
+  // depth pre-pass on / off, compare the depthPrepass and teapot timings in the HUD
+  case Qt::Key_P:
+    m_depthPrepass ^= true;
+    break;
+  // step the deferred lighting resolution down through 3/4, 1/2 and 1/4 then back to full, turns off any target
+  case Qt::Key_R:
+    setLightingScale(lightingScale() <= DeferredRenderer::MinLightingScale ? 1.0f : lightingScale() - 0.25f);
+    break;
+  // step the forward BRDF through reference, fast and lookup table
+  case Qt::Key_B:
+    setBRDFMode(static_cast<BRDFMode>((static_cast<size_t>(m_brdfMode) + 1) % BRDFModeNames.size()));
+    break;
+  // toggle the deferred renderer
+  case Qt::Key_D:
+    m_deferred ^= true;
+    break;
+  // animate the lights on the GPU, turning it off puts them back at rest
+  case Qt::Key_A:
+    m_animateLights ^= true;
+    m_clustersDirty = true;
+    if (!m_animateLights)
+    {
+      makeCurrent();
+      uploadLights();
+    }
+    dirty = LightsDirty;
+    break;
+  // shadows on / off
+  case Qt::Key_O:
+    m_shadows ^= true;
+    m_stochasticLights.invalidate();
+    break;
+  // light and gizmo culling on / off
+  case Qt::Key_U:
+    m_cullLights ^= true;
+    break;
+  // only draw when something changes / stop the clock so nothing does
+  case Qt::Key_I:
+    m_onDemand ^= true;
+    break;
+  case Qt::Key_Z:
+    m_paused ^= true;
+    break;
+  // profiler HUD on / off
+  case Qt::Key_H:
+    m_showHUD ^= true;
+    break;
+  // start / stop recording a Chrome trace
+  case Qt::Key_T:
+    makeCurrent();
+    if (m_profiler.isTracing())
+    {
+      m_profiler.stopTrace(TraceFile);
+      ngl::NGLMessage::addMessage(fmt::format("trace written to {0}", TraceFile));
+    }
+    else
+    {
+      m_profiler.startTrace();
+    }
+    break;
   case Qt::Key_Minus:
     --m_scale;
+    dirty = TransformsDirty;
     break;
   case Qt::Key_Space:
     m_showLights ^= true;
     break;
   default:
+    dirty = 0;
     break;
   }
-  update();
+  markDirty(dirty);
 }
 
 void NGLScene::createLights()
 {
-  // light colour
-  ngl::ShaderLib::use(PBRShader);
-  // loop for the NumLights lights and set the position and colour
-  int i = 0;
-  for (auto &light : m_lightArray)
+  Profiler::Scope createScope(m_profiler, "createLights");
+  LightGenerator::Params params;
+  params.cutoff = lightCutoff();
+  params.seed = m_seed.value_or(0);
+  params.generation = m_lightGeneration++;
+  // the lights are generated straight into the mapped buffer, a failed map or contents lost while mapped
+  // fall back to a plain upload of the store
+  auto mapped = m_lightBuffer.map(m_lights.size());
+  m_lightGenerator.generate(m_lights, params, mapped);
+  if (mapped == nullptr || !m_lightBuffer.unmap())
+  {
+    uploadLights();
+  }
+  lightsChanged();
+}
+
+void NGLScene::lightsChanged()
+{
+  m_clustersDirty = true;
+  m_aliasTableDirty = true;
+  m_stochasticLights.invalidate();
+  m_shadowAtlas.invalidate();
+  m_lightCuller.invalidate();
+  m_dirty |= LightsDirty;
+  m_lightAnimator.setRestState(m_lightBuffer, static_cast<size_t>(m_numLights));
+}
+
+bool NGLScene::loadLights(const std::string &_path)
+{
+  Profiler::Scope loadScope(m_profiler, "loadLights");
+  std::string error;
+  if (_path.size() > 5 && _path.compare(_path.size() - 5, 5, ".json") == 0)
+  {
+    // hand written rigs are small, imported and uploaded in one go
+    LightSoA lights;
+    // a rig is lit as written, only a cutoff set on purpose changes it
+    if (!LightFile::importJSON(_path, m_lightCutoff > 0.0f ? m_lightCutoff : LightCutoff, lights, error))
+    {
+      ngl::NGLMessage::addWarning(error);
+      return false;
+    }
+    if (lights.size() == 0 || lights.size() > static_cast<size_t>(MaxLights))
+    {
+      ngl::NGLMessage::addWarning(fmt::format("{0} holds {1} lights, expected 1 to {2}", _path, lights.size(), MaxLights));
+      return false;
+    }
+    m_lightFile.close();
+    m_lights = std::move(lights);
+    m_numLights = static_cast<int>(m_lights.size());
+    uploadLights();
+    lightsChanged();
+  }
+  else
+  {
+    if (!m_lightFile.open(_path))
+    {
+      ngl::NGLMessage::addWarning(m_lightFile.error());
+      return false;
+    }
+    if (m_lightFile.size() == 0 || m_lightFile.size() > static_cast<size_t>(MaxLights))
+    {
+      ngl::NGLMessage::addWarning(fmt::format("{0} holds {1} lights, expected 1 to {2}", _path, m_lightFile.size(), MaxLights));
+      m_lightFile.close();
+      return false;
+    }
+    // the first chunk now and one a frame after that, streamLights publishes them as they arrive
+    m_lightFile.beginStream(m_lightBuffer, m_lights);
+    m_numLights = 0;
+    m_streamPublished = 0;
+    streamLights();
+  }
+  m_fileLights = true;
+  return true;
+}
+
+void NGLScene::streamLights()
+{
+  Profiler::Scope streamScope(m_profiler, "lightStream");
+  bool done = m_lightFile.streamChunk(m_lightBuffer, m_lights);
+  // shading, the clusters and the alias table see the streamed lights each time their count doubles, so the
+  // rebuilds cost about twice one full build rather than one per chunk
+  if (done || m_lights.size() >= 2 * m_streamPublished)
+  {
+    m_streamPublished = m_lights.size();
+    m_numLights = static_cast<int>(m_streamPublished);
+    lightsChanged();
+  }
+  if (done)
   {
-    // get a random light position
-    light.position = ngl::Random::getRandomPoint(20, 20, 20);
-    // create random colour
-    light.colour = ngl::Vec3(0.1f, 0.1f, 0.1f) + ngl::Random::getRandomColour3() * 100;
-    ngl::ShaderLib::setUniform(fmt::format("lightPositions[{0}]", i), light.position);
-    ngl::ShaderLib::setUniform(fmt::format("lightColours[{0}]", i), light.colour);
-    ++i;
+    m_lightFile.close();
   }
 }
 
+void NGLScene::uploadLights()
+{
+  Profiler::Scope uploadScope(m_profiler, "lightUpload");
+  std::vector<Light> lights(m_lights.size());
+  m_lightGenerator.interleave(m_lights, lights.data());
+  m_lightBuffer.upload(lights);
+}
+
+void NGLScene::reportLightStats()
+{
+  auto stats = m_lightBuffer.stats();
+  auto frames = std::max<size_t>(m_framesSinceReport, 1);
+  auto &clusters = m_lightClusters.stats();
+  // every refresh of the display since the last report that wasn't given a new frame was skipped
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> interval = now - m_lastReport;
+  m_lastReport = now;
+  auto refreshes = static_cast<size_t>(std::lround(interval.count() * (screen() ? screen()->refreshRate() : 60.0)));
+  m_renderedFrames += m_framesSinceReport;
+  m_skippedFrames += refreshes > m_framesSinceReport ? refreshes - m_framesSinceReport : 0;
+  // the old per-index path issued a glUniform3fv (and a string format / location lookup) for every
+  // position and colour each time the lights changed
+  setTitle(QString(fmt::format("Lights {0} objects {8} brdf {9} : {5:.0f} fps {6:.2f} ms max {7:.2f} ms : upload {1:.3f} calls {2:.1f} bytes per frame (per-light uniforms {3} calls per update) : {4} : {10}",
+                               m_numLights,
+                               static_cast<float>(stats.calls) / frames,
+                               static_cast<float>(stats.bytes) / frames,
+                               m_lights.size() * 2,
+                               m_deferred ? fmt::format("deferred geometry {0:.2f} ms lighting {1:.2f} ms at {3:.0f}% resolve {2:.2f} ms{4}",
+                                                        m_deferredRenderer.timings().geometryMs,
+                                                        m_deferredRenderer.timings().lightingMs,
+                                                        m_deferredRenderer.timings().resolveMs,
+                                                        m_deferredRenderer.timings().lightingScale * 100.0f,
+                                                        m_resolution.enabled() ? fmt::format(", target {0:.1f} ms", m_resolution.target()) : std::string())
+                               : m_clustered ? fmt::format("clustered {0} lights binned, {1:.1f} avg {2} max per cluster, build {3:.2f} ms",
+                                                         clusters.lightsBinned,
+                                                         static_cast<float>(clusters.indices) / m_lightClusters.numClusters(),
+                                                         clusters.maxPerCluster,
+                                                         clusters.buildMs)
+                                           : culledLoop() ? fmt::format("culled {0} lights per fragment", m_lightCuller.visibleLights())
+                                                          : std::string("all lights per fragment"),
+                               m_frameMsSum > 0.0f ? 1000.0f * frames / m_frameMsSum : 0.0f,
+                               m_frameMsSum / frames,
+                               m_frameMsMax,
+                               m_numObjects,
+                               brdfModeName(m_brdfMode),
+                               fmt::format("{0}{1} frames {2} drawn {3} skipped {4} requests coalesced", m_onDemand ? "on demand" : "continuous",
+                                           m_paused ? " paused" : "", m_renderedFrames, m_skippedFrames, m_coalescedRequests))
+                       .c_str()));
+  resetFrameStats();
+}
+
+float NGLScene::lightCutoff() const
+{
+  return m_lightCutoff > 0.0f ? m_lightCutoff : LightGenerator::scaledCutoff(LightCutoff, m_lights.size());
+}
+
+void NGLScene::resetFrameStats()
+{
+  m_lightBuffer.resetStats();
+  m_framesSinceReport = 0;
+  m_frameMsSum = 0.0f;
+  m_frameMsMax = 0.0f;
+}
+
+std::optional<float> NGLScene::takeLightEditMs()
+{
+  auto editMs = m_lightEditMs;
+  m_lightEditMs.reset();
+  return editMs;
+}
+
 void NGLScene::timerEvent(QTimerEvent *_event)
 {
-  if (_event->timerId() == m_rotationTimer)
+  if (_event->timerId() == m_lightChangeTimer)
   {
-    ++m_teapotRotation;
-    // re-draw GL
-    update();
+    reportLightStats();
+    newLightSet();
   }
+}
 
-  else if (_event->timerId() == m_lightChangeTimer)
+void NGLScene::newLightSet()
+{
+  // animated lights keep their rest state rather than jumping to a new random set, loaded ones stay loaded and
+  // paused ones stay still
+  if (!m_animateLights && !m_fileLights && !m_paused)
   {
+    // GL calls outside paintGL need our context, a render thread's is already current
+    if (context() != nullptr)
+    {
+      makeCurrent();
+    }
     createLights();
     // re-draw GL
-    update();
+    markDirty(LightsDirty);
+  }
+}
+
+void NGLScene::markDirty(uint32_t _flags)
+{
+  if (_flags != 0)
+  {
+    m_dirty |= _flags;
+    scheduleFrame();
   }
 }
 
+void NGLScene::scheduleFrame()
+{
+  // a mouse reports far more often than the display refreshes, every event until the frame is presented shares it
+  if (m_frameScheduled)
+  {
+    ++m_coalescedRequests;
+    return;
+  }
+  // driven by the benchmark or a render thread, which decide when to paint
+  if (context() == nullptr)
+  {
+    return;
+  }
+  m_frameScheduled = true;
+  update();
+}
+
+bool NGLScene::animating() const
+{
+  // the instanced objects don't spin, and the stochastic history converges over its first frames
+  return (!m_paused && (!instanced() || m_animateLights)) || m_lightFile.streaming() ||
+         (stochastic() && m_stochasticLights.stats().accumulatedFrames < StochasticLights::MaxFrames);
+}
+
+void NGLScene::setNumLights(int _numLights)
+{
+  m_numLights = std::clamp(_numLights, 1, MaxLights);
+  m_lights.resize(m_numLights);
+}
+
+void NGLScene::setNumObjects(int _numObjects)
+{
+  m_numObjects = std::clamp(_numObjects, 1, MaxObjects);
+  m_objectsDirty = true;
+}
+
+void NGLScene::setBRDFMode(BRDFMode _mode)
+{
+  m_brdfMode = _mode;
+  // the history was accumulated with the other BRDF
+  m_stochasticLights.invalidate();
+}
+
+void NGLScene::setStochastic(int _samples)
+{
+  m_stochastic = _samples > 0;
+  if (m_stochastic)
+  {
+    m_stochasticSamples = std::min(_samples, MaxStochasticSamples);
+  }
+  // the history was built from a different estimator, or is stale from when the mode was last on
+  m_stochasticLights.invalidate();
+}
+
+void NGLScene::setLightingScale(float _scale)
+{
+  m_resolution.setTarget(0.0f);
+  m_deferredRenderer.setLightingScale(_scale);
+}
+
+void NGLScene::setPose(int _spinX, int _spinY, ngl::Real _teapotRotation, ngl::Real _lightTime)
+{
+  m_win.spinXFace = _spinX;
+  m_win.spinYFace = _spinY;
+  m_state.teapotRotation = _teapotRotation;
+  m_state.lightTime = _lightTime;
+  m_previousState = m_state;
+  m_externalPose = true;
+  // the caller paints directly, so nothing is scheduled
+  m_dirty |= CameraDirty | TransformsDirty;
+}
+
+void NGLScene::setCamera(int _spinX, int _spinY, const ngl::Vec3 &_modelPos)
+{
+  m_win.spinXFace = _spinX;
+  m_win.spinYFace = _spinY;
+  m_modelPos = _modelPos;
+  m_dirty |= CameraDirty;
+}
+
 void NGLScene::updateLights(int _amount)
 {
-  ngl::ShaderLib::use(PBRShader);
-  m_numLights += _amount;
-  std::clamp(m_numLights, 1, 120);
-  auto editString = fmt::format("{0}", m_numLights);
-  ngl::ShaderLib::resetEdits(FragmentShader);
-
-  ngl::ShaderLib::editShader(FragmentShader, "@numLights", editString);
-  ngl::ShaderLib::compileShader(VertexShader);
-  ngl::ShaderLib::compileShader(FragmentShader);
-  ngl::ShaderLib::linkProgramObject(PBRShader);
-  ngl::ShaderLib::use(PBRShader);
-  m_lightArray.resize(m_numLights);
+  // the light count is a uniform over an unsized buffer so no shader edit / recompile is needed here
+  m_lightEditStart = std::chrono::steady_clock::now();
+  if (context() != nullptr)
+  {
+    makeCurrent();
+  }
+  Profiler::Scope updateScope(m_profiler, "updateLights");
+  m_timeLightEdit = true;
+  // editing the count goes back to generated lights
+  m_lightFile.close();
+  m_fileLights = false;
+  m_numLights = std::clamp(m_numLights + _amount, 1, MaxLights);
+  m_lights.resize(m_numLights);
   createLights();
-  setTitle(QString(fmt::format("Number of Light {0}", m_numLights).c_str()));
-  loadShaderDefaults();
+  // the window is the GUI thread's, RenderWindow reports the edit from its frame stats instead
+  if (context() != nullptr)
+  {
+    setTitle(QString(fmt::format("Number of Light {0}", m_numLights).c_str()));
+  }
 }
@@ -3,6 +3,36 @@
 #include <QtGlobal>
 //----------------------------------------------------------------------------------------------------------------------
 void NGLScene::mouseMoveEvent(QMouseEvent *_event)
+{
+  if (dragCamera(m_win, m_modelPos, _event))
+  {
+    markDirty(CameraDirty);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void NGLScene::mousePressEvent(QMouseEvent *_event)
+{
+  pressCamera(m_win, _event);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void NGLScene::mouseReleaseEvent(QMouseEvent *_event)
+{
+  releaseCamera(m_win, _event);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+void NGLScene::wheelEvent(QWheelEvent *_event)
+{
+  if (wheelCamera(m_modelPos, _event))
+  {
+    markDirty(CameraDirty);
+  }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+bool NGLScene::dragCamera(WinParams &_win, ngl::Vec3 &_modelPos, QMouseEvent *_event)
 {
 // note the method buttons() is the button state when event was called
 // that is different from button() which is used to check which button was
@@ -12,31 +42,32 @@ void NGLScene::mouseMoveEvent(QMouseEvent *_event)
 #else
   auto position = _event->pos();
 #endif
-  if (m_win.rotate && _event->buttons() == Qt::LeftButton)
+  if (_win.rotate && _event->buttons() == Qt::LeftButton)
   {
-    int diffx = position.x() - m_win.origX;
-    int diffy = position.y() - m_win.origY;
-    m_win.spinXFace += static_cast<int>(0.5f * diffy);
-    m_win.spinYFace += static_cast<int>(0.5f * diffx);
-    m_win.origX = position.x();
-    m_win.origY = position.y();
-    update();
+    int diffx = position.x() - _win.origX;
+    int diffy = position.y() - _win.origY;
+    _win.spinXFace += static_cast<int>(0.5f * diffy);
+    _win.spinYFace += static_cast<int>(0.5f * diffx);
+    _win.origX = position.x();
+    _win.origY = position.y();
+    return true;
   }
   // right mouse translate code
-  else if (m_win.translate && _event->buttons() == Qt::RightButton)
+  else if (_win.translate && _event->buttons() == Qt::RightButton)
   {
-    int diffX = static_cast<int>(position.x() - m_win.origXPos);
-    int diffY = static_cast<int>(position.y() - m_win.origYPos);
-    m_win.origXPos = position.x();
-    m_win.origYPos = position.y();
-    m_modelPos.m_x += INCREMENT * diffX;
-    m_modelPos.m_y -= INCREMENT * diffY;
-    update();
+    int diffX = static_cast<int>(position.x() - _win.origXPos);
+    int diffY = static_cast<int>(position.y() - _win.origYPos);
+    _win.origXPos = position.x();
+    _win.origYPos = position.y();
+    _modelPos.m_x += INCREMENT * diffX;
+    _modelPos.m_y -= INCREMENT * diffY;
+    return true;
   }
+  return false;
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void NGLScene::mousePressEvent(QMouseEvent *_event)
+void NGLScene::pressCamera(WinParams &_win, QMouseEvent *_event)
 {
   // that method is called when the mouse button is pressed in this case we
   // store the value where the mouse was clicked (x,y) and set the Rotate flag to true
@@ -48,48 +79,48 @@ void NGLScene::mousePressEvent(QMouseEvent *_event)
 
   if (_event->button() == Qt::LeftButton)
   {
-    m_win.origX = position.x();
-    m_win.origY = position.y();
-    m_win.rotate = true;
+    _win.origX = position.x();
+    _win.origY = position.y();
+    _win.rotate = true;
   }
   // right mouse translate mode
   else if (_event->button() == Qt::RightButton)
   {
-    m_win.origXPos = position.x();
-    m_win.origYPos = position.y();
-    m_win.translate = true;
+    _win.origXPos = position.x();
+    _win.origYPos = position.y();
+    _win.translate = true;
   }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void NGLScene::mouseReleaseEvent(QMouseEvent *_event)
+void NGLScene::releaseCamera(WinParams &_win, QMouseEvent *_event)
 {
 
   // that event is called when the mouse button is released
   // we then set Rotate to false
   if (_event->button() == Qt::LeftButton)
   {
-    m_win.rotate = false;
+    _win.rotate = false;
   }
   // right mouse translate mode
   if (_event->button() == Qt::RightButton)
   {
-    m_win.translate = false;
+    _win.translate = false;
   }
 }
 
 //----------------------------------------------------------------------------------------------------------------------
-void NGLScene::wheelEvent(QWheelEvent *_event)
+bool NGLScene::wheelCamera(ngl::Vec3 &_modelPos, QWheelEvent *_event)
 {
 
   // check the diff of the wheel position (0 means no change)
   if (_event->angleDelta().y() > 0)
   {
-    m_modelPos.m_z += ZOOM;
+    _modelPos.m_z += ZOOM;
   }
   else if (_event->angleDelta().y() < 0)
   {
-    m_modelPos.m_z -= ZOOM;
+    _modelPos.m_z -= ZOOM;
   }
-  update();
+  return _event->angleDelta().y() != 0;
 }
@@ -0,0 +1,193 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+void rollingStats(const std::deque<float> &_history, float &o_avg, float &o_p99)
+{
+  if (_history.empty())
+  {
+    o_avg = o_p99 = 0.0f;
+    return;
+  }
+  std::vector<float> sorted(_history.begin(), _history.end());
+  std::sort(sorted.begin(), sorted.end());
+  float sum = 0.0f;
+  for (auto v : sorted)
+  {
+    sum += v;
+  }
+  o_avg = sum / sorted.size();
+  o_p99 = sorted[std::min(sorted.size() - 1, (sorted.size() * 99) / 100)];
+}
+} // end anon namespace
+
+Profiler::Scope::Scope(Profiler &_profiler, const char *_name, bool _gpu) : m_profiler(_profiler), m_section(_profiler.findSection(_name))
+{
+  if (_gpu)
+  {
+    m_startQuery = m_profiler.allocateQuery();
+    glQueryCounter(m_startQuery, GL_TIMESTAMP);
+  }
+  m_start = std::chrono::steady_clock::now();
+}
+
+Profiler::Scope::~Scope()
+{
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<float, std::milli> elapsed = end - m_start;
+  m_profiler.addSample(m_profiler.m_sections[m_section].cpu, elapsed.count());
+  if (m_profiler.m_tracing)
+  {
+    m_profiler.m_trace.push_back({m_section, false, m_profiler.cpuTraceTime(m_start), elapsed.count() * 1000.0});
+  }
+  if (m_startQuery != 0)
+  {
+    GLuint endQuery = m_profiler.allocateQuery();
+    glQueryCounter(endQuery, GL_TIMESTAMP);
+    m_profiler.m_frames[m_profiler.m_frame % FramesInFlight].records.push_back({m_section, m_startQuery, endQuery});
+  }
+}
+
+Profiler::~Profiler()
+{
+  for (auto &frame : m_frames)
+  {
+    if (!frame.pool.empty())
+    {
+      glDeleteQueries(static_cast<GLsizei>(frame.pool.size()), frame.pool.data());
+    }
+  }
+}
+
+size_t Profiler::findSection(const char *_name)
+{
+  for (size_t i = 0; i < m_sections.size(); ++i)
+  {
+    if (std::strcmp(m_sections[i].name, _name) == 0)
+    {
+      return i;
+    }
+  }
+  m_sections.push_back({_name, {}, {}});
+  return m_sections.size() - 1;
+}
+
+GLuint Profiler::allocateQuery()
+{
+  auto &frame = m_frames[m_frame % FramesInFlight];
+  if (frame.used == frame.pool.size())
+  {
+    GLuint id;
+    glGenQueries(1, &id);
+    frame.pool.push_back(id);
+  }
+  return frame.pool[frame.used++];
+}
+
+void Profiler::addSample(std::deque<float> &_history, float _ms)
+{
+  _history.push_back(_ms);
+  if (_history.size() > HistorySize)
+  {
+    _history.pop_front();
+  }
+}
+
+double Profiler::cpuTraceTime(std::chrono::steady_clock::time_point _time) const
+{
+  return std::chrono::duration<double, std::micro>(_time - m_traceEpoch).count();
+}
+
+void Profiler::collect(FrameQueries &_frame)
+{
+  if (_frame.records.empty())
+  {
+    return;
+  }
+  // queries complete in order so if the last one is ready they all are
+  GLint available = 0;
+  glGetQueryObjectiv(_frame.records.back().end, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available)
+  {
+    for (const auto &record : _frame.records)
+    {
+      GLuint64 start;
+      GLuint64 end;
+      glGetQueryObjectui64v(record.start, GL_QUERY_RESULT, &start);
+      glGetQueryObjectui64v(record.end, GL_QUERY_RESULT, &end);
+      addSample(m_sections[record.section].gpu, (end - start) / 1.0e6f);
+      if (m_tracing && static_cast<GLint64>(start) >= m_gpuTraceEpoch)
+      {
+        m_trace.push_back({record.section, true, (start - m_gpuTraceEpoch) / 1000.0, (end - start) / 1000.0});
+      }
+    }
+  }
+}
+
+void Profiler::beginFrame()
+{
+  ++m_frame;
+  auto &frame = m_frames[m_frame % FramesInFlight];
+  collect(frame);
+  frame.records.clear();
+  frame.used = 0;
+}
+
+Profiler::Stats Profiler::stats(const std::string &_name) const
+{
+  Stats s;
+  for (const auto &section : m_sections)
+  {
+    if (_name == section.name)
+    {
+      rollingStats(section.cpu, s.cpuAvg, s.cpuP99);
+      rollingStats(section.gpu, s.gpuAvg, s.gpuP99);
+    }
+  }
+  return s;
+}
+
+std::vector<std::string> Profiler::summary() const
+{
+  std::vector<std::string> lines;
+  lines.push_back(fmt::format("{0:<14} {1:>15} {2:>15}", "ms avg / p99", "cpu", "gpu"));
+  for (const auto &section : m_sections)
+  {
+    auto s = stats(section.name);
+    lines.push_back(fmt::format("{0:<14} {1:>7.2f}/{2:<7.2f} {3:>7.2f}/{4:<7.2f}", section.name, s.cpuAvg, s.cpuP99, s.gpuAvg, s.gpuP99));
+  }
+  return lines;
+}
+
+void Profiler::startTrace()
+{
+  m_trace.clear();
+  // both clocks are sampled together so GPU events line up with the CPU ones
+  m_traceEpoch = std::chrono::steady_clock::now();
+  glGetInteger64v(GL_TIMESTAMP, &m_gpuTraceEpoch);
+  m_tracing = true;
+}
+
+bool Profiler::stopTrace(const std::string &_fileName)
+{
+  m_tracing = false;
+  std::ofstream file(_fileName);
+  if (!file)
+  {
+    return false;
+  }
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+  file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+  for (const auto &event : m_trace)
+  {
+    file << fmt::format(",\n{{\"name\": \"{0}\", \"cat\": \"{1}\", \"ph\": \"X\", \"pid\": 1, \"tid\": {2}, \"ts\": {3:.3f}, \"dur\": {4:.3f}}}",
+                        m_sections[event.section].name, event.gpu ? "gpu" : "cpu", event.gpu ? 2 : 1, event.startUs, event.durationUs);
+  }
+  file << "\n]}\n";
+  m_trace.clear();
+  return static_cast<bool>(file);
+}
@@ -0,0 +1,287 @@
+#include "RenderWindow.h"
+#include <ngl/NGLMessage.h>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QOpenGLContext>
+#include <QResizeEvent>
+#include <QThread>
+#include <algorithm>
+#include <cstdlib>
+
+RenderWindow::RenderWindow(std::unique_ptr<NGLScene> _scene) : m_scene(std::move(_scene))
+{
+  setSurfaceType(QWindow::OpenGLSurface);
+  setTitle("Multiple Point Lights");
+  // the background link needs an offscreen surface made on this thread, and a compile on the render thread no
+  // longer stalls input anyway
+  m_scene->setPrecompileShaders(false);
+}
+
+RenderWindow::~RenderWindow()
+{
+  if (m_thread)
+  {
+    m_quit = true;
+    wake();
+    m_thread->wait();
+    // the render thread handed the context back, the scene's dtor releases its GL objects with it
+    m_context->makeCurrent(this);
+  }
+  m_scene.reset();
+}
+
+void RenderWindow::start()
+{
+  m_context = std::make_unique<QOpenGLContext>();
+  m_context->setFormat(requestedFormat());
+  if (!m_context->create())
+  {
+    ngl::NGLMessage::addError("unable to create the render thread's context");
+    m_context.reset();
+    return;
+  }
+  m_thread.reset(QThread::create([this]() { renderLoop(); }));
+  // makeCurrent must be called from the thread the context lives in
+  m_context->moveToThread(m_thread.get());
+  m_thread->start();
+  m_timer = startTimer(1000);
+}
+
+void RenderWindow::renderLoop()
+{
+  m_context->makeCurrent(this);
+  m_scene->initializeGL();
+  // a window surface draws to the context's framebuffer, the scene only looks it up itself when Qt drives it
+  m_scene->setRenderTarget(m_context->defaultFramebufferObject());
+  CameraSnapshot camera;
+  // inputs taken but not yet presented, and the newest camera input already timed so a snapshot the GUI thread
+  // published before it saw ours taken isn't timed twice
+  std::optional<Clock::time_point> waiting;
+  Clock::time_point lastCameraInput;
+  std::optional<Clock::time_point> lastPresent;
+  auto windowStart = Clock::now();
+  FrameStats window;
+  double frameMsSum = 0.0;
+  double paintMsSum = 0.0;
+  double latencyMsSum = 0.0;
+  while (!m_quit)
+  {
+    Command command;
+    while (m_commands.pop(command))
+    {
+      if (command.type == Command::Type::Key)
+      {
+        m_scene->handleKey(command.key);
+        waiting = std::min(waiting.value_or(command.time), command.time);
+      }
+      else
+      {
+        m_scene->newLightSet();
+      }
+    }
+    if (m_cameras.update())
+    {
+      auto &next = m_cameras.front();
+      m_consumed.store(next.sequence, std::memory_order_release);
+      window.coalesced += static_cast<size_t>(next.sequence - camera.sequence - 1);
+      if (next.width != camera.width || next.height != camera.height)
+      {
+        m_scene->resizeGL(next.width, next.height);
+      }
+      m_scene->setCamera(next.spinX, next.spinY, next.modelPos);
+      if (next.input && *next.input > lastCameraInput)
+      {
+        lastCameraInput = *next.input;
+        waiting = std::min(waiting.value_or(lastCameraInput), lastCameraInput);
+      }
+      camera = next;
+    }
+    // swapping a window that isn't exposed is undefined, and with no vsync to block on the loop would spin
+    if (!m_exposed.load(std::memory_order_acquire) || !m_scene->needsFrame())
+    {
+      m_scene->idle();
+      lastPresent.reset();
+      std::unique_lock<std::mutex> lock(m_wakeMutex);
+      m_wakeCondition.wait(lock, [this]() { return m_woken; });
+      m_woken = false;
+      continue;
+    }
+    auto paintStart = Clock::now();
+    m_scene->paintGL();
+    std::chrono::duration<double, std::milli> paint = Clock::now() - paintStart;
+    // blocks for vsync, which paces this thread rather than the GUI's
+    m_context->swapBuffers(this);
+    auto now = Clock::now();
+    ++window.frames;
+    paintMsSum += paint.count();
+    if (lastPresent)
+    {
+      std::chrono::duration<double, std::milli> frame = now - *lastPresent;
+      frameMsSum += frame.count();
+      window.frameMsMax = std::max(window.frameMsMax, static_cast<float>(frame.count()));
+    }
+    lastPresent = now;
+    if (auto editMs = m_scene->takeLightEditMs())
+    {
+      window.lightEditMs = editMs;
+    }
+    if (waiting)
+    {
+      std::chrono::duration<double, std::milli> latency = now - *waiting;
+      latencyMsSum += latency.count();
+      window.latencyMsMax = std::max(window.latencyMsMax, static_cast<float>(latency.count()));
+      ++window.inputs;
+      waiting.reset();
+    }
+    if (now - windowStart >= std::chrono::seconds(1))
+    {
+      window.frameMs = static_cast<float>(frameMsSum / std::max<size_t>(window.frames - 1, 1));
+      window.paintMs = static_cast<float>(paintMsSum / window.frames);
+      window.latencyMs = window.inputs > 0 ? static_cast<float>(latencyMsSum / window.inputs) : 0.0f;
+      window.lights = m_scene->lights().size();
+      m_stats.back() = window;
+      m_stats.publish();
+      // the scene's own report never runs without its timer, so its counters are restarted here
+      m_scene->resetFrameStats();
+      window = FrameStats();
+      frameMsSum = paintMsSum = latencyMsSum = 0.0;
+      windowStart = now;
+    }
+  }
+  m_context->doneCurrent();
+  m_context->moveToThread(qGuiApp->thread());
+}
+
+void RenderWindow::publishCamera(bool _input)
+{
+  // once the render thread has taken everything published, the next input starts a new wait
+  if (m_consumed.load(std::memory_order_acquire) == m_sequence)
+  {
+    m_firstInput.reset();
+  }
+  if (_input && !m_firstInput)
+  {
+    m_firstInput = Clock::now();
+  }
+  auto &snapshot = m_cameras.back();
+  snapshot.spinX = m_win.spinXFace;
+  snapshot.spinY = m_win.spinYFace;
+  snapshot.modelPos = m_modelPos;
+  snapshot.width = m_win.width;
+  snapshot.height = m_win.height;
+  snapshot.sequence = ++m_sequence;
+  snapshot.input = m_firstInput;
+  m_cameras.publish();
+  wake();
+}
+
+void RenderWindow::pushCommand(const Command &_command)
+{
+  if (!m_commands.push(_command))
+  {
+    ngl::NGLMessage::addWarning("render thread command queue full, input dropped");
+    return;
+  }
+  wake();
+}
+
+void RenderWindow::wake()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_woken = true;
+  }
+  m_wakeCondition.notify_one();
+}
+
+void RenderWindow::reportStats()
+{
+  // nothing new means the render thread drew nothing for the last second
+  bool drawing = m_stats.update();
+  auto &stats = m_stats.front();
+  setTitle(QString(fmt::format("Lights {0} : render thread {1:.0f} fps frame {2:.2f} ms max {3:.2f} ms paintGL {4:.2f} ms : "
+                               "input latency {5:.2f} ms max {6:.2f} ms in {7} frames, {8} camera snapshots coalesced{10}{9}",
+                               stats.lights, stats.frameMs > 0.0f ? 1000.0f / stats.frameMs : 0.0f, stats.frameMs, stats.frameMsMax,
+                               stats.paintMs, stats.latencyMs, stats.latencyMsMax, stats.inputs, stats.coalesced,
+                               drawing ? "" : " : idle",
+                               stats.lightEditMs ? fmt::format(" : light count edit {0:.2f} ms", *stats.lightEditMs) : std::string())
+                       .c_str()));
+}
+
+void RenderWindow::exposeEvent(QExposeEvent *)
+{
+  m_exposed.store(isExposed(), std::memory_order_release);
+  if (!isExposed())
+  {
+    return;
+  }
+  if (!m_thread)
+  {
+    start();
+  }
+  // whatever was on screen may be gone, have it drawn again
+  publishCamera(false);
+}
+
+void RenderWindow::resizeEvent(QResizeEvent *_event)
+{
+  m_win.width = _event->size().width();
+  m_win.height = _event->size().height();
+  publishCamera(false);
+}
+
+void RenderWindow::keyPressEvent(QKeyEvent *_event)
+{
+  switch (_event->key())
+  {
+  // the window itself belongs to this thread, everything else is the scene's and handled on the render thread
+  case Qt::Key_Escape:
+    QGuiApplication::exit(EXIT_SUCCESS);
+    break;
+  case Qt::Key_F:
+    showFullScreen();
+    break;
+  case Qt::Key_N:
+    showNormal();
+    break;
+  default:
+    pushCommand({Command::Type::Key, _event->key(), Clock::now()});
+    break;
+  }
+}
+
+void RenderWindow::mouseMoveEvent(QMouseEvent *_event)
+{
+  if (NGLScene::dragCamera(m_win, m_modelPos, _event))
+  {
+    publishCamera(true);
+  }
+}
+
+void RenderWindow::mousePressEvent(QMouseEvent *_event)
+{
+  NGLScene::pressCamera(m_win, _event);
+}
+
+void RenderWindow::mouseReleaseEvent(QMouseEvent *_event)
+{
+  NGLScene::releaseCamera(m_win, _event);
+}
+
+void RenderWindow::wheelEvent(QWheelEvent *_event)
+{
+  if (NGLScene::wheelCamera(m_modelPos, _event))
+  {
+    publishCamera(true);
+  }
+}
+
+void RenderWindow::timerEvent(QTimerEvent *_event)
+{
+  if (_event->timerId() == m_timer)
+  {
+    reportStats();
+    pushCommand({Command::Type::NewLights, 0, Clock::now()});
+  }
+}
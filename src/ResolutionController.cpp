@@ -0,0 +1,27 @@
+#include "ResolutionController.h"
+#include <algorithm>
+#include <cmath>
+
+// fraction of the way to the ideal scale moved per measurement, and how far off it must be before
+// the scale changes at all
+constexpr float Response = 0.3f;
+constexpr float DeadBand = 0.02f;
+
+float ResolutionController::update(float _frameMs, float _scaledMs, float _scale)
+{
+  if (!enabled() || _frameMs <= 0.0f || _scale <= 0.0f)
+  {
+    return m_scale;
+  }
+  // cost per unit of scaled area and the cost that doesn't change with it
+  float areaMs = std::max(_scaledMs, 1.0e-3f) / (_scale * _scale);
+  float fixedMs = std::max(_frameMs - _scaledMs, 0.0f);
+  // if the fixed part alone misses the target the best we can do is the smallest scale
+  float budgetMs = std::max(m_targetMs - fixedMs, 0.0f);
+  float ideal = std::clamp(std::sqrt(budgetMs / areaMs), MinScale, MaxScale);
+  if (std::abs(ideal - m_scale) >= DeadBand)
+  {
+    m_scale = std::clamp(m_scale + (ideal - m_scale) * Response, MinScale, MaxScale);
+  }
+  return m_scale;
+}
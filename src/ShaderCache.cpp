@@ -0,0 +1,415 @@
+#include "ShaderCache.h"
+#include <ngl/ShaderLib.h>
+#include <ngl/NGLMessage.h>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+constexpr char Magic[4] = {'L', 'S', 'C', 'B'};
+constexpr uint32_t FormatVersion = 1;
+
+// FNV-1a, only used to tell sources apart
+uint64_t hashString(const std::string &_s, uint64_t _hash = 14695981039346656037ULL)
+{
+  for (auto c : _s)
+  {
+    _hash ^= static_cast<unsigned char>(c);
+    _hash *= 1099511628211ULL;
+  }
+  return _hash;
+}
+
+std::string readFile(const std::string &_path)
+{
+  std::ifstream file(_path, std::ios::binary);
+  std::stringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+// the defines must follow #version, which has to be the first statement
+std::string addDefines(std::string _source, const std::vector<std::string> &_defines)
+{
+  std::string block;
+  for (const auto &define : _defines)
+  {
+    block += "#define " + define + "\n";
+  }
+  auto version = _source.find("#version");
+  auto insert = version == std::string::npos ? 0 : _source.find('\n', version);
+  _source.insert(insert == std::string::npos ? _source.size() : insert + 1, block);
+  return _source;
+}
+
+template <typename T>
+void writeValue(std::ofstream &_file, const T &_value)
+{
+  _file.write(reinterpret_cast<const char *>(&_value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::ifstream &_file, T &_value)
+{
+  return static_cast<bool>(_file.read(reinterpret_cast<char *>(&_value), sizeof(T)));
+}
+
+// plain GL rather than ShaderLib, which is not thread safe
+GLuint compileStage(GLenum _type, const std::string &_source)
+{
+  auto shader = glCreateShader(_type);
+  auto text = _source.c_str();
+  glShaderSource(shader, 1, &text, nullptr);
+  glCompileShader(shader);
+  GLint compiled = 0;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+  if (!compiled)
+  {
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+} // end anon namespace
+
+ShaderCache::ShaderCache() = default;
+
+ShaderCache::~ShaderCache()
+{
+  waitForPrecompile();
+}
+
+ShaderCache::Stats ShaderCache::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+void ShaderCache::clear()
+{
+  waitForPrecompile();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_binaries.clear();
+  }
+  std::error_code error;
+  if (m_directory.empty() || !std::filesystem::is_directory(m_directory, error))
+  {
+    return;
+  }
+  for (const auto &entry : std::filesystem::directory_iterator(m_directory, error))
+  {
+    if (entry.path().extension() == ".bin")
+    {
+      std::filesystem::remove(entry.path(), error);
+    }
+  }
+}
+
+void ShaderCache::queryDriver()
+{
+  if (!m_driver.empty())
+  {
+    return;
+  }
+  for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+  {
+    auto value = glGetString(name);
+    m_driver += value != nullptr ? reinterpret_cast<const char *>(value) : "";
+    m_driver += '|';
+  }
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  m_binariesSupported = formats > 0;
+}
+
+ShaderCache::Sources ShaderCache::readSources(const Variant &_variant) const
+{
+  Sources sources;
+  if (!_variant.compute.empty())
+  {
+    sources.compute = addDefines(readFile(_variant.compute), _variant.defines);
+    sources.hash = hashString(sources.compute) ^ 0xfe;
+    return sources;
+  }
+  sources.vertex = addDefines(readFile(_variant.vertex), _variant.defines);
+  sources.fragment = addDefines(readFile(_variant.fragment), _variant.defines);
+  sources.hash = hashString(sources.fragment, hashString(sources.vertex) ^ 0xff);
+  return sources;
+}
+
+std::string ShaderCache::cacheFile(const std::string &_name, uint64_t _hash) const
+{
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(_hash));
+  return (std::filesystem::path(m_directory) / (_name + "-" + hex + ".bin")).string();
+}
+
+ShaderCache::Origin ShaderCache::findBinary(const std::string &_name, uint64_t _hash, Binary &_binary)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto binary = m_binaries.find(_hash);
+    if (binary != m_binaries.end())
+    {
+      _binary = binary->second;
+      return Origin::Memory;
+    }
+  }
+  if (m_directory.empty())
+  {
+    return Origin::None;
+  }
+  std::ifstream file(cacheFile(_name, _hash), std::ios::binary);
+  char magic[4];
+  uint32_t version = 0;
+  uint32_t driverSize = 0;
+  if (!file || !file.read(magic, 4) || std::memcmp(magic, Magic, 4) != 0 || !readValue(file, version) ||
+      version != FormatVersion || !readValue(file, driverSize) || driverSize != m_driver.size())
+  {
+    return Origin::None;
+  }
+  std::string driver(driverSize, '\0');
+  uint64_t hash = 0;
+  uint64_t size = 0;
+  if (!file.read(driver.data(), driverSize) || driver != m_driver || !readValue(file, hash) || hash != _hash ||
+      !readValue(file, _binary.format) || !readValue(file, size))
+  {
+    return Origin::None;
+  }
+  _binary.data.resize(size);
+  if (!file.read(_binary.data.data(), static_cast<std::streamsize>(size)))
+  {
+    return Origin::None;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_binaries[_hash] = _binary;
+  return Origin::Disk;
+}
+
+void ShaderCache::storeBinary(const std::string &_name, uint64_t _hash, Binary _binary)
+{
+  if (!m_directory.empty())
+  {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    // written under a per thread temporary name then renamed so a reader never sees half a file
+    auto path = cacheFile(_name, _hash);
+    auto temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+      std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+      file.write(Magic, 4);
+      writeValue(file, FormatVersion);
+      writeValue(file, static_cast<uint32_t>(m_driver.size()));
+      file.write(m_driver.data(), static_cast<std::streamsize>(m_driver.size()));
+      writeValue(file, _hash);
+      writeValue(file, _binary.format);
+      writeValue(file, static_cast<uint64_t>(_binary.data.size()));
+      file.write(_binary.data.data(), static_cast<std::streamsize>(_binary.data.size()));
+    }
+    std::filesystem::rename(temporary, path, error);
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_binaries[_hash] = std::move(_binary);
+}
+
+bool ShaderCache::load(const Variant &_variant)
+{
+  if (isLoaded(_variant.name))
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_stats.memoryHits;
+    return true;
+  }
+  if (hasFailed(_variant.name))
+  {
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  queryDriver();
+  auto sources = readSources(_variant);
+  ngl::ShaderLib::createShaderProgram(_variant.name);
+  auto id = ngl::ShaderLib::getProgramID(_variant.name);
+
+  bool linked = false;
+  Binary binary;
+  auto origin = m_binariesSupported ? findBinary(_variant.name, sources.hash, binary) : Origin::None;
+  if (origin != Origin::None)
+  {
+    glProgramBinary(id, binary.format, binary.data.data(), static_cast<GLsizei>(binary.data.size()));
+    GLint status = 0;
+    glGetProgramiv(id, GL_LINK_STATUS, &status);
+    linked = status == GL_TRUE;
+    if (linked)
+    {
+      // ShaderLib looks uniforms up by name and normally registers them when it links
+      ngl::ShaderLib::autoRegisterUniforms(_variant.name);
+    }
+  }
+  if (!linked)
+  {
+    // a rejected binary (driver update) leaves the program unlinked so the source path can reuse it
+    origin = Origin::None;
+    if (!sources.compute.empty())
+    {
+      auto compute = _variant.name + "Compute";
+      ngl::ShaderLib::attachShader(compute, ngl::ShaderType::COMPUTE);
+      ngl::ShaderLib::loadShaderSourceFromString(compute, sources.compute);
+      ngl::ShaderLib::compileShader(compute);
+      ngl::ShaderLib::attachShaderToProgram(_variant.name, compute);
+    }
+    else
+    {
+      auto vertex = _variant.name + "Vertex";
+      auto fragment = _variant.name + "Fragment";
+      ngl::ShaderLib::attachShader(vertex, ngl::ShaderType::VERTEX);
+      ngl::ShaderLib::attachShader(fragment, ngl::ShaderType::FRAGMENT);
+      ngl::ShaderLib::loadShaderSourceFromString(vertex, sources.vertex);
+      ngl::ShaderLib::loadShaderSourceFromString(fragment, sources.fragment);
+      ngl::ShaderLib::compileShader(vertex);
+      ngl::ShaderLib::compileShader(fragment);
+      ngl::ShaderLib::attachShaderToProgram(_variant.name, vertex);
+      ngl::ShaderLib::attachShaderToProgram(_variant.name, fragment);
+    }
+    if (m_binariesSupported)
+    {
+      glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    linked = ngl::ShaderLib::linkProgramObject(_variant.name);
+    if (linked && m_binariesSupported)
+    {
+      GLint size = 0;
+      glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+      binary.data.resize(static_cast<size_t>(size));
+      glGetProgramBinary(id, size, nullptr, &binary.format, binary.data.data());
+      storeBinary(_variant.name, sources.hash, std::move(binary));
+    }
+  }
+  if (linked)
+  {
+    m_loaded.insert(_variant.name);
+  }
+  else
+  {
+    // remembered so a caller asking for it every frame doesn't rebuild it and repeat the compiler log each time
+    m_failed.insert(_variant.name);
+    ngl::NGLMessage::addWarning(fmt::format("shader {0} failed to build and will not be retried", _variant.name));
+  }
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_stats.memoryHits += origin == Origin::Memory ? 1 : 0;
+  m_stats.diskHits += origin == Origin::Disk ? 1 : 0;
+  m_stats.compiles += origin == Origin::None ? 1 : 0;
+  m_stats.loadMs += elapsed.count();
+  return linked;
+}
+
+void ShaderCache::precompile(std::vector<Variant> _variants)
+{
+  waitForPrecompile();
+  queryDriver();
+  auto current = QOpenGLContext::currentContext();
+  if (!m_binariesSupported || current == nullptr)
+  {
+    return;
+  }
+  // the sources are read here so the thread only does GL work and touches the binary table
+  std::vector<std::pair<std::string, Sources>> jobs;
+  for (const auto &variant : _variants)
+  {
+    if (!isLoaded(variant.name))
+    {
+      jobs.emplace_back(variant.name, readSources(variant));
+    }
+  }
+  if (jobs.empty())
+  {
+    return;
+  }
+  m_surface = std::make_unique<QOffscreenSurface>();
+  m_surface->setFormat(current->format());
+  m_surface->create();
+  m_context = std::make_unique<QOpenGLContext>();
+  m_context->setFormat(current->format());
+  m_context->setShareContext(current);
+  if (!m_context->create())
+  {
+    m_context.reset();
+    m_surface.reset();
+    return;
+  }
+  m_thread.reset(QThread::create(
+      [this, jobs = std::move(jobs)]()
+      {
+        if (!m_context->makeCurrent(m_surface.get()))
+        {
+          return;
+        }
+        for (const auto &[name, sources] : jobs)
+        {
+          Binary binary;
+          if (findBinary(name, sources.hash, binary) != Origin::None)
+          {
+            continue;
+          }
+          std::vector<GLuint> stages;
+          if (!sources.compute.empty())
+          {
+            stages.push_back(compileStage(GL_COMPUTE_SHADER, sources.compute));
+          }
+          else
+          {
+            stages.push_back(compileStage(GL_VERTEX_SHADER, sources.vertex));
+            stages.push_back(compileStage(GL_FRAGMENT_SHADER, sources.fragment));
+          }
+          auto program = glCreateProgram();
+          glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+          for (auto stage : stages)
+          {
+            glAttachShader(program, stage);
+          }
+          glLinkProgram(program);
+          GLint linked = 0;
+          glGetProgramiv(program, GL_LINK_STATUS, &linked);
+          if (std::find(stages.begin(), stages.end(), 0u) == stages.end() && linked)
+          {
+            GLint size = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+            binary.data.resize(static_cast<size_t>(size));
+            glGetProgramBinary(program, size, nullptr, &binary.format, binary.data.data());
+            storeBinary(name, sources.hash, std::move(binary));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.precompiled;
+          }
+          glDeleteProgram(program);
+          for (auto stage : stages)
+          {
+            glDeleteShader(stage);
+          }
+        }
+        m_context->doneCurrent();
+      }));
+  // makeCurrent must be called from the thread the context lives in
+  m_context->moveToThread(m_thread.get());
+  m_thread->start();
+}
+
+void ShaderCache::waitForPrecompile()
+{
+  if (m_thread)
+  {
+    m_thread->wait();
+    m_thread.reset();
+    m_context.reset();
+    m_surface.reset();
+  }
+}
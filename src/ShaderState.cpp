@@ -0,0 +1,125 @@
+#include "ShaderState.h"
+#include <ngl/ShaderLib.h>
+#include <cstring>
+
+void ShaderState::use(std::string_view _program)
+{
+  auto program = m_programs.find(_program);
+  if (program == m_programs.end())
+  {
+    program = m_programs.emplace(std::string(_program), Program()).first;
+    program->second.id = ngl::ShaderLib::getProgramID(_program);
+  }
+  m_current = &program->second;
+  if (ngl::ShaderLib::getCurrentShaderName() == _program)
+  {
+    ++m_stats.programSkips;
+    return;
+  }
+  ngl::ShaderLib::use(_program);
+  ++m_stats.programBinds;
+}
+
+GLint ShaderState::changed(std::string_view _name, const void *_value, size_t _size)
+{
+  if (m_current == nullptr)
+  {
+    return -1;
+  }
+  auto uniform = m_current->uniforms.find(_name);
+  if (uniform == m_current->uniforms.end())
+  {
+    std::string name(_name);
+    Uniform entry;
+    entry.location = glGetUniformLocation(m_current->id, name.c_str());
+    uniform = m_current->uniforms.emplace(std::move(name), std::move(entry)).first;
+  }
+  auto &entry = uniform->second;
+  auto bytes = static_cast<const unsigned char *>(_value);
+  // uniforms the compiler removed have no location, there is nothing to send
+  if (entry.location < 0 || (entry.value.size() == _size && std::memcmp(entry.value.data(), bytes, _size) == 0))
+  {
+    ++m_stats.uniformSkips;
+    return -1;
+  }
+  entry.value.assign(bytes, bytes + _size);
+  ++m_stats.uniformSets;
+  return entry.location;
+}
+
+void ShaderState::setUniform(std::string_view _name, int _value)
+{
+  auto location = changed(_name, &_value, sizeof(_value));
+  if (location >= 0)
+  {
+    glUniform1i(location, _value);
+  }
+}
+
+void ShaderState::setUniform(std::string_view _name, int _x, int _y)
+{
+  const int value[] = {_x, _y};
+  auto location = changed(_name, value, sizeof(value));
+  if (location >= 0)
+  {
+    glUniform2iv(location, 1, value);
+  }
+}
+
+void ShaderState::setUniform(std::string_view _name, int _x, int _y, int _z)
+{
+  const int value[] = {_x, _y, _z};
+  auto location = changed(_name, value, sizeof(value));
+  if (location >= 0)
+  {
+    glUniform3iv(location, 1, value);
+  }
+}
+
+void ShaderState::setUniform(std::string_view _name, float _value)
+{
+  auto location = changed(_name, &_value, sizeof(_value));
+  if (location >= 0)
+  {
+    glUniform1f(location, _value);
+  }
+}
+
+void ShaderState::setUniform(std::string_view _name, float _x, float _y, float _z)
+{
+  const float value[] = {_x, _y, _z};
+  auto location = changed(_name, value, sizeof(value));
+  if (location >= 0)
+  {
+    glUniform3fv(location, 1, value);
+  }
+}
+
+void ShaderState::setUniform(std::string_view _name, const ngl::Vec3 &_value)
+{
+  setUniform(_name, _value.m_x, _value.m_y, _value.m_z);
+}
+
+void ShaderState::setUniform(std::string_view _name, const ngl::Mat3 &_value)
+{
+  auto location = changed(_name, _value.m_openGL, sizeof(_value.m_openGL));
+  if (location >= 0)
+  {
+    glUniformMatrix3fv(location, 1, GL_FALSE, _value.m_openGL);
+  }
+}
+
+void ShaderState::setUniform(std::string_view _name, const ngl::Mat4 &_value)
+{
+  auto location = changed(_name, _value.m_openGL, sizeof(_value.m_openGL));
+  if (location >= 0)
+  {
+    glUniformMatrix4fv(location, 1, GL_FALSE, _value.m_openGL);
+  }
+}
+
+void ShaderState::beginFrame()
+{
+  m_lastFrame = m_stats;
+  m_stats = Stats();
+}
@@ -0,0 +1,381 @@
+#include "ShadowAtlas.h"
+#include "LightCuller.h"
+#include <ngl/Util.h>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+// the atlas is this many largest faces across and down, the tiers below fill it exactly
+constexpr int AtlasFacesX = 6;
+constexpr int AtlasFacesY = 8;
+// lights already holding a slot rank this much higher, so two lights of about the same influence don't swap slots
+// and re-render every frame
+constexpr float Hysteresis = 1.25f;
+// the near plane as a fraction of the light radius
+constexpr float NearFraction = 0.01f;
+// slope scaled bias while rendering the views, the shader adds no bias of its own
+constexpr float OffsetFactor = 2.0f;
+constexpr float OffsetUnits = 4.0f;
+// cube face axes and up vectors, any consistent set works as the shader picks the face by the major axis and
+// projects with the same matrix
+const ngl::Vec3 FaceDirections[6] = {{1.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f},
+                                     {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}};
+const ngl::Vec3 FaceUps[6] = {{0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+                              {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, -1.0f, 0.0f}};
+
+// a face sees the 90 degree pyramid where its axis is the major one, so a sphere is in it unless it is wholly
+// behind one of the four side planes
+bool sphereInFace(int _face, const float *_offset, float _radius)
+{
+  int axis = _face / 2;
+  float along = _face % 2 == 0 ? _offset[axis] : -_offset[axis];
+  float reach = _radius * std::sqrt(2.0f);
+  for (int other = 0; other < 3; ++other)
+  {
+    if (other != axis && (along + _offset[other] < -reach || along - _offset[other] < -reach))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+} // end anon namespace
+
+ShadowAtlas::~ShadowAtlas()
+{
+  if (m_slotBuffer != 0)
+  {
+    releaseAtlas();
+    GLuint buffers[] = {m_slotBuffer, m_lightSlotBuffer};
+    glDeleteBuffers(2, buffers);
+  }
+}
+
+void ShadowAtlas::create(GLuint _slotBinding, GLuint _lightSlotBinding)
+{
+  m_slotBinding = _slotBinding;
+  m_lightSlotBinding = _lightSlotBinding;
+  glGenBuffers(1, &m_slotBuffer);
+  glGenBuffers(1, &m_lightSlotBuffer);
+}
+
+void ShadowAtlas::setFaceSize(int _size)
+{
+  auto size = std::clamp(_size, MinFaceSize, MaxFaceSize);
+  if (size != m_faceSize)
+  {
+    m_faceSize = size;
+    m_atlasDirty = true;
+  }
+}
+
+void ShadowAtlas::releaseAtlas()
+{
+  if (m_atlas != 0)
+  {
+    glDeleteFramebuffers(1, &m_fbo);
+    glDeleteTextures(1, &m_atlas);
+    m_atlas = 0;
+  }
+}
+
+void ShadowAtlas::allocateAtlas()
+{
+  releaseAtlas();
+  int width = AtlasFacesX * m_faceSize;
+  int height = AtlasFacesY * m_faceSize;
+  glGenTextures(1, &m_atlas);
+  glBindTexture(GL_TEXTURE_2D, m_atlas);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+  // hardware comparison with linear filtering gives 2x2 PCF for free
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenFramebuffers(1, &m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_atlas, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  const GLfloat farDepth = 1.0f;
+  glClearBufferfv(GL_DEPTH, 0, &farDepth);
+
+  // each tier fills whole rows of 3 x 2 face blocks, a half size tier fits twice as many blocks in a row
+  m_slots.clear();
+  int y = 0;
+  for (size_t tier = 0; tier < TierSlots.size(); ++tier)
+  {
+    int size = m_faceSize >> tier;
+    int perRow = width / (3 * size);
+    for (size_t i = 0; i < TierSlots[tier]; ++i)
+    {
+      Slot slot;
+      slot.tier = tier;
+      slot.size = size;
+      slot.x = static_cast<int>(i % perRow) * 3 * size;
+      slot.y = y + static_cast<int>(i / perRow) * 2 * size;
+      m_slots.push_back(slot);
+    }
+    y += static_cast<int>((TierSlots[tier] + perRow - 1) / perRow) * 2 * size;
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_slotBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_slots.size() * sizeof(GPUSlot)), nullptr, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  m_atlasDirty = false;
+  // every view was in the old atlas
+  m_lightsDirty = true;
+}
+
+void ShadowAtlas::resetSlots(size_t _numLights)
+{
+  m_numLights = _numLights;
+  m_lightSlots.assign(_numLights, -1);
+  for (auto &slot : m_slots)
+  {
+    slot.light = NoLight;
+    slot.published = false;
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightSlotBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(std::max<size_t>(_numLights, 1) * sizeof(int32_t)),
+               m_lightSlots.empty() ? nullptr : m_lightSlots.data(), GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  m_lightsDirty = false;
+}
+
+void ShadowAtlas::setLightSlot(uint32_t _light, int32_t _slot)
+{
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightSlotBuffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(_light * sizeof(int32_t)), sizeof(int32_t), &_slot);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ShadowAtlas::rankLights(const LightSoA &_lights, size_t _numLights, const ngl::Mat4 &_viewProject, float _projectScale,
+                             const ngl::Vec3 &_eye, const Casters &_casters)
+{
+  auto planes = LightCuller::frustumPlanes(_viewProject);
+  m_ranked.clear();
+  for (uint32_t i = 0; i < _numLights; ++i)
+  {
+    float x = _lights.x[i];
+    float y = _lights.y[i];
+    float z = _lights.z[i];
+    float radius = _lights.radius[i];
+    // a light that can't reach a caster has nothing to cast
+    float cx = x - _casters.centre.m_x;
+    float cy = y - _casters.centre.m_y;
+    float cz = z - _casters.centre.m_z;
+    float reach = radius + _casters.radius;
+    if (cx * cx + cy * cy + cz * cz > reach * reach)
+    {
+      continue;
+    }
+    bool visible = true;
+    for (const auto &plane : planes)
+    {
+      visible &= plane[0] * x + plane[1] * y + plane[2] * z + plane[3] > -radius;
+    }
+    if (!visible)
+    {
+      continue;
+    }
+    // the screen area of the influence sphere as a fraction of the screen height squared, all of it once the eye is
+    // inside
+    float ex = x - _eye.m_x;
+    float ey = y - _eye.m_y;
+    float ez = z - _eye.m_z;
+    float distance = std::sqrt(ex * ex + ey * ey + ez * ez);
+    float extent = distance > radius ? std::min(radius * _projectScale / distance, 1.0f) : 1.0f;
+    float priority = extent * extent;
+    if (m_lightSlots[i] >= 0)
+    {
+      priority *= Hysteresis;
+    }
+    m_ranked.emplace_back(priority, i);
+  }
+  auto capacity = std::min(m_ranked.size(), m_slots.size());
+  std::partial_sort(m_ranked.begin(), m_ranked.begin() + capacity, m_ranked.end(), std::greater<>());
+  m_ranked.resize(capacity);
+}
+
+void ShadowAtlas::assignSlots()
+{
+  // the rank a light needs for each tier, the best TierSlots[0] get the first and so on
+  auto tierOf = [](size_t _rank)
+  {
+    size_t tier = 0;
+    while (_rank >= TierSlots[tier])
+    {
+      _rank -= TierSlots[tier++];
+    }
+    return tier;
+  };
+  std::vector<size_t> wanted(m_ranked.size());
+  for (size_t rank = 0; rank < m_ranked.size(); ++rank)
+  {
+    wanted[rank] = tierOf(rank);
+  }
+  // free the slots whose light has dropped out or moved to another tier
+  for (auto &slot : m_slots)
+  {
+    if (slot.light == NoLight)
+    {
+      continue;
+    }
+    auto ranked = std::find_if(m_ranked.begin(), m_ranked.end(), [&slot](const auto &_entry) { return _entry.second == slot.light; });
+    if (ranked != m_ranked.end() && wanted[ranked - m_ranked.begin()] == slot.tier)
+    {
+      slot.priority = ranked->first;
+      continue;
+    }
+    if (slot.published)
+    {
+      setLightSlot(slot.light, -1);
+    }
+    m_lightSlots[slot.light] = -1;
+    slot.light = NoLight;
+    slot.published = false;
+  }
+  // then give the newcomers the free slots of their tier
+  for (size_t rank = 0; rank < m_ranked.size(); ++rank)
+  {
+    auto light = m_ranked[rank].second;
+    if (m_lightSlots[light] >= 0)
+    {
+      continue;
+    }
+    auto free = std::find_if(m_slots.begin(), m_slots.end(),
+                             [tier = wanted[rank]](const Slot &_slot) { return _slot.tier == tier && _slot.light == NoLight; });
+    free->light = light;
+    free->priority = m_ranked[rank].first;
+    m_lightSlots[light] = static_cast<int32_t>(free - m_slots.begin());
+  }
+}
+
+bool ShadowAtlas::stale(const Slot &_slot, const LightSoA &_lights, const Casters &_casters) const
+{
+  return !_slot.published || _slot.casterVersion != _casters.version || _slot.position[0] != _lights.x[_slot.light] ||
+         _slot.position[1] != _lights.y[_slot.light] || _slot.position[2] != _lights.z[_slot.light] || _slot.radius != _lights.radius[_slot.light];
+}
+
+void ShadowAtlas::renderSlot(Slot &_slot, size_t _index, const LightSoA &_lights, const Casters &_casters, const DrawCasters &_draw)
+{
+  ngl::Vec3 position(_lights.x[_slot.light], _lights.y[_slot.light], _lights.z[_slot.light]);
+  float radius = _lights.radius[_slot.light];
+  auto project = ngl::perspective(90.0f, 1.0f, radius * NearFraction, radius);
+  float offset[3] = {_casters.centre.m_x - position.m_x, _casters.centre.m_y - position.m_y, _casters.centre.m_z - position.m_z};
+  // the whole block is cleared so the faces with nothing in them read as unoccluded
+  glScissor(_slot.x, _slot.y, 3 * _slot.size, 2 * _slot.size);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  GPUSlot gpu;
+  for (int face = 0; face < 6; ++face)
+  {
+    auto view = ngl::lookAt(position, position + FaceDirections[face], FaceUps[face]);
+    gpu.faces[face] = project * view;
+    if (!sphereInFace(face, offset, _casters.radius))
+    {
+      ++m_stats.emptyViews;
+      continue;
+    }
+    glViewport(_slot.x + (face % 3) * _slot.size, _slot.y + (face / 3) * _slot.size, _slot.size, _slot.size);
+    _draw(view, project);
+    ++m_stats.renderedViews;
+  }
+  float width = static_cast<float>(AtlasFacesX * m_faceSize);
+  float height = static_cast<float>(AtlasFacesY * m_faceSize);
+  gpu.rect[0] = _slot.x / width;
+  gpu.rect[1] = _slot.y / height;
+  gpu.rect[2] = _slot.size / width;
+  gpu.rect[3] = _slot.size / height;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_slotBuffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, static_cast<GLintptr>(_index * sizeof(GPUSlot)), sizeof(GPUSlot), &gpu);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  _slot.position[0] = position.m_x;
+  _slot.position[1] = position.m_y;
+  _slot.position[2] = position.m_z;
+  _slot.radius = radius;
+  _slot.casterVersion = _casters.version;
+  _slot.renderedFrame = m_frame;
+  if (!_slot.published)
+  {
+    setLightSlot(_slot.light, static_cast<int32_t>(_index));
+    _slot.published = true;
+  }
+}
+
+void ShadowAtlas::update(const LightSoA &_lights, size_t _numLights, const ngl::Mat4 &_viewProject, float _projectScale,
+                         const ngl::Vec3 &_eye, const Casters &_casters, const DrawCasters &_draw)
+{
+  auto start = std::chrono::steady_clock::now();
+  m_stats = Stats();
+  if (m_atlasDirty)
+  {
+    allocateAtlas();
+  }
+  _numLights = std::min(_numLights, _lights.size());
+  if (m_lightsDirty || _numLights != m_numLights)
+  {
+    resetSlots(_numLights);
+  }
+  ++m_frame;
+  rankLights(_lights, _numLights, _viewProject, _projectScale, _eye, _casters);
+  assignSlots();
+
+  // the slots to bring up to date, ones with no views yet first then by rank times frames out of date
+  std::vector<std::pair<float, size_t>> stale;
+  for (size_t i = 0; i < m_slots.size(); ++i)
+  {
+    const auto &slot = m_slots[i];
+    if (slot.light != NoLight && this->stale(slot, _lights, _casters))
+    {
+      float score = slot.published ? slot.priority * static_cast<float>(m_frame - slot.renderedFrame) : std::numeric_limits<float>::max();
+      stale.emplace_back(score, i);
+    }
+  }
+  auto count = std::min(stale.size(), static_cast<size_t>(m_budget));
+  std::partial_sort(stale.begin(), stale.begin() + count, stale.end(), std::greater<>());
+  m_stats.staleLights = stale.size() - count;
+
+  if (count > 0)
+  {
+    GLint polygonMode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(OffsetFactor, OffsetUnits);
+    for (size_t i = 0; i < count; ++i)
+    {
+      renderSlot(m_slots[stale[i].second], stale[i].second, _lights, _casters, _draw);
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_SCISSOR_TEST);
+    glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(polygonMode[0]));
+  }
+  for (const auto &slot : m_slots)
+  {
+    if (slot.published)
+    {
+      ++m_stats.shadowedLights;
+      m_stats.reusedViews += slot.renderedFrame == m_frame ? 0 : 6;
+    }
+  }
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  m_stats.updateMs = elapsed.count();
+}
+
+void ShadowAtlas::bind(GLuint _unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + _unit);
+  glBindTexture(GL_TEXTURE_2D, m_atlas);
+  glActiveTexture(GL_TEXTURE0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_slotBinding, m_slotBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_lightSlotBinding, m_lightSlotBuffer);
+}
@@ -0,0 +1,205 @@
+#include "StochasticLights.h"
+#include "ShaderCache.h"
+#include "ShaderState.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <chrono>
+
+constexpr auto AccumulateShader = "StochasticAccumulate";
+constexpr auto ResolveShader = "StochasticResolve";
+// standard deviations the history may sit from the current frame's neighbourhood once anything moves
+constexpr float HistoryClip = 1.5f;
+
+StochasticLights::~StochasticLights()
+{
+  if (m_emptyVAO != 0)
+  {
+    releaseTargets();
+    glDeleteBuffers(1, &m_tableID);
+    glDeleteVertexArrays(1, &m_emptyVAO);
+  }
+}
+
+void StochasticLights::create(ShaderCache &_shaders, GLuint _tableBinding)
+{
+  m_tableBinding = _tableBinding;
+  _shaders.load({AccumulateShader, "shaders/DeferredResolveVertex.glsl", "shaders/StochasticAccumulateFragment.glsl", {}});
+  ngl::ShaderLib::use(AccumulateShader);
+  ngl::ShaderLib::setUniform("currentTex", 0);
+  ngl::ShaderLib::setUniform("historyTex", 1);
+  _shaders.load({ResolveShader, "shaders/DeferredResolveVertex.glsl", "shaders/StochasticResolveFragment.glsl", {}});
+  ngl::ShaderLib::use(ResolveShader);
+  ngl::ShaderLib::setUniform("historyTex", 1);
+  ngl::ShaderLib::setUniform("depthTex", 2);
+  glGenBuffers(1, &m_tableID);
+  glGenVertexArrays(1, &m_emptyVAO);
+}
+
+void StochasticLights::resize(int _width, int _height)
+{
+  m_width = std::max(_width, 1);
+  m_height = std::max(_height, 1);
+  m_targetsDirty = true;
+}
+
+void StochasticLights::buildTable(const LightSoA &_lights)
+{
+  auto start = std::chrono::steady_clock::now();
+  auto numLights = _lights.size();
+  m_table.resize(std::max<size_t>(numLights, 1));
+  m_scaled.resize(numLights);
+  double total = 0.0;
+  for (size_t i = 0; i < numLights; ++i)
+  {
+    m_scaled[i] = 0.2126f * _lights.r[i] + 0.7152f * _lights.g[i] + 0.0722f * _lights.b[i];
+    total += m_scaled[i];
+  }
+  // Vose's method, scale every probability by n so the mean is 1, then pair each light under 1 with one over to
+  // fill its slot. If every light is black the pick falls back to uniform
+  m_small.clear();
+  m_large.clear();
+  for (uint32_t i = 0; i < numLights; ++i)
+  {
+    float pdf = total > 0.0 ? static_cast<float>(m_scaled[i] / total) : 1.0f / numLights;
+    m_table[i].pdf = pdf;
+    m_table[i].pad = 0.0f;
+    m_scaled[i] = pdf * numLights;
+    (m_scaled[i] < 1.0f ? m_small : m_large).push_back(i);
+  }
+  while (!m_small.empty() && !m_large.empty())
+  {
+    auto small = m_small.back();
+    m_small.pop_back();
+    auto large = m_large.back();
+    m_table[small].threshold = m_scaled[small];
+    m_table[small].alias = large;
+    m_scaled[large] -= 1.0f - m_scaled[small];
+    if (m_scaled[large] < 1.0f)
+    {
+      m_large.pop_back();
+      m_small.push_back(large);
+    }
+  }
+  // whatever is left is 1 up to rounding
+  for (auto &remaining : {&m_small, &m_large})
+  {
+    for (auto i : *remaining)
+    {
+      m_table[i].threshold = 1.0f;
+      m_table[i].alias = i;
+    }
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_tableID);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_table.size() * sizeof(AliasEntry)), m_table.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  m_tableMs = elapsed.count();
+}
+
+void StochasticLights::releaseTargets()
+{
+  if (m_sceneFBO != 0)
+  {
+    glDeleteFramebuffers(1, &m_sceneFBO);
+    glDeleteFramebuffers(2, m_historyFBO.data());
+    GLuint textures[] = {m_colour, m_depth, m_history[0], m_history[1]};
+    glDeleteTextures(4, textures);
+    m_sceneFBO = 0;
+  }
+}
+
+void StochasticLights::allocateTargets()
+{
+  releaseTargets();
+  auto makeTexture = [this](GLenum _internalFormat)
+  {
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexStorage2D(GL_TEXTURE_2D, 1, _internalFormat, m_width, m_height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return id;
+  };
+  // the lighting is accumulated before tonemapping so it needs the range
+  m_colour = makeTexture(GL_RGBA16F);
+  m_depth = makeTexture(GL_DEPTH_COMPONENT32F);
+  glGenFramebuffers(1, &m_sceneFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colour, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depth, 0);
+  glGenFramebuffers(2, m_historyFBO.data());
+  for (size_t i = 0; i < m_history.size(); ++i)
+  {
+    m_history[i] = makeTexture(GL_RGBA16F);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_historyFBO[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_history[i], 0);
+    // the first blend gives the history no weight, but a NaN in new storage would survive that
+    const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, zero);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  m_targetsDirty = false;
+  m_frames = 0;
+}
+
+void StochasticLights::begin()
+{
+  if (m_targetsDirty)
+  {
+    allocateTargets();
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, m_sceneFBO);
+  glViewport(0, 0, m_width, m_height);
+  const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+  const GLfloat farDepth = 1.0f;
+  glClearBufferfv(GL_COLOR, 0, zero);
+  glClearBufferfv(GL_DEPTH, 0, &farDepth);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_tableBinding, m_tableID);
+}
+
+void StochasticLights::resolve(ShaderState &_state, bool _moved, GLuint _target)
+{
+  // a still view averages every frame so far, a moving one keeps a fixed share of clipped history
+  if (_moved)
+  {
+    m_frames = std::min(m_frames, MovingFrames - 1);
+  }
+  float blend = 1.0f / static_cast<float>(m_frames + 1);
+  m_frames = std::min(m_frames + 1, MaxFrames);
+  auto read = m_frameIndex % 2;
+  auto write = (m_frameIndex + 1) % 2;
+  ++m_frameIndex;
+
+  GLint polygonMode[2];
+  glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glBindVertexArray(m_emptyVAO);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, m_colour);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_history[read]);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, m_depth);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, m_historyFBO[write]);
+  glDisable(GL_DEPTH_TEST);
+  _state.use(AccumulateShader);
+  _state.setUniform("blend", blend);
+  _state.setUniform("historyClip", _moved ? HistoryClip : 0.0f);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  // resolve, writes our depth so anything drawn afterwards is occluded correctly
+  glBindFramebuffer(GL_FRAMEBUFFER, _target);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_history[write]);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(GL_ALWAYS);
+  _state.use(ResolveShader);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glDepthFunc(GL_LESS);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindVertexArray(0);
+  glPolygonMode(GL_FRONT_AND_BACK, static_cast<GLenum>(polygonMode[0]));
+}
@@ -2,14 +2,204 @@
 basic OpenGL demo modified from http://qt-project.org/doc/qt-5.0/qtgui/openglwindow.html
 ****************************************************************************/
 #include <QtGui/QGuiApplication>
+#include <QCommandLineParser>
+#include <QStandardPaths>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include "NGLScene.h"
+#include "RenderWindow.h"
+#include "Benchmark.h"
+#include "LightFile.h"
+#include "LightGenerator.h"
 
 
 
 int main(int argc, char **argv)
 {
   QGuiApplication app(argc, argv);
+  // command line, the scene options apply to both the window and the headless benchmark
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Multiple point lights demo");
+  parser.addHelpOption();
+  QCommandLineOption headlessOption("headless", "Render offscreen and write frame timings instead of opening a window.");
+  QCommandLineOption lightsOption("lights", "Number of lights.", "count", "8");
+  QCommandLineOption objectsOption("objects", "Number of teapots, more than 1 draws them instanced.", "count", "1");
+  QCommandLineOption seedOption("seed", "Random seed for the light positions and colours.", "seed");
+  QCommandLineOption deferredOption("deferred", "Use the deferred renderer.");
+  QCommandLineOption noClustersOption("no-clusters", "Shade every light for every fragment in the forward path.");
+  QCommandLineOption noGizmosOption("no-gizmos", "Don't draw the light gizmos.");
+  QCommandLineOption stochasticOption("stochastic", "Shade this many sampled lights per fragment in the forward path, 0 for every light.", "samples", "0");
+  QCommandLineOption depthPrepassOption("depth-prepass", "Draw the objects depth only first so the forward pass shades each pixel once.");
+  QCommandLineOption lightingScaleOption("lighting-scale", "Deferred light accumulation resolution as a fraction of the window, 0.25 to 1.", "scale", "1");
+  QCommandLineOption targetMsOption("target-ms", "Pick the deferred lighting resolution each frame to meet this GPU time.", "ms");
+  QCommandLineOption brdfOption("brdf", "Forward BRDF, reference, fast or lut.", "mode", "reference");
+  QCommandLineOption brdfToleranceOption("brdf-tolerance", "Headless, the largest RMSE a non reference BRDF may differ from the reference by.", "rmse", "0.01");
+  QCommandLineOption deferredToleranceOption("deferred-tolerance", "Headless, the largest RMSE the deferred frame may differ from forward by.", "rmse", "0.01");
+  QCommandLineOption lightFileOption("light-file", "Load the lights from a binary light file or a .json rig instead of generating them.", "file");
+  QCommandLineOption saveLightsOption("save-lights", "Write the lights (generated, or imported with --light-file) as a binary light file and exit.", "file");
+  QCommandLineOption lightFileBenchOption("light-file-bench", "Headless, time loading and uploading light files of 1k, 100k and 1M lights.");
+  QCommandLineOption shadowsOption("shadows", "Shadows for the forward path from a shared atlas of the most influential lights.");
+  QCommandLineOption shadowBudgetOption("shadow-budget", "Lights whose shadow views are re-rendered at most per frame.", "lights", "8");
+  QCommandLineOption shadowSizeOption("shadow-size", "Face size of the largest shadow slots, the atlas is 6 x 8 of them.", "pixels", "256");
+  QCommandLineOption lightCutoffOption("light-cutoff", "Radiance below which a light has no influence, sets the radii. By default 0.25 at 8 lights, rising with the count to keep them local.", "radiance");
+  QCommandLineOption cullLightsOption("cull-lights", "Cull the lights and gizmos against the view frustum on the CPU, the forward loop shades only those left.");
+  QCommandLineOption cullBenchOption("cull-bench", "Headless, time building, refitting and culling the light BVH at 1k, 100k and 1M lights.");
+  QCommandLineOption cpuReferenceOption("cpu-reference", "Headless, render the final frame on the CPU too and report the difference.");
+  QCommandLineOption cpuPngOption("cpu-png", "Headless, save the CPU reference frame to this PNG.", "file");
+  QCommandLineOption cpuBenchOption("cpu-bench", "Headless, time the CPU reference renderer over light and thread counts.");
+  QCommandLineOption animateOption("animate", "Animate the lights on the GPU.");
+  QCommandLineOption uncappedOption("uncapped", "Turn vsync off so the window draws as fast as it can.");
+  QCommandLineOption onDemandOption("on-demand", "Only draw the window when something on screen has changed.");
+  QCommandLineOption renderThreadOption("render-thread", "Render on a thread of its own, the GUI thread only handles input.");
+  QCommandLineOption pausedOption("paused", "Start with the teapot spin, light animation and new light sets stopped.");
+  QCommandLineOption lightBenchOption("light-bench", "Headless, time light generation and upload at 1k, 100k and 1M lights.");
+  QCommandLineOption shaderCacheOption("shader-cache", "Directory for cached program binaries, empty to keep them in memory only.", "dir",
+                                       QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders");
+  QCommandLineOption clearShaderCacheOption("clear-shader-cache", "Delete the cached program binaries first, for a cold start.");
+  QCommandLineOption noPrecompileOption("no-shader-precompile", "Don't link the other shader permutations in the background.");
+  QCommandLineOption widthOption("width", "Headless render width.", "pixels", "1024");
+  QCommandLineOption heightOption("height", "Headless render height.", "pixels", "720");
+  QCommandLineOption framesOption("frames", "Headless frames to time.", "count", "300");
+  QCommandLineOption warmupOption("warmup", "Headless frames to render before timing.", "count", "10");
+  QCommandLineOption outputOption("output", "Headless results file, .csv for CSV otherwise JSON. Defaults to stdout.", "file");
+  QCommandLineOption pngOption("png", "Headless, save the final frame to this PNG.", "file");
+  QCommandLineOption traceOption("trace", "Headless, write a Chrome trace of the timed frames to this file.", "file");
+  for (auto &option : {headlessOption, lightsOption, objectsOption, seedOption, deferredOption, noClustersOption,
+                       noGizmosOption, stochasticOption, depthPrepassOption, lightingScaleOption, targetMsOption,
+                       brdfOption, brdfToleranceOption, deferredToleranceOption, lightFileOption, saveLightsOption,
+                       lightFileBenchOption, cpuReferenceOption, cpuPngOption, cpuBenchOption, shadowsOption,
+                       shadowBudgetOption, shadowSizeOption, lightCutoffOption, cullLightsOption, cullBenchOption,
+                       animateOption, uncappedOption, onDemandOption, pausedOption, renderThreadOption,
+                       lightBenchOption, shaderCacheOption, clearShaderCacheOption, noPrecompileOption, widthOption,
+                       heightOption, framesOption, warmupOption, outputOption, pngOption, traceOption})
+  {
+    parser.addOption(option);
+  }
+  parser.process(app);
+  auto brdf = brdfModeFromName(parser.value(brdfOption).toStdString());
+  if (!brdf)
+  {
+    std::cerr << "unknown BRDF " << parser.value(brdfOption).toStdString() << ", expected reference, fast or lut\n";
+    return EXIT_FAILURE;
+  }
+  // reject what the scene would otherwise clamp or misread, for the window as well as headless
+  constexpr int NoMaximum = std::numeric_limits<int>::max();
+  struct IntRange
+  {
+    const QCommandLineOption *option;
+    int minimum;
+    int maximum;
+  };
+  for (const auto &range : {IntRange{&lightsOption, 1, NGLScene::MaxLights},
+                            IntRange{&objectsOption, 1, NGLScene::MaxObjects},
+                            IntRange{&stochasticOption, 0, NGLScene::MaxStochasticSamples},
+                            IntRange{&shadowBudgetOption, 1, NoMaximum},
+                            IntRange{&shadowSizeOption, ShadowAtlas::MinFaceSize, ShadowAtlas::MaxFaceSize},
+                            IntRange{&widthOption, 1, NoMaximum}, IntRange{&heightOption, 1, NoMaximum},
+                            IntRange{&framesOption, 1, NoMaximum}, IntRange{&warmupOption, 0, NoMaximum}})
+  {
+    bool valid = false;
+    int value = parser.value(*range.option).toInt(&valid);
+    if (!valid || value < range.minimum || value > range.maximum)
+    {
+      std::cerr << "invalid --" << range.option->names().front().toStdString() << " "
+                << parser.value(*range.option).toStdString() << ", expected a whole number ";
+      if (range.maximum == NoMaximum)
+      {
+        std::cerr << "of at least " << range.minimum << '\n';
+      }
+      else
+      {
+        std::cerr << "from " << range.minimum << " to " << range.maximum << '\n';
+      }
+      return EXIT_FAILURE;
+    }
+  }
+  constexpr float NoLimit = std::numeric_limits<float>::max();
+  struct FloatRange
+  {
+    const QCommandLineOption *option;
+    float minimum;
+    float maximum;
+  };
+  for (const auto &range : {FloatRange{&lightingScaleOption, DeferredRenderer::MinLightingScale, 1.0f},
+                            FloatRange{&targetMsOption, 0.0f, NoLimit}, FloatRange{&brdfToleranceOption, 0.0f, NoLimit},
+                            FloatRange{&deferredToleranceOption, 0.0f, NoLimit}})
+  {
+    // --target-ms has no default and is off unless given
+    if (!parser.isSet(*range.option) && parser.value(*range.option).isEmpty())
+    {
+      continue;
+    }
+    bool valid = false;
+    float value = parser.value(*range.option).toFloat(&valid);
+    // written so NaN fails too
+    if (!valid || !(value >= range.minimum && value <= range.maximum))
+    {
+      std::cerr << "invalid --" << range.option->names().front().toStdString() << " "
+                << parser.value(*range.option).toStdString() << ", expected a number ";
+      if (range.maximum == NoLimit)
+      {
+        std::cerr << "of at least " << range.minimum << '\n';
+      }
+      else
+      {
+        std::cerr << "from " << range.minimum << " to " << range.maximum << '\n';
+      }
+      return EXIT_FAILURE;
+    }
+  }
+  // 0 for the default, which scales with the light count
+  float lightCutoff = 0.0f;
+  if (parser.isSet(lightCutoffOption))
+  {
+    bool valid = false;
+    lightCutoff = parser.value(lightCutoffOption).toFloat(&valid);
+    if (!valid || lightCutoff <= 0.0f)
+    {
+      std::cerr << "invalid --light-cutoff " << parser.value(lightCutoffOption).toStdString() << ", expected a radiance above 0\n";
+      return EXIT_FAILURE;
+    }
+  }
+  // converting needs no GL, a JSON rig or the generated set for the seed becomes a binary light file
+  if (parser.isSet(saveLightsOption))
+  {
+    LightSoA lights;
+    LightGenerator::Params params;
+    if (lightCutoff > 0.0f)
+    {
+      params.cutoff = lightCutoff;
+    }
+    auto lightFile = parser.value(lightFileOption).toStdString();
+    if (!lightFile.empty())
+    {
+      std::string error;
+      if (!LightFile::importJSON(lightFile, params.cutoff, lights, error))
+      {
+        std::cerr << error << '\n';
+        return EXIT_FAILURE;
+      }
+    }
+    else
+    {
+      lights.resize(static_cast<size_t>(parser.value(lightsOption).toInt()));
+      params.seed = parser.value(seedOption).toUInt();
+      if (lightCutoff <= 0.0f)
+      {
+        params.cutoff = LightGenerator::scaledCutoff(params.cutoff, lights.size());
+      }
+      LightGenerator().generate(lights, params);
+    }
+    auto output = parser.value(saveLightsOption).toStdString();
+    if (!LightFile::write(output, lights))
+    {
+      std::cerr << "unable to write " << output << '\n';
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
   // create an OpenGL format specifier
   QSurfaceFormat format;
   // set the number of samples for multisampling
@@ -29,19 +219,96 @@ int main(int argc, char **argv)
   format.setProfile(QSurfaceFormat::CoreProfile);
   // now set the depth buffer to 24 bits
   format.setDepthBufferSize(24);
+  // the window redraws on every frameSwapped so the swap interval sets the frame rate
+  format.setSwapInterval(parser.isSet(uncappedOption) ? 0 : 1);
+
+  if (parser.isSet(headlessOption) || parser.isSet(lightBenchOption) || parser.isSet(lightFileBenchOption) ||
+      parser.isSet(cpuBenchOption) || parser.isSet(cullBenchOption))
+  {
+    Benchmark::Options options;
+    options.numLights = parser.value(lightsOption).toInt();
+    options.numObjects = parser.value(objectsOption).toInt();
+    options.stochasticSamples = parser.value(stochasticOption).toInt();
+    options.depthPrepass = parser.isSet(depthPrepassOption);
+    options.lightingScale = parser.value(lightingScaleOption).toFloat();
+    options.targetMs = parser.value(targetMsOption).toFloat();
+    options.brdf = *brdf;
+    options.brdfTolerance = parser.value(brdfToleranceOption).toFloat();
+    options.deferredTolerance = parser.value(deferredToleranceOption).toFloat();
+    options.seed = parser.isSet(seedOption) ? parser.value(seedOption).toUInt() : options.seed;
+    options.deferred = parser.isSet(deferredOption);
+    options.clustered = !parser.isSet(noClustersOption);
+    options.showLights = !parser.isSet(noGizmosOption);
+    options.animate = parser.isSet(animateOption);
+    options.lightGeneration = parser.isSet(lightBenchOption);
+    options.lightFiles = parser.isSet(lightFileBenchOption);
+    options.lightFile = parser.value(lightFileOption).toStdString();
+    options.cpuReference = parser.isSet(cpuReferenceOption) || parser.isSet(cpuPngOption);
+    options.cpuPng = parser.value(cpuPngOption).toStdString();
+    options.cpuBench = parser.isSet(cpuBenchOption);
+    options.shadows = parser.isSet(shadowsOption);
+    options.shadowBudget = parser.value(shadowBudgetOption).toInt();
+    options.shadowSize = parser.value(shadowSizeOption).toInt();
+    options.cullLights = parser.isSet(cullLightsOption);
+    options.lightCutoff = lightCutoff;
+    options.lightCulling = parser.isSet(cullBenchOption);
+    options.shaderCache = parser.value(shaderCacheOption).toStdString();
+    options.clearShaderCache = parser.isSet(clearShaderCacheOption);
+    options.width = parser.value(widthOption).toInt();
+    options.height = parser.value(heightOption).toInt();
+    options.frames = parser.value(framesOption).toInt();
+    options.warmup = parser.value(warmupOption).toInt();
+    options.output = parser.value(outputOption).toStdString();
+    options.png = parser.value(pngOption).toStdString();
+    options.trace = parser.value(traceOption).toStdString();
+    Benchmark benchmark(format, options);
+    return benchmark.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
   // now we are going to create our scene window
-  NGLScene window;
+  auto scene = std::make_unique<NGLScene>();
+  scene->setNumLights(parser.value(lightsOption).toInt());
+  if (parser.isSet(seedOption))
+  {
+    scene->setSeed(parser.value(seedOption).toUInt());
+  }
+  scene->setDeferred(parser.isSet(deferredOption));
+  scene->setClustered(!parser.isSet(noClustersOption));
+  scene->setShowLights(!parser.isSet(noGizmosOption));
+  scene->setAnimateLights(parser.isSet(animateOption));
+  scene->setOnDemand(parser.isSet(onDemandOption));
+  scene->setPaused(parser.isSet(pausedOption));
+  scene->setLightFile(parser.value(lightFileOption).toStdString());
+  scene->setNumObjects(parser.value(objectsOption).toInt());
+  scene->setStochastic(parser.value(stochasticOption).toInt());
+  scene->setDepthPrepass(parser.isSet(depthPrepassOption));
+  scene->setLightingScale(parser.value(lightingScaleOption).toFloat());
+  scene->setTargetFrameMs(parser.value(targetMsOption).toFloat());
+  scene->setBRDFMode(*brdf);
+  scene->setShadows(parser.isSet(shadowsOption));
+  scene->setShadowBudget(parser.value(shadowBudgetOption).toInt());
+  scene->setShadowFaceSize(parser.value(shadowSizeOption).toInt());
+  scene->setCullLights(parser.isSet(cullLightsOption));
+  scene->setLightCutoff(lightCutoff);
+  scene->setShaderCacheDirectory(parser.value(shaderCacheOption).toStdString());
+  scene->setClearShaderCache(parser.isSet(clearShaderCacheOption));
+  scene->setPrecompileShaders(!parser.isSet(noPrecompileOption));
+  // the scene is its own window unless a render thread draws it into one that only handles input
+  std::unique_ptr<RenderWindow> renderWindow;
+  QWindow *window = scene.get();
+  if (parser.isSet(renderThreadOption))
+  {
+    renderWindow = std::make_unique<RenderWindow>(std::move(scene));
+    window = renderWindow.get();
+  }
   // and set the OpenGL format
-  window.setFormat(format);
+  window->setFormat(format);
   // we can now query the version to see if it worked
   std::cout<<"Profile is "<<format.majorVersion()<<" "<<format.minorVersion()<<"\n";
   // set the window size
-  window.resize(1024, 720);
+  window->resize(1024, 720);
   // and finally show
-  window.show();
+  window->show();
 
   return app.exec();
 }
-
-
-